@@ -288,6 +288,54 @@ do_checkbam(
 	return ret;
 }
 
+static int
+do_alloc(
+		void
+		)
+{
+	int ret = -1;
+
+	if (image) {
+		int count = 1;
+
+		char * param = get_current_arg();
+
+		while (argc > 0 && param[0] == '-') {
+			param = get_next_arg();
+
+			if (get_arg_is_option(param, "--count")) {
+				count = get_arg_parameter_int(param, 1);
+			}
+			else {
+				fprintf(stdout, "unknown parameter '%s' found.\n", param);
+				return -1;
+			}
+
+			param = get_current_arg();
+		}
+
+		cbmimage_blockaddress block_previous;
+
+		ret = 0;
+
+		for (int i = 0; i < count; ++i) {
+			cbmimage_blockaddress block;
+
+			if (cbmimage_bam_alloc(image, i ? &block_previous : NULL, &block)) {
+				fprintf(stdout, "could not allocate block %d of %d.\n", i + 1, count);
+				ret = -1;
+				break;
+			}
+
+			printf("allocated block %u/%u = %u.\n", block.ts.track, block.ts.sector, block.lba);
+
+			block_previous = block;
+		}
+	}
+
+	return ret;
+}
+
 static int
 do_validate(
 		void
@@ -295,7 +343,38 @@ do_validate(
 {
 	int ret = -1;
 	if (image) {
-		cbmimage_validate(image);
+		char * cachefile = NULL;
+		int    fix = 0;
+
+		char * param = get_current_arg();
+
+		while (argc > 0 && param[0] == '-') {
+			param = get_next_arg();
+
+			if (get_arg_is_option(param, "--cache")) {
+				cachefile = get_arg_parameter(param);
+			}
+			else if (get_arg_is_option(param, "--fix")) {
+				fix = 1;
+			}
+			else {
+				fprintf(stdout, "unknown parameter '%s' found.\n", param);
+				return -1;
+			}
+
+			param = get_current_arg();
+		}
+
+		if (cachefile) {
+			cbmimage_validate_cached(image, cachefile);
+		}
+		else {
+			cbmimage_validate(image);
+		}
+
+		if (fix && cbmimage_bam_rebuild(image)) {
+			fmt_print_verbose(1, "Error rebuilding the BAM!\n");
+		}
 		ret = 0;
 	}
 
@@ -350,9 +429,50 @@ dir_output_name(
 	printf("%-18s", output_buffer);
 }
 
+static
+const char *
+dir_type_name(
+		uint16_t type
+		)
+{
+	switch (type) {
+		case DIR_TYPE_DEL:
+			return "DEL";
+		case DIR_TYPE_SEQ:
+			return "SEQ";
+		case DIR_TYPE_PRG:
+			return "PRG";
+		case DIR_TYPE_USR:
+			return "USR";
+		case DIR_TYPE_REL:
+			return "REL";
+		case DIR_TYPE_PART1581:
+			return "CBM";
+		case DIR_TYPE_CMD_NATIVE:
+			return "NAT";
+
+		case DIR_TYPE_PART_NO:
+			return "NOP";
+		case DIR_TYPE_PART_CMD_NATIVE:
+			return "CNP";
+		case DIR_TYPE_PART_D64:
+			return "D64";
+		case DIR_TYPE_PART_D71:
+			return "D71";
+		case DIR_TYPE_PART_D81:
+			return "D81";
+		case DIR_TYPE_PART_SYSTEM:
+			return "SYS";
+
+		default:
+			return "   ";
+	}
+}
+
 static void
 output_dir(
-	cbmimage_fileimage * image
+	cbmimage_fileimage *       image,
+	const cbmimage_dir_match * match
 	)
 {
 	cbmimage_dir_entry * dir_entry = NULL;
@@ -367,9 +487,9 @@ output_dir(
 		printf("\n");
 	}
 
-	for (dir_entry = cbmimage_dir_get_first(image);
+	for (dir_entry = match ? cbmimage_dir_match_first(image, match) : cbmimage_dir_get_first(image);
 	     cbmimage_dir_get_is_valid(dir_entry);
-	     cbmimage_dir_get_next(dir_entry)
+	     match ? cbmimage_dir_match_next(dir_entry, match) : cbmimage_dir_get_next(dir_entry)
 	    )
 	{
 		if (cbmimage_dir_is_deleted(dir_entry)) {
@@ -382,54 +502,7 @@ output_dir(
 
 		char char_is_closed = dir_entry->is_closed ? ' ' : '*';
 		char char_is_locked = dir_entry->is_locked ? '<' : ' ';
-		char * imagetype = "   ";
-
-		switch (dir_entry->type) {
-			case DIR_TYPE_DEL:
-				imagetype = "DEL";
-				break;
-			case DIR_TYPE_SEQ:
-				imagetype = "SEQ";
-				break;
-			case DIR_TYPE_PRG:
-				imagetype = "PRG";
-				break;
-			case DIR_TYPE_USR:
-				imagetype = "USR";
-				break;
-			case DIR_TYPE_REL:
-				imagetype = "REL";
-				break;
-			case DIR_TYPE_PART1581:
-				imagetype = "CBM";
-				break;
-			case DIR_TYPE_CMD_NATIVE:
-				imagetype = "NAT";
-				break;
-
-			case DIR_TYPE_PART_NO:
-				imagetype = "NOP";
-				break;
-			case DIR_TYPE_PART_CMD_NATIVE:
-				imagetype = "CNP";
-				break;
-			case DIR_TYPE_PART_D64:
-				imagetype = "D64";
-				break;
-			case DIR_TYPE_PART_D71:
-				imagetype = "D71";
-				break;
-			case DIR_TYPE_PART_D81:
-				imagetype = "D81";
-				break;
-			case DIR_TYPE_PART_SYSTEM:
-				imagetype = "SYS";
-				break;
-
-			default:
-				imagetype = "   ";
-				break;
-		}
+		const char * imagetype = dir_type_name(dir_entry->type);
 
 		printf("%c%s%c - %3u/%3u",
 				char_is_closed, imagetype, char_is_locked,
@@ -479,6 +552,133 @@ output_dir(
 	cbmimage_dir_get_header_close(header_entry);
 }
 
+static void
+output_dir_snapshot(
+	cbmimage_fileimage *    image,
+	cbmimage_dir_view_order order
+	)
+{
+	size_t count;
+	size_t view_count;
+
+	cbmimage_dir_snapshot_entry * snapshot = cbmimage_dir_snapshot(image, &count);
+	size_t * view = cbmimage_dir_view(snapshot, count, order, NULL, &view_count);
+
+	for (size_t i = 0; i < view_count; ++i) {
+		cbmimage_dir_snapshot_entry * entry = &snapshot[view[i]];
+
+		cbmimage_dir_header_name name;
+
+		memset(&name, 0, sizeof name);
+		memcpy((char *) name.text, entry->name, sizeof entry->name);
+		name.end_index = entry->name_end_index;
+		name.length = sizeof entry->name;
+
+		printf("%5u ", entry->block_count);
+
+		dir_output_name(image, &name);
+
+		printf("%c%s%c - %3u/%3u - slot %3u/%3u:%02X\n",
+				entry->is_closed ? ' ' : '*',
+				dir_type_name(entry->type),
+				entry->is_locked ? '<' : ' ',
+				entry->start_block.ts.track,
+				entry->start_block.ts.sector,
+				entry->slot_block.ts.track,
+				entry->slot_block.ts.sector,
+				entry->slot_offset
+				);
+	}
+
+	cbmimage_dir_view_close(view);
+	cbmimage_dir_snapshot_close(snapshot);
+}
+
+static void
+output_dir_json(
+	cbmimage_fileimage * image
+	)
+{
+	size_t count;
+
+	cbmimage_dir_snapshot_entry * snapshot = cbmimage_dir_snapshot(image, &count);
+	const char ** names = cbmimage_petscii_convert_snapshot_names(snapshot, count, CHARSET_UTF8);
+
+	printf("[");
+
+	for (size_t i = 0, output_count = 0; names && i < count; ++i) {
+		cbmimage_dir_snapshot_entry * entry = &snapshot[i];
+
+		if (entry->is_deleted) {
+			continue;
+		}
+
+		printf("%s\n  { \"name\": \"", output_count++ ? "," : "");
+
+		for (const char * p = names[i]; *p; ++p) {
+			if (*p == '"' || *p == '\\') {
+				putchar('\\');
+			}
+			putchar(*p);
+		}
+
+		printf("\", \"type\": \"%s\", \"blocks\": %u, \"locked\": %s, \"closed\": %s }",
+				dir_type_name(entry->type),
+				entry->block_count,
+				entry->is_locked ? "true" : "false",
+				entry->is_closed ? "true" : "false"
+				);
+	}
+
+	printf("\n]\n");
+
+	cbmimage_petscii_names_close(names);
+	cbmimage_dir_snapshot_close(snapshot);
+}
+
+static void
+output_dir_count(
+	cbmimage_fileimage * image
+	)
+{
+	static const uint16_t types[] = {
+		DIR_TYPE_DEL, DIR_TYPE_SEQ, DIR_TYPE_PRG, DIR_TYPE_USR, DIR_TYPE_REL, DIR_TYPE_PART1581, DIR_TYPE_CMD_NATIVE,
+		DIR_TYPE_PART_NO, DIR_TYPE_PART_CMD_NATIVE, DIR_TYPE_PART_D64, DIR_TYPE_PART_D71, DIR_TYPE_PART_D81, DIR_TYPE_PART_SYSTEM
+	};
+
+	unsigned int count[sizeof types / sizeof types[0]] = { 0 };
+	unsigned int blocks[sizeof types / sizeof types[0]] = { 0 };
+
+	cbmimage_dir_entry * dir_entry;
+
+	for (dir_entry = cbmimage_dir_get_first_lazy(image);
+	     cbmimage_dir_get_is_valid(dir_entry);
+	     cbmimage_dir_get_next(dir_entry)
+	    )
+	{
+		if (cbmimage_dir_is_deleted(dir_entry)) {
+			continue;
+		}
+
+		cbmimage_dir_type type = cbmimage_dir_get_type(dir_entry);
+
+		for (size_t i = 0; i < sizeof types / sizeof types[0]; ++i) {
+			if (types[i] == type) {
+				++count[i];
+				blocks[i] += cbmimage_dir_get_block_count(dir_entry);
+				break;
+			}
+		}
+	}
+	cbmimage_dir_get_close(dir_entry);
+
+	for (size_t i = 0; i < sizeof types / sizeof types[0]; ++i) {
+		if (count[i]) {
+			printf("%s: %5u files, %5u blocks\n", dir_type_name(types[i]), count[i], blocks[i]);
+		}
+	}
+}
+
 static int
 do_dir(
 		void
@@ -487,7 +687,74 @@ do_dir(
 	int ret = -1;
 
 	if (image) {
-		output_dir(image);
+		int snapshot = 0;
+		int count = 0;
+		int json = 0;
+		char * pattern = NULL;
+		cbmimage_dir_view_order order = DIR_VIEW_ORDER_DIRECTORY;
+
+		char * param = get_current_arg();
+
+		while (argc > 0 && param[0] == '-') {
+			param = get_next_arg();
+
+			if (get_arg_is_option(param, "--snapshot")) {
+				snapshot = 1;
+			}
+			else if (get_arg_is_option(param, "--count")) {
+				count = 1;
+			}
+			else if (get_arg_is_option(param, "--json")) {
+				json = 1;
+			}
+			else if (get_arg_is_option(param, "--sort")) {
+				char * sort = get_arg_parameter(param);
+
+				if (sort && strcmp(sort, "name") == 0) {
+					order = DIR_VIEW_ORDER_NAME;
+				}
+				else if (sort && strcmp(sort, "size") == 0) {
+					order = DIR_VIEW_ORDER_SIZE;
+				}
+				else if (sort && strcmp(sort, "type") == 0) {
+					order = DIR_VIEW_ORDER_TYPE;
+				}
+				else {
+					fprintf(stdout, "unknown sort order '%s' found.\n", sort ? sort : "");
+					return -1;
+				}
+				snapshot = 1;
+			}
+			else if (get_arg_is_option(param, "--pattern")) {
+				pattern = get_arg_parameter(param);
+			}
+			else {
+				fprintf(stdout, "unknown parameter '%s' found.\n", param);
+				return -1;
+			}
+
+			param = get_current_arg();
+		}
+
+		cbmimage_dir_match match;
+
+		if (pattern && cbmimage_dir_match_compile(&match, pattern) != 0) {
+			fprintf(stdout, "invalid pattern '%s' found.\n", pattern);
+			return -1;
+		}
+
+		if (json) {
+			output_dir_json(image);
+		}
+		else if (snapshot) {
+			output_dir_snapshot(image, order);
+		}
+		else if (count) {
+			output_dir_count(image);
+		}
+		else {
+			output_dir(image, pattern ? &match : NULL);
+		}
 		ret = 0;
 	}
 
@@ -560,6 +827,168 @@ do_read(
 	return ret;
 }
 
+static int
+do_owner(
+		void
+		)
+{
+	int ret = -1;
+
+	if (image) {
+		char * parameter_block = NULL;
+
+		char * param = get_current_arg();
+
+		while (argc > 0 && param[0] == '-') {
+			param = get_next_arg();
+
+			if (get_arg_is_option(param, "--block")) {
+				parameter_block = get_arg_parameter(param);
+			}
+			else {
+				fprintf(stdout, "unknown parameter '%s' found.\n", param);
+				return -1;
+			}
+
+			param = get_current_arg();
+		}
+
+		if (parameter_block) {
+			cbmimage_blockaddress block;
+			cbmimage_block_owner  owner;
+			char                  owner_text[32];
+
+			get_blockaddress(image, &block, parameter_block);
+
+			if (cbmimage_image_get_block_owner(image, block, &owner) == 0) {
+				printf("block %u/%u = %u is owned by %s.\n", block.ts.track, block.ts.sector, block.lba,
+						cbmimage_fat_owner_format(owner, owner_text, sizeof owner_text));
+				ret = 0;
+			}
+		}
+		else {
+			cbmimage_image_owner_dump(image);
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+static cbmimage_walk_result
+walk_output_entry(
+		const cbmimage_walk_info * info,
+		void *                     context
+		)
+{
+	printf("%*s%5u ", (int) info->depth * 2, "", info->entry->block_count);
+
+	dir_output_name(info->image, &info->entry->name);
+
+	printf(" %s%s\n", dir_type_name(info->entry->type), info->is_dir ? " (dir)" : "");
+
+	return WALK_CONTINUE;
+}
+
+static int
+do_walk(
+		void
+		)
+{
+	int ret = -1;
+
+	if (image) {
+		if (cbmimage_walk(image, walk_output_entry, NULL) >= 0) {
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+static int
+do_statistics(
+		void
+		)
+{
+	int ret = -1;
+
+	if (image) {
+		cbmimage_bam_statistics * statistics = cbmimage_bam_statistics_get(image);
+
+		if (statistics) {
+			printf("%u blocks, %u free in %u runs.\n",
+					statistics->blocks, statistics->blocks_free, statistics->free_runs);
+
+			if (statistics->free_extent_largest_count > 0) {
+				printf("Largest free extent: %u blocks, starting at %u/%u.\n",
+						statistics->free_extent_largest_count,
+						statistics->free_extent_largest_first.ts.track,
+						statistics->free_extent_largest_first.ts.sector);
+			}
+
+			if (statistics->files > 0) {
+				printf("%u files in %u fragments.\n", statistics->files, statistics->files_fragments);
+			}
+
+			printf("\ntrack: free runs largest\n");
+
+			for (size_t track = 1; track < statistics->track_count; ++track) {
+				cbmimage_bam_track_statistics * track_statistics = &statistics->track[track];
+
+				printf("  %3zu: %4u %4u %7u\n",
+						track,
+						track_statistics->free,
+						track_statistics->free_runs,
+						track_statistics->free_run_largest);
+			}
+
+			cbmimage_bam_statistics_close(statistics);
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+static void
+showfile_output_file(
+	cbmimage_file * file
+	)
+{
+	int read;
+
+	do {
+		static char buffer[256];
+
+		read = cbmimage_file_read_next_block(file, buffer, sizeof buffer);
+
+		if (read >= 0) {
+			dump(buffer, read);
+		}
+	} while (read >= 0);
+}
+
+static void
+showfile_output_name(
+	cbmimage_fileimage * image,
+	const char *         name
+	)
+{
+	fmt_print_verbose(1, "Opening file \"%s\":\n", name);
+
+	cbmimage_file * file = cbmimage_file_open_by_name(image, name);
+
+	if (file) {
+		showfile_output_file(file);
+
+		cbmimage_file_close(file);
+	}
+	else {
+		fprintf(stdout, "file '%s' not found.\n", name);
+	}
+}
+
 static void
 showfile_output_no(
 	cbmimage_fileimage * image,
@@ -588,17 +1017,7 @@ showfile_output_no(
 			cbmimage_file * file = cbmimage_file_open_by_dir_entry(dir_entry);
 
 			if (file) {
-				int read;
-
-				do {
-					static char buffer[256];
-
-					read = cbmimage_file_read_next_block(file, buffer, sizeof buffer);
-
-					if (read >= 0) {
-						dump(buffer, read);
-					}
-				} while (read >= 0);
+				showfile_output_file(file);
 
 				cbmimage_file_close(file);
 			}
@@ -619,6 +1038,7 @@ do_showfile(
 	if (image) {
 		int numerical_file = 0;
 		int number_of_file = 0;
+		char * name_of_file = NULL;
 
 		char * param = get_current_arg();
 
@@ -629,6 +1049,9 @@ do_showfile(
 				numerical_file = 1;
 				number_of_file = get_arg_parameter_int(param, -1);
 			}
+			else if (get_arg_is_option(param, "--name")) {
+				name_of_file = get_arg_parameter(param);
+			}
 			else {
 				fprintf(stdout, "unknown parameter '%s' found.\n", param);
 				return -1;
@@ -642,6 +1065,11 @@ do_showfile(
 
 			showfile_output_no(image, number_of_file);
 
+			ret = 0;
+		}
+		else if (name_of_file) {
+			showfile_output_name(image, name_of_file);
+
 			ret = 0;
 		}
 	}
@@ -730,6 +1158,254 @@ do_chdir(
 	return ret;
 }
 
+static int
+do_create(
+		void
+		)
+{
+	int ret = -1;
+
+	if (image) {
+		char * name = NULL;
+		char * type_name = "PRG";
+		char * start = NULL;
+		int block_count = 0;
+		int count = 0;
+
+		char * param = get_current_arg();
+
+		while (argc > 0 && param[0] == '-') {
+			param = get_next_arg();
+
+			if (get_arg_is_option(param, "--name")) {
+				name = get_arg_parameter(param);
+			}
+			else if (get_arg_is_option(param, "--type")) {
+				type_name = get_arg_parameter(param);
+			}
+			else if (get_arg_is_option(param, "--start")) {
+				start = get_arg_parameter(param);
+			}
+			else if (get_arg_is_option(param, "--blocks")) {
+				block_count = get_arg_parameter_int(param, 0);
+			}
+			else if (get_arg_is_option(param, "--count")) {
+				count = get_arg_parameter_int(param, 0);
+			}
+			else {
+				fprintf(stdout, "unknown parameter '%s' found.\n", param);
+				return -1;
+			}
+
+			param = get_current_arg();
+		}
+
+		int type;
+
+		for (type = DIR_TYPE_DEL; type <= DIR_TYPE_CMD_NATIVE; ++type) {
+			if (type_name && strcmp(type_name, dir_type_name(type)) == 0) {
+				break;
+			}
+		}
+
+		if (name == NULL || type > DIR_TYPE_CMD_NATIVE) {
+			fprintf(stdout, "create needs a --name and a valid --type.\n");
+			return -1;
+		}
+
+		if (start == NULL && type != DIR_TYPE_DEL) {
+			fprintf(stdout, "create needs a --start for a file of type %s.\n", type_name);
+			return -1;
+		}
+
+		cbmimage_blockaddress start_block = cbmimage_block_unused;
+
+		if (start) {
+			get_blockaddress(image, &start_block, start);
+		}
+
+		ret = 0;
+
+		for (int i = count ? 1 : 0; i <= count; ++i) {
+			char name_numbered[32];
+
+			if (count) {
+				snprintf(name_numbered, sizeof name_numbered, "%s%d", name, i);
+			}
+			else {
+				snprintf(name_numbered, sizeof name_numbered, "%s", name);
+			}
+
+			cbmimage_dir_entry * dir_entry = cbmimage_dir_create_entry(image, name_numbered, type, start_block, block_count);
+
+			if (dir_entry == NULL) {
+				fprintf(stdout, "could not create '%s'.\n", name_numbered);
+				ret = -1;
+				break;
+			}
+
+			cbmimage_dir_get_close(dir_entry);
+		}
+	}
+
+	return ret;
+}
+
+static int
+delete_or_rename(
+		int is_rename
+		)
+{
+	int ret = -1;
+
+	if (image) {
+		char * name = NULL;
+		char * name_new = NULL;
+
+		char * param = get_current_arg();
+
+		while (argc > 0 && param[0] == '-') {
+			param = get_next_arg();
+
+			if (get_arg_is_option(param, "--name")) {
+				name = get_arg_parameter(param);
+			}
+			else if (is_rename && get_arg_is_option(param, "--to")) {
+				name_new = get_arg_parameter(param);
+			}
+			else {
+				fprintf(stdout, "unknown parameter '%s' found.\n", param);
+				return -1;
+			}
+
+			param = get_current_arg();
+		}
+
+		if (name == NULL || (is_rename && name_new == NULL)) {
+			fprintf(stdout, "%s needs a --name%s.\n", is_rename ? "rename" : "delete", is_rename ? " and a --to" : "");
+			return -1;
+		}
+
+		cbmimage_dir_entry * dir_entry = cbmimage_dir_find(image, name);
+
+		if (dir_entry == NULL) {
+			fprintf(stdout, "file '%s' not found.\n", name);
+		}
+		else {
+			int error = is_rename ? cbmimage_dir_rename_entry(dir_entry, name_new) : cbmimage_dir_delete_entry(dir_entry);
+
+			if (error) {
+				fprintf(stdout, "could not %s '%s'.\n", is_rename ? "rename" : "delete", name);
+			}
+			else {
+				ret = 0;
+			}
+
+			cbmimage_dir_get_close(dir_entry);
+		}
+	}
+
+	return ret;
+}
+
+static int
+do_delete(
+		void
+		)
+{
+	return delete_or_rename(0);
+}
+
+static int
+do_rename(
+		void
+		)
+{
+	return delete_or_rename(1);
+}
+
+static int
+do_compact(
+		void
+		)
+{
+	int ret = -1;
+
+	if (image) {
+		int keep_deleted = 0;
+
+		char * param = get_current_arg();
+
+		while (argc > 0 && param[0] == '-') {
+			param = get_next_arg();
+
+			if (get_arg_is_option(param, "--keep-deleted")) {
+				keep_deleted = 1;
+			}
+			else {
+				fprintf(stdout, "unknown parameter '%s' found.\n", param);
+				return -1;
+			}
+
+			param = get_current_arg();
+		}
+
+		int blocks_freed = cbmimage_dir_compact(image, keep_deleted);
+
+		if (blocks_freed < 0) {
+			fprintf(stdout, "could not compact the directory.\n");
+		}
+		else {
+			printf("%d directory blocks freed.\n", blocks_freed);
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+static int
+do_header(
+		void
+		)
+{
+	int ret = -1;
+
+	if (image) {
+		const cbmimage_dir_header * header = cbmimage_dir_get_header_cached(image);
+
+		if (header == NULL) {
+			fprintf(stdout, "there is no header.\n");
+		}
+		else {
+			const uint8_t * name = (const uint8_t *) header->name.text;
+			size_t name_length = 0;
+
+			while (name_length < (size_t) header->name.end_index && name[name_length] != 0xA0) {
+				++name_length;
+			}
+
+			char buffer[2 * sizeof header->name.text];
+
+			cbmimage_petscii_convert(name, name_length, CHARSET_ASCII, buffer, sizeof buffer);
+			printf("name:        \"%s\"\n", buffer);
+
+			cbmimage_petscii_convert(header->id, sizeof header->id, CHARSET_ASCII, buffer, sizeof buffer);
+			printf("id:          \"%s\"\n", buffer);
+
+			cbmimage_petscii_convert(header->dos_type, sizeof header->dos_type, CHARSET_ASCII, buffer, sizeof buffer);
+			printf("dos type:    \"%s\"\n", buffer);
+
+			printf("blocks free: %u\n", header->free_block_count);
+			printf("geos:        %s\n", header->is_geos ? "yes" : "no");
+
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
 typedef int execute_fct(void);
 
 typedef
@@ -760,6 +1436,19 @@ commands command_table[] = {
 	},
 
 	{ "dir", do_dir, "show the directory of an image",
+		"dir [--snapshot] [--sort=<order>] [--count] [--json] [--pattern=<pattern>]\n"
+		"  with --snapshot, the directory is read in one go, and the location\n"
+		"  of each entry in the directory is shown, too.\n"
+		"  with --sort, the directory is shown like with --snapshot, but sorted\n"
+		"  by <order>, which is one of \"name\", \"size\" or \"type\".\n"
+		"  with --pattern, only the files that match the CBM DOS pattern\n"
+		"  <pattern> (for example, \"A*=P\") are shown.\n"
+		"  with --count, the number of files of each type is shown.\n"
+		"  with --json, the directory is shown as JSON, with the names\n"
+		"  converted to UTF-8.\n",
+	},
+
+	{ "header", do_header, "show the header of an image",
 		"",
 	},
 
@@ -771,6 +1460,13 @@ commands command_table[] = {
 		"",
 	},
 
+	{ "alloc", do_alloc, "allocate blocks in the BAM",
+		"alloc [--count=<n>]\n"
+		"  allocates <n> blocks (default: 1) the way the DOS allocates the blocks\n"
+		"  of a file: the first one near the directory, and every other one\n"
+		"  after the previous one.\n",
+	},
+
 	{ "fat", do_fat, "create and output the FAT of an image",
 		"",
 	},
@@ -780,16 +1476,61 @@ commands command_table[] = {
 	},
 
 	{ "showfile", do_showfile, "show/extract a file from an image",
-		"",
+		"showfile [--numerical=<no>] [--name=<name>]\n"
+		"  with --numerical, show the <no>th file of the directory.\n"
+		"  with --name, show the file with the name <name>.\n",
 	},
 
 	{ "validate", do_validate, "validate an image",
-		"",
+		"validate [--cache=<file>] [--fix]\n"
+		"  with --cache, the result of the validation is stored in <file>, and\n"
+		"  loaded from there if the image has not changed in the meantime.\n"
+		"  with --fix, the BAM is rebuilt from the blocks that are in use.\n",
 	},
 
 	{ "chdir", do_chdir, "change to a subdir",
 		"",
 	},
+
+	{ "create", do_create, "create a directory entry",
+		"create --name=<name> [--type=<type>] --start=<block> [--blocks=<count>] [--count=<n>]\n"
+		"  creates a directory entry for a file <name> of type <type> (default: PRG)\n"
+		"  that starts at <block> and occupies <count> blocks. The blocks are not\n"
+		"  allocated. --start is optional for the type DEL only.\n"
+		"  with --count, <n> entries are created, and the numbers 1 to <n> are\n"
+		"  appended to the name.\n",
+	},
+
+	{ "delete", do_delete, "delete a directory entry",
+		"delete --name=<name>\n"
+		"  deletes the directory entry of the file <name>. The blocks of the\n"
+		"  file are not freed.\n",
+	},
+
+	{ "rename", do_rename, "rename a directory entry",
+		"rename --name=<name> --to=<newname>\n",
+	},
+
+	{ "compact", do_compact, "compact the directory",
+		"compact [--keep-deleted]\n"
+		"  packs the directory entries into as few directory blocks as possible,\n"
+		"  and frees the blocks that are not needed anymore.\n"
+		"  with --keep-deleted, the entries of deleted files are kept.\n",
+	},
+
+	{ "owner", do_owner, "show the owner of the blocks of an image",
+		"owner [--block=<t/s or lba>]\n"
+		"  without --block, output the owner of all used blocks.\n",
+	},
+
+	{ "walk", do_walk, "show the directories of all partitions and sub-directories",
+		"",
+	},
+
+	{ "statistics", do_statistics, "show the free space and the fragmentation of an image",
+		"statistics\n"
+		"  if the image has been validated before, the files are included.\n",
+	},
 };
 
 static
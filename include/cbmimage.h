@@ -304,6 +304,12 @@ struct cbmimage_dir_header_s {
 	/// the count of free blocks on this image
 	uint16_t free_block_count;
 
+	/// the disk ID as taken from the info block. No processing (for example, PETSCII conversion) is performed!
+	uint8_t id[2];
+
+	/// the DOS type (for example, "2A") as taken from the info block. No processing is performed!
+	uint8_t dos_type[2];
+
 	/// if set to 1, this is a GEOS file
 	unsigned int is_geos : 1;
 
@@ -392,6 +398,128 @@ struct cbmimage_dir_entry_s {
 
 } cbmimage_dir_entry;
 
+/** @brief A compact record of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * cbmimage_dir_snapshot() returns an array of these records, one for each
+ * directory entry. In contrast to cbmimage_dir_entry, only the data that
+ * is needed for a listing is decoded.
+ */
+typedef
+struct cbmimage_dir_snapshot_entry_s {
+
+	/** the name of the file as taken from the directory entry, padded with
+	 * shifted spaces (0xA0). No processing (for example, PETSCII conversion)
+	 * is performed!
+	 */
+	uint8_t name[16];
+
+	/// the index of the end of the file name, cf. cbmimage_dir_header_name
+	uint8_t name_end_index;
+
+	/// if set to 1, this entry is for a deleted file, cf. cbmimage_dir_is_deleted()
+	unsigned int is_deleted : 1;
+
+	/// if set to 1, this file is locked, cf. cbmimage_dir_entry
+	unsigned int is_locked : 1;
+
+	/// if set to 1, this file is closed correctly, cf. cbmimage_dir_entry
+	unsigned int is_closed : 1;
+
+	/// if set to 1, this is a GEOS file
+	unsigned int is_geos : 1;
+
+	/// type of this directory entry, as a cbmimage_dir_type
+	uint16_t type;
+
+	/// the count of occupied blocks on disk
+	uint16_t block_count;
+
+	/// the start of the file on the disk
+	cbmimage_blockaddress start_block;
+
+	/// the directory block that contains this entry
+	cbmimage_blockaddress slot_block;
+
+	/// the offset of this entry in the directory block slot_block
+	uint16_t slot_offset;
+
+} cbmimage_dir_snapshot_entry;
+
+/** @brief The character set names are converted to
+ * @ingroup cbmimage_petscii
+ */
+typedef
+enum cbmimage_charset_e {
+	CHARSET_ASCII = 0, ///< ASCII; characters without an ASCII equivalent are converted to '?'
+	CHARSET_UTF8  = 1, ///< UTF-8; the graphic characters are converted, too
+} cbmimage_charset;
+
+/** @brief A compiled CBM DOS file name pattern
+ * @ingroup cbmimage_dir
+ *
+ * This is the result of cbmimage_dir_match_compile(), and it is used with
+ * cbmimage_dir_match_first() and cbmimage_dir_match_next(). \n
+ * Don't make any assumptions about the contents; it can be copied freely,
+ * and it does not need to be freed.
+ */
+typedef
+struct cbmimage_dir_match_s {
+
+	/// @internal the characters the name must have at the positions where mask is 0xFF
+	uint8_t name[16];
+
+	/// @internal 0xFF for each position of the name that must be equal to name, 0 otherwise
+	uint8_t mask[16];
+
+	/** @internal bit i is set if position i of the pattern is a '?'.
+	 * These positions match every character, but not the end of the name.
+	 */
+	uint16_t any_char;
+
+	/// @internal the CBM DOS file type the entry must have, or -1 if any type matches
+	int type;
+
+} cbmimage_dir_match;
+
+/** @brief The order of the entries of a cbmimage_dir_view()
+ * @ingroup cbmimage_dir
+ */
+typedef
+enum cbmimage_dir_view_order_e {
+	DIR_VIEW_ORDER_DIRECTORY = 0, ///< the order of the directory
+	DIR_VIEW_ORDER_NAME      = 1, ///< sorted by name
+	DIR_VIEW_ORDER_SIZE      = 2, ///< sorted by block count, then by name
+	DIR_VIEW_ORDER_TYPE      = 3, ///< sorted by type, then by name
+} cbmimage_dir_view_order;
+
+/** @brief The filter for the entries of a cbmimage_dir_view()
+ * @ingroup cbmimage_dir
+ *
+ * Each of the flags is -1 if the entries are not filtered by it. If it is
+ * 0 or 1, only entries where the flag of the cbmimage_dir_snapshot_entry
+ * is 0 or 1, respectively, are part of the view.
+ */
+typedef
+struct cbmimage_dir_view_filter_s {
+
+	/// only entries of this type (cf. cbmimage_dir_type) are part of the view; -1 for all types
+	int type;
+
+	/// filter on cbmimage_dir_snapshot_entry::is_deleted
+	int is_deleted;
+
+	/// filter on cbmimage_dir_snapshot_entry::is_locked
+	int is_locked;
+
+	/// filter on cbmimage_dir_snapshot_entry::is_closed
+	int is_closed;
+
+	/// filter on cbmimage_dir_snapshot_entry::is_geos
+	int is_geos;
+
+} cbmimage_dir_view_filter;
+
 /* disk image handling */
 
 /** @brief The type of the libcbmimage image
@@ -452,6 +580,60 @@ struct cbmimage_fileimage_s {
 
 } cbmimage_fileimage;
 
+/** @brief The result of a cbmimage_walk_visitor
+ * @ingroup cbmimage_dir
+ */
+typedef
+enum cbmimage_walk_result_e {
+	WALK_CONTINUE = 0, ///< continue the walk; if the entry is a directory, descend into it
+	WALK_PRUNE    = 1, ///< continue the walk, but do not descend into this entry
+	WALK_STOP     = 2, ///< stop the walk immediately
+} cbmimage_walk_result;
+
+/** @brief The maximum depth of directories cbmimage_walk() descends into
+ * @ingroup cbmimage_dir
+ */
+#define CBMIMAGE_WALK_DEPTH_MAX 16
+
+/** @brief The information given to a cbmimage_walk_visitor
+ * @ingroup cbmimage_dir
+ */
+typedef
+struct cbmimage_walk_info_s {
+
+	/// the image, set to the directory that contains entry
+	cbmimage_fileimage * image;
+
+	/// the directory entry that is visited
+	cbmimage_dir_entry * entry;
+
+	/// the depth of the directory that contains entry; 0 is the directory the walk started in
+	unsigned int depth;
+
+	/** the directory entries of the directories that contain entry,
+	 * starting with the outermost one. There are depth elements.
+	 */
+	cbmimage_dir_entry * const * parent;
+
+	/// if set to 1, entry is a directory or partition the walk descends into, unless pruned
+	unsigned int is_dir : 1;
+
+} cbmimage_walk_info;
+
+/** @brief Type for the visitor of cbmimage_walk()
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] info
+ *    the directory entry that is visited, with its context
+ *
+ * @param[in] context
+ *    the context that was given to cbmimage_walk()
+ *
+ * @return
+ *    what to do next, cf. cbmimage_walk_result
+ */
+typedef cbmimage_walk_result cbmimage_walk_visitor(const cbmimage_walk_info * info, void * context);
+
 /** @brief cbmimage loop detector struct
  * @ingroup cbmimage_loop
  *
@@ -523,6 +705,48 @@ struct cbmimage_fat_entry_s {
 
 } cbmimage_fat_entry;
 
+/** @brief The type of the owner of a block
+ * @ingroup cbmimage_fat
+ *
+ * This type is used in cbmimage_block_owner to describe which
+ * structure of the image occupies a specific block.
+ */
+typedef
+enum cbmimage_block_owner_type_e {
+	BLOCK_OWNER_NONE,             ///< the block is not owned by anything, that is, it is not in use
+	BLOCK_OWNER_FILE,             ///< the block belongs to a file (or a partition); dir_index tells which one
+	BLOCK_OWNER_SIDESECTOR,       ///< the block is a (super) side-sector of a REL file; dir_index tells which one
+	BLOCK_OWNER_GEOS_INFO,        ///< the block is the GEOS info block of a file; dir_index tells which one
+	BLOCK_OWNER_INFO,             ///< the block is the info block (disk header) of the image
+	BLOCK_OWNER_BAM,              ///< the block contains (a part of) the BAM
+	BLOCK_OWNER_DIRECTORY,        ///< the block is part of the directory
+	BLOCK_OWNER_GEOS_BORDER,      ///< the block is the GEOS border block
+	BLOCK_OWNER_RESERVED,         ///< the block is reserved by the DOS (e.g., 2nd directory track of the D71, blocks outside of a partition)
+	BLOCK_OWNER_LAST              ///< not a type, just an end marker
+} cbmimage_block_owner_type;
+
+/** @brief cbmimage owner of a block
+ * @ingroup cbmimage_fat
+ *
+ * This structure describes which structure of the image occupies a
+ * specific block.
+ */
+typedef
+struct cbmimage_block_owner_s {
+
+	/// the type of the owner of the block
+	cbmimage_block_owner_type type;
+
+	/** if type is BLOCK_OWNER_FILE, BLOCK_OWNER_SIDESECTOR or BLOCK_OWNER_GEOS_INFO,
+	 * this is the index of the directory entry that owns this block. \n
+	 * The index counts all directory entries (including deleted ones) as
+	 * they are returned by cbmimage_dir_get_first() and cbmimage_dir_get_next(),
+	 * starting with 0.
+	 */
+	uint16_t dir_index;
+
+} cbmimage_block_owner;
+
 /** @brief cbmimage FAT structure
  * @ingroup cbmimage_fat
  *
@@ -531,25 +755,95 @@ struct cbmimage_fat_entry_s {
  *
  * It helps in fast navigation inside of an image.
  *
+ * The layout of this structure is internal, as the FAT is stored in
+ * different representations (cf. cbmimage_fat_compact()). Use the
+ * cbmimage_fat_get() and cbmimage_fat_set() family of functions to access it.
+ */
+typedef struct cbmimage_fat_s cbmimage_fat;
+
+/** @brief The type of a mismatch between the BAM and the FAT
+ * @ingroup cbmimage_bam
+ */
+typedef
+enum cbmimage_bam_mismatch_type_e {
+	BAM_MISMATCH_FREE_IN_BAM,     ///< the block is used according to the FAT, but the BAM tells it is free
+	BAM_MISMATCH_USED_IN_BAM      ///< the block is not used according to the FAT, but the BAM tells it is used
+} cbmimage_bam_mismatch_type;
+
+/** @brief A range of blocks where the BAM and the FAT do not match
+ * @ingroup cbmimage_bam
+ *
+ * cf. cbmimage_bam_compare_fat()
  */
 typedef
-struct cbmimage_fat_s {
+struct cbmimage_bam_mismatch_s {
 
-	/// the FAT entries for each LBA block inside of this image.
-	cbmimage_fat_entry *entry;
+	/// the type of the mismatch
+	cbmimage_bam_mismatch_type type;
 
-	/// the image data
-	cbmimage_fileimage *image;
+	/// the first block of this range
+	cbmimage_blockaddress block_first;
 
-	/// the number of elements in this FAT
-	size_t elements;
+	/// the last block of this range
+	cbmimage_blockaddress block_last;
 
-	/** some additional space for the various data. Don't make any assumptions
-	 * about the contents or the layout here!
+} cbmimage_bam_mismatch;
+
+/** @brief Statistics of the free blocks of one track
+ * @ingroup cbmimage_bam
+ */
+typedef
+struct cbmimage_bam_track_statistics_s {
+
+	/// the number of free blocks on this track
+	uint16_t free;
+
+	/// the number of runs of consecutive free sectors on this track
+	uint16_t free_runs;
+
+	/// the number of blocks of the longest run of free sectors on this track
+	uint16_t free_run_largest;
+
+} cbmimage_bam_track_statistics;
+
+/** @brief Statistics of the free space and the fragmentation of an image
+ * @ingroup cbmimage_bam
+ *
+ * cf. cbmimage_bam_statistics_get()
+ */
+typedef
+struct cbmimage_bam_statistics_s {
+
+	/// the number of blocks on the image
+	uint16_t blocks;
+
+	/// the number of free blocks on the image, including the directory tracks
+	uint16_t blocks_free;
+
+	/// the number of runs of free blocks (with consecutive LBAs)
+	uint16_t free_runs;
+
+	/// the first block of the largest run of free blocks
+	cbmimage_blockaddress free_extent_largest_first;
+
+	/// the number of blocks of the largest run of free blocks
+	uint16_t free_extent_largest_count;
+
+	/// the number of files (only if the image has been validated)
+	uint16_t files;
+
+	/** the number of fragments of all files (only if the image has been validated). \n
+	 * files_fragments / files is the average fragmentation.
 	 */
-	uint8_t bufferarray[];
+	uint32_t files_fragments;
+
+	/// the number of elements in track; this is the number of tracks + 1
+	size_t track_count;
+
+	/// the statistics of every track, indexed by the track number
+	cbmimage_bam_track_statistics * track;
 
-} cbmimage_fat;
+} cbmimage_bam_statistics;
 
 /* file handling */
 
@@ -638,6 +932,9 @@ const void *         cbmimage_image_get_raw                    (cbmimage_fileima
 size_t               cbmimage_image_get_raw_size               (cbmimage_fileimage *);
 void                 cbmimage_image_close                      (cbmimage_fileimage *);
 void                 cbmimage_image_fat_dump                   (cbmimage_fileimage *, int linear);
+int                  cbmimage_image_get_block_owner            (cbmimage_fileimage *, cbmimage_blockaddress block, cbmimage_block_owner * owner);
+void                 cbmimage_image_owner_dump                 (cbmimage_fileimage *);
+uint64_t             cbmimage_image_hash                       (cbmimage_fileimage *);
 
 const char *         cbmimage_get_imagetype_name               (cbmimage_fileimage *);
 const char *         cbmimage_get_filename                     (cbmimage_fileimage *);
@@ -678,17 +975,49 @@ int                  cbmimage_bam_check_consistency            (cbmimage_fileima
 int                  cbmimage_get_blocks_free                  (cbmimage_fileimage *);
 cbmimage_BAM_state   cbmimage_bam_get                          (cbmimage_fileimage *, cbmimage_blockaddress block);
 int                  cbmimage_bam_get_free_on_track            (cbmimage_fileimage * image, uint8_t track);
+int                  cbmimage_bam_alloc                        (cbmimage_fileimage *, const cbmimage_blockaddress * block_previous, cbmimage_blockaddress * block);
+int                  cbmimage_bam_free                         (cbmimage_fileimage *, cbmimage_blockaddress block);
+int                  cbmimage_bam_rebuild                      (cbmimage_fileimage *);
+cbmimage_bam_statistics * cbmimage_bam_statistics_get          (cbmimage_fileimage *);
+void                 cbmimage_bam_statistics_close             (cbmimage_bam_statistics * statistics);
+int                  cbmimage_bam_compare_fat                  (cbmimage_fileimage *, cbmimage_bam_mismatch ** mismatches, size_t * count);
+void                 cbmimage_bam_mismatch_print               (cbmimage_fileimage *, const cbmimage_bam_mismatch * mismatches, size_t count);
+void                 cbmimage_bam_mismatch_close               (cbmimage_bam_mismatch * mismatches);
 
 cbmimage_dir_header *cbmimage_dir_get_header                   (cbmimage_fileimage *);
+const cbmimage_dir_header * cbmimage_dir_get_header_cached     (cbmimage_fileimage *);
 void                 cbmimage_dir_get_header_close             (cbmimage_dir_header *);
 cbmimage_dir_entry * cbmimage_dir_get_first                    (cbmimage_fileimage *);
+cbmimage_dir_entry * cbmimage_dir_get_first_lazy               (cbmimage_fileimage *);
 int                  cbmimage_dir_get_next                     (cbmimage_dir_entry *);
 int                  cbmimage_dir_get_is_valid                 (cbmimage_dir_entry *);
 char *               cbmimage_dir_extract_name                 (cbmimage_dir_header_name *, char * name, size_t len);
 int                  cbmimage_dir_is_deleted                   (cbmimage_dir_entry *);
+const uint8_t *      cbmimage_dir_get_raw                      (cbmimage_dir_entry *);
+const uint8_t *      cbmimage_dir_get_raw_name                 (cbmimage_dir_entry *);
+cbmimage_dir_type    cbmimage_dir_get_type                     (cbmimage_dir_entry *);
+cbmimage_blockaddress cbmimage_dir_get_start_block             (cbmimage_dir_entry *);
+uint16_t             cbmimage_dir_get_block_count              (cbmimage_dir_entry *);
+int                  cbmimage_dir_decode                       (cbmimage_dir_entry *);
 int                  cbmimage_dir_chdir                        (cbmimage_dir_entry *);
 int                  cbmimage_dir_chdir_close                  (cbmimage_fileimage *);
 void                 cbmimage_dir_get_close                    (cbmimage_dir_entry *);
+cbmimage_dir_entry * cbmimage_dir_find                         (cbmimage_fileimage *, const char * name);
+cbmimage_dir_entry * cbmimage_dir_create_entry                 (cbmimage_fileimage *, const char * name, cbmimage_dir_type type, cbmimage_blockaddress start_block, uint16_t block_count);
+int                  cbmimage_dir_delete_entry                 (cbmimage_dir_entry *);
+int                  cbmimage_dir_rename_entry                 (cbmimage_dir_entry *, const char * name);
+int                  cbmimage_dir_compact                      (cbmimage_fileimage *, int keep_deleted);
+cbmimage_dir_snapshot_entry * cbmimage_dir_snapshot              (cbmimage_fileimage *, size_t * count);
+void                 cbmimage_dir_snapshot_close               (cbmimage_dir_snapshot_entry * snapshot);
+size_t *             cbmimage_dir_view                         (const cbmimage_dir_snapshot_entry * snapshot, size_t count, cbmimage_dir_view_order order, const cbmimage_dir_view_filter * filter, size_t * view_count);
+void                 cbmimage_dir_view_close                   (size_t * view);
+const char **        cbmimage_petscii_convert_snapshot_names   (const cbmimage_dir_snapshot_entry * snapshot, size_t count, cbmimage_charset charset);
+void                 cbmimage_petscii_names_close              (const char ** names);
+size_t               cbmimage_petscii_convert                  (const uint8_t * petscii, size_t length, cbmimage_charset charset, char * buffer, size_t buffer_size);
+int                  cbmimage_dir_match_compile                (cbmimage_dir_match * match, const char * pattern);
+cbmimage_dir_entry * cbmimage_dir_match_first                  (cbmimage_fileimage *, const cbmimage_dir_match * match);
+int                  cbmimage_dir_match_next                   (cbmimage_dir_entry *, const cbmimage_dir_match * match);
+int                  cbmimage_walk                             (cbmimage_fileimage *, cbmimage_walk_visitor * visitor, void * context);
 
 cbmimage_loop *      cbmimage_loop_create                      (cbmimage_fileimage *);
 void                 cbmimage_loop_close                       (cbmimage_loop *);
@@ -696,8 +1025,11 @@ int                  cbmimage_loop_mark                        (cbmimage_loop *,
 int                  cbmimage_loop_check                       (cbmimage_loop *, cbmimage_blockaddress block);
 
 int                  cbmimage_validate                         (cbmimage_fileimage *);
+int                  cbmimage_validate_cached                  (cbmimage_fileimage *, const char * filename);
+int                  cbmimage_validate_cache_load              (cbmimage_fileimage *, const char * filename, int * verdict);
+int                  cbmimage_validate_cache_save              (cbmimage_fileimage *, const char * filename, int verdict);
 
-cbmimage_file * cbmimage_file_open_by_name(const char * filename);
+cbmimage_file * cbmimage_file_open_by_name(cbmimage_fileimage * image, const char * filename);
 cbmimage_file * cbmimage_file_open_by_dir_entry(cbmimage_dir_entry * dir_entry);
 void            cbmimage_file_close(cbmimage_file * file);
 int             cbmimage_file_read_next_block(cbmimage_file * file, uint8_t * buffer, size_t buffer_size);
@@ -712,9 +1044,16 @@ int cbmimage_print_set_function(cbmimage_print_function_type print_function);
 cbmimage_fat *         cbmimage_fat_create(cbmimage_fileimage * image);
 int                    cbmimage_fat_set   (cbmimage_fat *, cbmimage_blockaddress block, cbmimage_blockaddress target);
 int                    cbmimage_fat_clear (cbmimage_fat *, cbmimage_blockaddress block);
+int                    cbmimage_fat_claim (cbmimage_fat *, cbmimage_blockaddress block, cbmimage_blockaddress target, cbmimage_block_owner owner, cbmimage_block_owner * owner_previous);
 cbmimage_blockaddress  cbmimage_fat_get   (cbmimage_fat *, cbmimage_blockaddress block);
 int                    cbmimage_fat_is_used(cbmimage_fat *, cbmimage_blockaddress block);
+int                    cbmimage_fat_set_owner(cbmimage_fat *, cbmimage_blockaddress block, cbmimage_block_owner owner);
+cbmimage_block_owner   cbmimage_fat_get_owner(cbmimage_fat *, cbmimage_blockaddress block);
+const char *           cbmimage_fat_owner_type_name(cbmimage_block_owner_type type);
+char *                 cbmimage_fat_owner_format(cbmimage_block_owner owner, char * buffer, size_t len);
 void                   cbmimage_fat_dump  (cbmimage_fat *, int linear);
+void                   cbmimage_fat_dump_owner(cbmimage_fat *);
+int                    cbmimage_fat_compact(cbmimage_fat *);
 void                   cbmimage_fat_close (cbmimage_fat *);
 
 cbmimage_chain *       cbmimage_chain_start      (cbmimage_fileimage *, cbmimage_blockaddress);
@@ -40,6 +40,9 @@ struct cbmimage_i_dir_entry_internal_s {
 	/// loop detector
 	cbmimage_loop * loop_detector;
 
+	/// if set, the entries are not decoded, cf. cbmimage_dir_get_first_lazy()
+	unsigned int is_lazy : 1;
+
 } cbmimage_i_dir_entry_internal;
 
 
@@ -477,6 +480,258 @@ struct cbmimage_i_bam_selector_s {
  */
 typedef cbmimage_i_bam_selector cbmimage_i_bam_counter_selector;
 
+/** @brief BAM location of a specific track
+ * @ingroup cbmimage_bam @internal
+ *
+ * This type describes where the BAM of one specific track is located.
+ * It is precalculated from the BAM selectors (cf. cbmimage_i_bam_selector)
+ * for every track when an image is opened or a directory is changed, so
+ * that the BAM functions do not need to search the selectors.
+ */
+typedef
+struct cbmimage_i_bam_track_s {
+
+	/// pointer to the first byte of the BAM bitmap of this track
+	uint8_t * bam;
+
+	/// pointer to the BAM counter of this track. NULL if there is no BAM counter.
+	uint8_t * counter;
+
+	/// the number of bytes of the BAM bitmap of this track
+	uint8_t data_count;
+
+	/// if != 0, the bits of the BAM bitmap are stored in reverse order
+	uint8_t reverse_order;
+
+} cbmimage_i_bam_track;
+
+/** @brief decoded BAM
+ * @ingroup cbmimage_bam @internal
+ *
+ * This type contains the BAM of all tracks in a normalized form, that is,
+ * independent of the number of BAM blocks, of the selectors and of the
+ * bit order on disk. It is decoded once, and it is kept up to date when
+ * the BAM is changed through the BAM functions.
+ *
+ * It is only a read cache: every change is written through to the BAM
+ * blocks of the image immediately; there is no delayed write-back.
+ * If a BAM block is written with cbmimage_write_block(), the decoded BAM
+ * is discarded (cf. cbmimage_i_bam_cache_block_written()).
+ */
+typedef
+struct cbmimage_i_bam_decoded_s {
+
+	/** bitmap that is indexed by the LBA. \n
+	 * Bit (lba % 8) of byte (lba / 8) is set if the block is free.
+	 */
+	uint8_t * free_map;
+
+	/** the number of free blocks of each track according to free_map, indexed by the track number. \n
+	 * Bits above the last sector of a track (damaged BAM) are not counted.
+	 */
+	uint16_t * free_count;
+
+	/** the BAM counter of each track as stored on disk, indexed by the track number. \n
+	 * If there is no BAM counter (DNP), this is the same as free_count.
+	 */
+	uint16_t * counter;
+
+} cbmimage_i_bam_decoded;
+
+/** @brief cbmimage FAT extent
+ * @ingroup cbmimage_fat @internal
+ *
+ * This structure describes a run of consecutive LBAs inside of a compacted
+ * FAT (cf. cbmimage_fat_compact()).
+ *
+ * The block start + i (with 0 <= i < count) links to target + i * step.
+ * Thus, a run of unused blocks is described with step = 0, and a run of
+ * blocks with the same interleave is described with step = 1.
+ */
+typedef
+struct cbmimage_fat_extent_s {
+
+	/// the first LBA of this extent
+	uint16_t start;
+
+	/// the number of LBAs in this extent
+	uint16_t count;
+
+	/// the target of the first LBA of this extent
+	uint16_t target;
+
+	/// the step with which the target advances from one LBA to the next (0 or 1)
+	uint16_t step;
+
+} cbmimage_fat_extent;
+
+/** @brief cbmimage FAT owner extent
+ * @ingroup cbmimage_fat @internal
+ *
+ * This structure describes a run of consecutive LBAs inside of a compacted
+ * FAT (cf. cbmimage_fat_compact()) which all have the same owner.
+ */
+typedef
+struct cbmimage_fat_owner_extent_s {
+
+	/// the first LBA of this extent
+	uint16_t start;
+
+	/// the number of LBAs in this extent
+	uint16_t count;
+
+	/// the owner of all blocks of this extent
+	cbmimage_block_owner owner;
+
+} cbmimage_fat_owner_extent;
+
+/** @brief cbmimage FAT structure
+ * @ingroup cbmimage_fat @internal
+ *
+ * This structure holds a file allocaton table (FAT) into the image, build from
+ * the T/S links at the beginning of each block.
+ *
+ * It helps in fast navigation inside of an image.
+ *
+ * The FAT is either stored densely (entry and owner are set), or it is
+ * compacted into extents (extent and owner_extent are set). Use the
+ * cbmimage_fat_get() and cbmimage_fat_set() family of functions to access
+ * it; they handle both representations.
+ *
+ */
+struct cbmimage_fat_s {
+
+	/// the FAT entries for each LBA block inside of this image. NULL if the FAT is compacted.
+	cbmimage_fat_entry *entry;
+
+	/// the owner of each LBA block inside of this image. NULL if the FAT is compacted.
+	cbmimage_block_owner *owner;
+
+	/// the extents of the FAT entries, sorted by LBA. NULL if the FAT is not compacted.
+	cbmimage_fat_extent *extent;
+
+	/// the number of elements in extent
+	size_t extent_count;
+
+	/// the extents of the owners, sorted by LBA. NULL if the FAT is not compacted.
+	cbmimage_fat_owner_extent *owner_extent;
+
+	/// the number of elements in owner_extent
+	size_t owner_extent_count;
+
+	/// the image data
+	cbmimage_fileimage *image;
+
+	/// the number of elements in this FAT
+	size_t elements;
+
+};
+
+/** @brief one entry of the directory index
+ * @ingroup cbmimage_dir @internal
+ */
+typedef
+struct cbmimage_i_dir_index_slot_s {
+
+	/// the hash of the normalized name of the entry
+	uint32_t hash;
+
+	/// the offset of the entry in the directory block
+	uint16_t offset;
+
+	/// the directory block that contains the entry
+	cbmimage_blockaddress block;
+
+} cbmimage_i_dir_index_slot;
+
+/** @brief index of the directory
+ * @ingroup cbmimage_dir @internal
+ *
+ * This type allows to find a directory entry by its name without
+ * walking the directory, cf. cbmimage_dir_find().
+ */
+typedef
+struct cbmimage_i_dir_index_s {
+
+	/// the (non-deleted) entries of the directory, in directory order
+	cbmimage_i_dir_index_slot * slot;
+
+	/// the number of elements in slot
+	size_t slot_count;
+
+	/** the hash table with open addressing. \n
+	 * Each element is the index into slot plus 1; 0 marks an unused element.
+	 */
+	uint32_t * table;
+
+	/// the number of elements in table; this is always a power of 2
+	size_t table_size;
+
+	/// the LBAs of all blocks of the directory chain the index has been built from
+	uint16_t * block_lba;
+
+	/// the number of elements in block_lba
+	size_t block_count;
+
+} cbmimage_i_dir_index;
+
+/** @brief one directory block of the free slot index
+ * @ingroup cbmimage_dir @internal
+ */
+typedef
+struct cbmimage_i_dir_slots_block_s {
+
+	/// the directory block
+	cbmimage_blockaddress block;
+
+	/// bit i is set if the slot at offset i * CBMIMAGE_DIR_ENTRY_NEXT_ONE is free
+	uint8_t free_mask;
+
+} cbmimage_i_dir_slots_block;
+
+/** @brief index of the free slots of the directory
+ * @ingroup cbmimage_dir @internal
+ *
+ * This type allows to find a free slot for a new directory entry without
+ * walking the directory, cf. cbmimage_dir_create_entry().
+ */
+typedef
+struct cbmimage_i_dir_slots_s {
+
+	/// the blocks of the directory, in directory order
+	cbmimage_i_dir_slots_block * block;
+
+	/// the number of elements in block
+	size_t block_count;
+
+	/// the number of elements block can hold
+	size_t block_capacity;
+
+	/// all blocks before this index have no free slot
+	size_t block_first_free;
+
+} cbmimage_i_dir_slots;
+
+/** @brief filter for the raw data of a directory entry
+ * @ingroup cbmimage_dir @internal
+ *
+ * cf. cbmimage_i_dir_get_filtered()
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slot
+ *    pointer to the raw directory entry in the directory block
+ *
+ * @param[in] context
+ *    the context that was given to cbmimage_i_dir_get_filtered()
+ *
+ * @return
+ *    - != 0 if the directory entry passes the filter
+ *    - 0 if it is skipped
+ */
+typedef int (*cbmimage_i_dir_filter)(cbmimage_fileimage * image, const uint8_t * slot, const void * context);
+
 /** @brief BAM counter selector
  * @ingroup cbmimage_bam @internal
  *
@@ -683,6 +938,16 @@ struct cbmimage_image_settings_s {
 	 */
 	uint8_t dir_tracks[2];
 
+	/** the interleave the DOS uses when it allocates the blocks of a file. \n
+	 * 0 is handled like 1.
+	 */
+	uint8_t interleave;
+
+	/** the interleave the DOS uses when it appends a block to the directory. \n
+	 * 0 is handled like 1.
+	 */
+	uint8_t dir_interleave;
+
 	/// address of the last block on this image
 	cbmimage_blockaddress lastblock;
 
@@ -701,6 +966,57 @@ struct cbmimage_image_settings_s {
 	/// the location of the BAM counter.
 	cbmimage_i_bam_counter_selector * bam_counter;
 
+	/** the location of the BAM for each track, indexed by the track number. \n
+	 * NULL if there is no BAM.
+	 */
+	cbmimage_i_bam_track * bam_track;
+
+	/** the decoded BAM. \n
+	 * It is created on first use; NULL if it has not been created yet.
+	 */
+	cbmimage_i_bam_decoded * bam_decoded;
+
+	/** a bitmap that is indexed by the LBA. \n
+	 * Bit (lba % 8) of byte (lba / 8) is set if the block is really unused,
+	 * that is, its contents are the same as after formatting
+	 * (cf. cbmimage_i_bam_check_really_unused()). \n
+	 * It is created on first use; NULL if it has not been created yet.
+	 */
+	uint8_t * really_unused_map;
+
+	/** all tracks that are nearer to the directory track than this distance
+	 * have no free blocks. \n
+	 * cbmimage_bam_alloc() starts its search for the first block of a file here.
+	 */
+	uint8_t bam_alloc_distance;
+
+	/** the number of free blocks on the image, cf. cbmimage_get_blocks_free(). \n
+	 * Only valid if bam_blocks_free_valid is set.
+	 */
+	uint16_t bam_blocks_free;
+
+	/// set if bam_blocks_free is valid
+	unsigned int bam_blocks_free_valid : 1;
+
+	/** the index of the directory for cbmimage_dir_find(). \n
+	 * NULL if it has not been built yet.
+	 */
+	cbmimage_i_dir_index * dir_index;
+
+	/** the index of the free slots of the directory for cbmimage_dir_create_entry(). \n
+	 * NULL if it has not been built yet.
+	 */
+	cbmimage_i_dir_slots * dir_slots;
+
+	/** the cached directory header, cf. cbmimage_dir_get_header_cached(). \n
+	 * It is created on first use; NULL if it has not been created yet. \n
+	 * Its contents are only valid if dir_header_valid is set.
+	 */
+	cbmimage_dir_header * dir_header;
+
+	/// set if dir_header is valid
+	unsigned int dir_header_valid : 1;
+
 	/** @brief data offset for subdir
 	 *
 	 * For subdirs/partitions that are handled as part of an absolute section on the image
@@ -750,6 +1066,13 @@ struct cbmimage_image_settings_s {
 	/** @brief set if this is a GEOS disk */
 	unsigned int is_geos : 1;
 
+	/** @brief set if the memory of these settings is not owned by them
+	 *
+	 * If this is 1, cbmimage_dir_chdir_close() does not free the settings,
+	 * cf. cbmimage_i_dir_chdir_frame().
+	 */
+	unsigned int is_borrowed : 1;
+
 	/// block of the GEOS border block.
 	cbmimage_blockaddress geos_border;
 
@@ -818,6 +1141,14 @@ void cbmimage_i_d4m_image_open(cbmimage_fileimage * image);
 void cbmimage_i_dnp_image_open(cbmimage_fileimage * image);
 #endif
 
+/** @brief @internal mark for the last block of a FAT
+ */
+#define CBMIMAGE_FAT_LASTBLOCK 0xFFFFu
+
+/** @brief @internal mark for an unused block in a FAT
+ */
+#define CBMIMAGE_FAT_UNUSED    0x0000u
+
 uint8_t * cbmimage_i_get_address_of_block(cbmimage_fileimage * image, cbmimage_blockaddress block);
 
 void cbmimage_i_init_bam_selector(cbmimage_image_settings * settings, cbmimage_i_bam_selector * selector, size_t selector_count);
@@ -852,6 +1183,10 @@ void cbmimage_i_fmt_print(const char * fmt, ...);
 
 cbmimage_dir_entry * cbmimage_i_dir_get_clone(cbmimage_dir_entry * dir_entry);
 int cbmimage_i_bam_check_really_unused(cbmimage_image_settings * settings, cbmimage_blockaddress block);
+void cbmimage_i_bam_cache_invalidate(cbmimage_image_settings * settings);
+int cbmimage_i_bam_track_table_create(cbmimage_image_settings * settings);
+void cbmimage_i_bam_track_table_close(cbmimage_image_settings * settings);
+void cbmimage_i_bam_cache_block_written(cbmimage_fileimage * image, cbmimage_blockaddress block);
 
 int cbmimage_i_dir_get_partition_data(cbmimage_dir_entry * dir_entry, cbmimage_blockaddress * block_first, cbmimage_blockaddress * block_last, size_t * block_count);
 
@@ -866,6 +1201,27 @@ int cbmimage_i_d64_chdir_partition_init(cbmimage_image_settings * settings);
 int cbmimage_i_d71_chdir_partition_init(cbmimage_image_settings * settings);
 int cbmimage_i_d81_chdir_partition_init(cbmimage_image_settings * settings);
 
-int cbmimage_i_validate_1581_partition(cbmimage_fileimage * image, cbmimage_blockaddress block_start, int count);
+int cbmimage_i_validate_1581_partition(cbmimage_fileimage * image, cbmimage_blockaddress block_start, int count, cbmimage_block_owner owner);
+uint16_t cbmimage_i_fat_get_lba(const cbmimage_fat * fat, uint16_t lba);
+void cbmimage_i_fat_get_used_map(const cbmimage_fat * fat, uint64_t * used_map, size_t word_count);
+cbmimage_block_owner cbmimage_i_fat_get_owner_lba(const cbmimage_fat * fat, uint16_t lba);
+int cbmimage_i_fat_update_link(cbmimage_fat * fat, cbmimage_blockaddress block, const uint8_t * link_old);
+int cbmimage_i_mark_global_and_local(cbmimage_fileimage * image, cbmimage_loop * loop_detector, cbmimage_blockaddress block_start, cbmimage_blockaddress block_current, cbmimage_blockaddress block_target, cbmimage_block_owner owner);
+cbmimage_dir_entry * cbmimage_i_dir_get_at_slot(cbmimage_fileimage * image, cbmimage_blockaddress block, uint16_t offset);
+int cbmimage_i_dir_get_slot(cbmimage_dir_entry * dir_entry, cbmimage_blockaddress * block, uint16_t * offset);
+void cbmimage_i_dir_name_normalize(const uint8_t * name, size_t name_length, uint8_t * normalized);
+void cbmimage_i_dir_index_invalidate(cbmimage_image_settings * settings);
+void cbmimage_i_dir_index_block_written(cbmimage_fileimage * image, cbmimage_blockaddress block);
+int cbmimage_i_dir_decode(cbmimage_fileimage * image, const uint8_t * slot, cbmimage_dir_entry * entry);
+int cbmimage_i_dir_slot_is_unused(cbmimage_fileimage * image, const uint8_t * slot);
+int cbmimage_i_dir_array_grow(void ** array, size_t * capacity, size_t element_size);
+cbmimage_dir_entry * cbmimage_i_dir_open(cbmimage_fileimage * image);
+int cbmimage_i_dir_get_filtered(cbmimage_dir_entry * dir_entry, cbmimage_i_dir_filter filter, const void * context);
+int cbmimage_i_dir_chdir_frame(cbmimage_dir_entry * dir_entry, cbmimage_image_settings * frame);
+int cbmimage_i_bam_alloc_on_track(cbmimage_fileimage * image, cbmimage_blockaddress block_previous, uint8_t interleave, cbmimage_blockaddress * block);
+void cbmimage_i_dir_slots_invalidate(cbmimage_image_settings * settings);
+void cbmimage_i_dir_slots_block_written(cbmimage_fileimage * image, cbmimage_blockaddress block);
+void cbmimage_i_dir_header_block_written(cbmimage_fileimage * image, cbmimage_blockaddress block);
+void cbmimage_i_dir_header_cache_close(cbmimage_image_settings * settings);
 
 #endif // #ifndef CBMIMAGE_INTERNAL_H
@@ -42,6 +42,10 @@ enum {
 
 enum {
 	CBMIMAGE_HEADER_ENTRY_NAME_LENGTH    = 0x10u,
+
+	// these offsets are relative to the start of the disk name
+	CBMIMAGE_HEADER_ENTRY_ID_OFFSET       = 0x12u,
+	CBMIMAGE_HEADER_ENTRY_DOS_TYPE_OFFSET = 0x15u,
 };
 
 enum {
@@ -10,6 +10,7 @@
 #include "cbmimage/helper.h"
 
 #include <assert.h>
+#include <string.h>
 
 enum { BAM_MASK_COUNT = 0x20 };
 
@@ -20,6 +21,55 @@ struct {
 	uint8_t mask[BAM_MASK_COUNT];
 } bam_mask_t;
 
+/** @brief @internal table with the bit-reversed values of all byte values
+ * @ingroup cbmimage_bam
+ *
+ * Entry i contains the value of i with the bit order reversed
+ * (bit 0 <-> bit 7, bit 1 <-> bit 6, ...).
+ */
+static const uint8_t cbmimage_i_reverse_bit_order_table[256] = {
+	0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+	0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+	0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+	0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+	0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+	0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+	0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+	0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+	0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+	0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+	0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+	0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+	0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+	0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+	0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+	0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF,
+};
+
+/** @brief @internal table with the number of "1" bits of all byte values
+ * @ingroup cbmimage_bam
+ *
+ * Entry i contains the number of "1" bits in i.
+ */
+static const uint8_t cbmimage_i_countbits_table[256] = {
+	0x00, 0x01, 0x01, 0x02, 0x01, 0x02, 0x02, 0x03, 0x01, 0x02, 0x02, 0x03, 0x02, 0x03, 0x03, 0x04,
+	0x01, 0x02, 0x02, 0x03, 0x02, 0x03, 0x03, 0x04, 0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05,
+	0x01, 0x02, 0x02, 0x03, 0x02, 0x03, 0x03, 0x04, 0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05,
+	0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05, 0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06,
+	0x01, 0x02, 0x02, 0x03, 0x02, 0x03, 0x03, 0x04, 0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05,
+	0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05, 0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06,
+	0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05, 0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06,
+	0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06, 0x04, 0x05, 0x05, 0x06, 0x05, 0x06, 0x06, 0x07,
+	0x01, 0x02, 0x02, 0x03, 0x02, 0x03, 0x03, 0x04, 0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05,
+	0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05, 0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06,
+	0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05, 0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06,
+	0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06, 0x04, 0x05, 0x05, 0x06, 0x05, 0x06, 0x06, 0x07,
+	0x02, 0x03, 0x03, 0x04, 0x03, 0x04, 0x04, 0x05, 0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06,
+	0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06, 0x04, 0x05, 0x05, 0x06, 0x05, 0x06, 0x06, 0x07,
+	0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x05, 0x06, 0x04, 0x05, 0x05, 0x06, 0x05, 0x06, 0x06, 0x07,
+	0x04, 0x05, 0x05, 0x06, 0x05, 0x06, 0x06, 0x07, 0x05, 0x06, 0x06, 0x07, 0x06, 0x07, 0x07, 0x08,
+};
+
 /** @brief @internal reverse the bit order in the byte
  * @ingroup cbmimage_bam
  *
@@ -30,11 +80,7 @@ struct {
  *    the byte value with the reversed bits
  *
  * @remark
- *   - An extremly simple algorithm is used, just shifting out
- *     a bit from the input and shifting it in into the output
- *     in reverse order.
- *
- * @todo reversing can be optimized, for example by using a lookup table
+ *   - A lookup table is used.
  *
  */
 static
@@ -43,44 +89,31 @@ reverse_bit_order(
 		uint8_t input
 		)
 {
-	uint8_t output = 0;
-
-	for (int j = 0; j < 8; ++j) {
-		output <<= 1;
-		output |= (input & 1);
-		input >>= 1;
-	}
-	return output;
+	return cbmimage_i_reverse_bit_order_table[input];
 }
 
 /** @brief @internal count the number of "1" bits
  * @ingroup cbmimage_bam
  *
  * @param[in] value
- *    values of which to count the number of "1" bits
+ *    pointer to the values of which to count the number of "1" bits
  *
  * @return
  *    The number of "1" bits in value
  *
  * @remark
- *   - An extremly simple algorithm is used, just counting the
- *     bits in a loop.
+ *   - A lookup table is used, counting one byte at a time.
  */
 static
 int
 cbmimage_i_countbits(
-		bam_mask_t value
+		const bam_mask_t * value
 		)
 {
 	int result = 0;
 
 	for (int i = 0; i < BAM_MASK_COUNT; ++i) {
-		uint8_t bam_byte = value.mask[i];
-
-		for (int j = 0; j < 8; ++j) {
-			result += (bam_byte & 1) ? 1 : 0;
-			bam_byte >>= 1;
-		}
+		result += cbmimage_i_countbits_table[value->mask[i]];
 	}
 
 	return result;
@@ -161,6 +194,95 @@ cbmimage_i_get_right_selector(
 	return selector_number;
 }
 
+/** @brief @internal create the table of the BAM locations of all tracks
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *    - This must be called after the BAM selectors have been initialized,
+ *      that is, after opening an image or after changing the directory.
+ *    - If there is no BAM, no table is created.
+ */
+int
+cbmimage_i_bam_track_table_create(
+		cbmimage_image_settings * settings
+		)
+{
+	assert(settings != NULL);
+
+	cbmimage_i_bam_track_table_close(settings);
+
+	if (settings->bam_count == 0 || settings->bam == NULL) {
+		return 0;
+	}
+
+	cbmimage_i_bam_track * bam_track = cbmimage_i_xalloc((settings->maxtracks + 1) * sizeof *bam_track);
+
+	if (bam_track == NULL) {
+		return -1;
+	}
+
+	for (uint16_t track = 1; track <= settings->maxtracks; ++track) {
+		int selector_number = cbmimage_i_get_right_selector(settings, settings->bam, settings->bam_count, track);
+
+		if (selector_number < 0) {
+			cbmimage_i_xfree(bam_track);
+			return -1;
+		}
+
+		cbmimage_i_bam_selector * selector = &settings->bam[selector_number];
+
+		assert(selector->data_count > 0);
+		assert(selector->data_count <= BAM_MASK_COUNT);
+
+		bam_track[track].bam = &selector->buffer[selector->startoffset + (track - selector->starttrack) * selector->multiplier];
+		bam_track[track].data_count = selector->data_count;
+		bam_track[track].reverse_order = selector->reverse_order;
+
+		if (settings->bam_counter) {
+			selector_number = cbmimage_i_get_right_selector(settings, settings->bam_counter, settings->bam_count, track);
+
+			if (selector_number < 0) {
+				cbmimage_i_xfree(bam_track);
+				return -1;
+			}
+
+			cbmimage_i_bam_counter_selector * counter_selector = &settings->bam_counter[selector_number];
+
+			assert(counter_selector->data_count == 0);
+
+			bam_track[track].counter = &counter_selector->buffer[counter_selector->startoffset + (track - counter_selector->starttrack) * counter_selector->multiplier];
+		}
+	}
+
+	settings->bam_track = bam_track;
+
+	return 0;
+}
+
+/** @brief @internal free the table of the BAM locations of all tracks
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ */
+void
+cbmimage_i_bam_track_table_close(
+		cbmimage_image_settings * settings
+		)
+{
+	assert(settings != NULL);
+
+	cbmimage_i_xfree(settings->bam_track);
+	settings->bam_track = NULL;
+}
+
 /** @brief @internal output a BAM bitmap
  * @ingroup cbmimage_bam
  *
@@ -222,31 +344,25 @@ cbmimage_i_check_max_bam_of_track(
 		return -1;
 	}
 	uint16_t sectors_on_track = cbmimage_get_sectors_in_track(settings->image, track);
-	uint16_t remaining_sectors_on_track = sectors_on_track;
 
-	for (int i = 0; i < BAM_MASK_COUNT; ++i) {
-		if (remaining_sectors_on_track >= 8) {
-			remaining_sectors_on_track -= 8;
-		}
-		else if (remaining_sectors_on_track == 0) {
-			if (mask.mask[i] != 0) {
-				cbmimage_i_fmt_print("Track %u: Bits marked which are not allowed, no. of sectors is %u.\n",
-						track, sectors_on_track);
-				cbmimage_i_bam_print(mask);
-				cbmimage_i_fmt_print("\n");
-				return -1;
-			}
-		}
-		else {
-			uint8_t local_mask = 0xFFu << remaining_sectors_on_track;
-			if ((mask.mask[i] & local_mask) != 0) {
-				cbmimage_i_fmt_print("Track %u: Bits marked which are not allowed, no. of sectors is %u.\n",
-						track, sectors_on_track);
-				cbmimage_i_bam_print(mask);
-				cbmimage_i_fmt_print("\n");
-				return -1;
-			}
-		}
+	// all bits above the last sector must be 0: find them in the partial byte, and OR all bytes after it
+	int index = sectors_on_track / 8;
+	uint8_t not_allowed = 0;
+
+	if (index < BAM_MASK_COUNT && (sectors_on_track % 8) != 0) {
+		not_allowed = mask.mask[index++] & (uint8_t) (0xFFu << (sectors_on_track % 8));
+	}
+
+	for ( /* unchanged */ ; index < BAM_MASK_COUNT; ++index) {
+		not_allowed |= mask.mask[index];
+	}
+
+	if (not_allowed != 0) {
+		cbmimage_i_fmt_print("Track %u: Bits marked which are not allowed, no. of sectors is %u.\n",
+				track, sectors_on_track);
+		cbmimage_i_bam_print(mask);
+		cbmimage_i_fmt_print("\n");
+		return -1;
 	}
 
 	return 0;
@@ -278,40 +394,143 @@ cbmimage_i_get_bam_of_track(
 		bam_mask_t *              mask
 		)
 {
-	if (settings->bam_count == 0) {
+	if (settings->bam_track == NULL) {
 		return -1;
 	}
 
-	int selector_number = cbmimage_i_get_right_selector(settings, settings->bam, settings->bam_count, track);
-
-	assert(selector_number >= 0);
+	assert(track > 0);
+	assert(track <= settings->maxtracks);
 
-	if (selector_number < 0) {
+	if (track < 1 || track > settings->maxtracks) {
 		return -1;
 	}
 
-	uint8_t offset_bam = settings->bam[selector_number].startoffset + (track - settings->bam[selector_number].starttrack) * settings->bam[selector_number].multiplier; // offset to where the BAM is located in the block
+	const cbmimage_i_bam_track * bam_track = &settings->bam_track[track];
 
-	assert(settings->bam[selector_number].data_count > 0);
-	assert(settings->bam[selector_number].data_count <= BAM_MASK_COUNT);
-
-	for (int i = settings->bam[selector_number].data_count; i < BAM_MASK_COUNT; ++i) {
+	for (int i = bam_track->data_count; i < BAM_MASK_COUNT; ++i) {
 		mask->mask[i] = 0;
 	}
 
-	for (int i = settings->bam[selector_number].data_count - 1; i >= 0; --i) {
-		uint8_t bam_byte = settings->bam[selector_number].buffer[offset_bam + i];
-		if (settings->bam[selector_number].reverse_order) {
-			mask->mask[i] = reverse_bit_order(bam_byte);
-		}
-		else {
-			mask->mask[i] = bam_byte;
+	if (bam_track->reverse_order) {
+		for (int i = 0; i < bam_track->data_count; ++i) {
+			mask->mask[i] = reverse_bit_order(bam_track->bam[i]);
 		}
 	}
+	else {
+		memcpy(mask->mask, bam_track->bam, bam_track->data_count);
+	}
 
 	return 0;
 }
 
+/** @brief @internal decode the BAM of all tracks
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @return
+ *    - pointer to the decoded BAM (cf. cbmimage_image_settings::bam_decoded)
+ *    - NULL if the image has no BAM, or an error occurred
+ *
+ * @remark
+ *    - The BAM is only decoded once; afterwards, the cached decoded BAM
+ *      is returned, until it is invalidated with cbmimage_i_bam_cache_invalidate().
+ *    - The free counts are calculated from the BAM bitmap, while the
+ *      counters are taken from the BAM, as these might differ on a
+ *      damaged image.
+ *    - Bits above the last sector of a track (cf. cbmimage_i_check_max_bam_of_track())
+ *      are neither part of the bitmap nor of the free counts.
+ */
+static
+cbmimage_i_bam_decoded *
+cbmimage_i_bam_decode(
+		cbmimage_image_settings * settings
+		)
+{
+	if (settings->bam_decoded) {
+		return settings->bam_decoded;
+	}
+
+	if (settings->bam_track == NULL) {
+		return NULL;
+	}
+
+	cbmimage_fileimage * image = settings->image;
+
+	uint16_t maxtrack = cbmimage_get_max_track(image);
+	size_t   count_size = (maxtrack + 1) * sizeof(uint16_t);
+
+	// the decoded BAM, the counts and the bitmap are allocated together
+	cbmimage_i_bam_decoded * decoded = cbmimage_i_xalloc(sizeof *decoded + 2 * count_size
+			+ (cbmimage_get_max_lba(image) + 1 + 7) / 8);
+
+	if (decoded == NULL) {
+		return NULL;
+	}
+
+	decoded->free_count = (uint16_t *) &decoded[1];
+	decoded->counter    = decoded->free_count + maxtrack + 1;
+	decoded->free_map   = (uint8_t *) (decoded->counter + maxtrack + 1);
+
+	for (uint16_t track = 1; track <= maxtrack; ++track) {
+		bam_mask_t bam_mask;
+
+		if (cbmimage_i_get_bam_of_track(settings, track, &bam_mask) < 0) {
+			cbmimage_i_xfree(decoded);
+			return NULL;
+		}
+
+		cbmimage_blockaddress block;
+		cbmimage_blockaddress_init_from_ts_value(image, &block, track, 0);
+
+		uint16_t sectors_on_track = cbmimage_get_sectors_in_track(image, track);
+
+		// only the bits of existing sectors are counted; on a damaged BAM,
+		// there might be bits set above the last sector.
+		decoded->free_count[track] = 0;
+
+		for (uint16_t sector = 0; sector < sectors_on_track; ++sector) {
+			if (bam_mask.mask[sector / 8] & (1u << (sector % 8))) {
+				uint16_t lba = block.lba + sector;
+				decoded->free_map[lba / 8] |= 1u << (lba % 8);
+				++decoded->free_count[track];
+			}
+		}
+
+		// if there is no specific BAM counter present (DNP images),
+		// the free count is used instead
+		decoded->counter[track] = settings->bam_track[track].counter
+			? *settings->bam_track[track].counter
+			: decoded->free_count[track];
+	}
+
+	settings->bam_decoded = decoded;
+
+	return decoded;
+}
+
+/** @brief @internal get the decoded BAM as an LBA indexed bitmap
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @return
+ *    - pointer to the bitmap (cf. cbmimage_i_bam_decoded::free_map)
+ *    - NULL if the image has no BAM, or an error occurred
+ */
+static
+const uint8_t *
+cbmimage_i_bam_get_free_map(
+		cbmimage_image_settings * settings
+		)
+{
+	cbmimage_i_bam_decoded * decoded = cbmimage_i_bam_decode(settings);
+
+	return decoded ? decoded->free_map : NULL;
+}
+
 /** @brief @internal get the BAM counter of a specific track
  * @ingroup cbmimage_bam
  *
@@ -336,258 +555,1286 @@ cbmimage_i_get_bam_counter_of_track(
 		uint8_t                   track
 		)
 {
-	if (settings->bam_counter == NULL) {
-		// there is no specific BAM counter present (DNP images).
-		// Because of this, calculate it on my own by adding
-		// the free entries in the BAM for this track
+	cbmimage_i_bam_decoded * decoded = cbmimage_i_bam_decode(settings);
 
-		bam_mask_t bam_mask;
-		if (cbmimage_i_get_bam_of_track(settings, track, &bam_mask) < 0) {
-			return 0;
-		}
-		return cbmimage_i_countbits(bam_mask);
-	}
-
-	if (settings->bam_count == 0) {
+	if (decoded == NULL || track < 1 || track > settings->maxtracks) {
 		return 0;
 	}
-	else {
-		int selector_number = cbmimage_i_get_right_selector(settings, settings->bam_counter, settings->bam_count, track);
-
-		assert(selector_number >= 0);
 
-		if (selector_number < 0) {
-			return 0;
-		}
-
-		uint8_t offset_bam = settings->bam_counter[selector_number].startoffset + (track - settings->bam_counter[selector_number].starttrack) * settings->bam_counter[selector_number].multiplier; // offset to where the BAM is located in the block
-
-		assert(settings->bam_counter[selector_number].data_count == 0);
-
-		return settings->bam_counter[selector_number].buffer[offset_bam];
-	}
+	return decoded->counter[track];
 }
 
-/** @brief @internal check if a block is really unused, that is, it's value is
+/** @brief @internal classify a block as really unused, that is, it's value is
  * the same as after formatting
  *
  * @ingroup cbmimage_bam
  *
- * @param[in] settings
- *    pointer to the image data internal settings
+ * @param[in] buffer
+ *    pointer to the contents of the block
  *
- * @param[in] block
- *    the address of the block to check
+ * @param[in] bytes_in_block
+ *    the number of bytes in the block
  *
  * @return
  *    - 0 if the block is used
  *    - != 0 otherwise
  *
  * @remark
- *    - If the block does not exist, the result is unspecified.
- *      Thus, be careful that you provide a valid track.
- *
  *    - It is tested if the block is all "0" (0x00, 0x00, 0x00, ..., 0x00)
  *      OR if it is all but the first value "1" (0x??, 0x01, 0x01, ..., 0x01)
  *      The second scheme is used in the 1541 for no apparant reason. The 0x??
  *      is often 0x4B (the result of the GCR conversion), but not on the first
  *      track!
+ *    - Comparing the buffer with itself, shifted by one byte, tests if all
+ *      bytes are identical; this lets memcmp() do the work on whole words.
  */
+static
 int
-cbmimage_i_bam_check_really_unused(
-		cbmimage_image_settings * settings,
-		cbmimage_blockaddress     block
+cbmimage_i_bam_classify_really_unused(
+		const uint8_t * buffer,
+		uint16_t        bytes_in_block
 		)
 {
-	assert(settings != NULL);
-	uint8_t * buffer = cbmimage_i_get_address_of_block(settings->image, block);
-
-	assert(buffer != NULL);
-
-	if (buffer == NULL) {
-		return 0;
-	}
-
-	uint16_t bytes_in_block = cbmimage_get_bytes_in_block(settings->image);
-
 	if (buffer[2] == 1) {
 		// empty (1541 and above): 0x??, 0x01, 0x01, ..., with 0x?? often being 0x4B
-		for (int i = 1; i < bytes_in_block; ++i) {
-			if (buffer[i] != 1) {
-				return 0;
-			}
-		}
-		return 1;
+		return buffer[1] == 1 && memcmp(&buffer[1], &buffer[2], bytes_in_block - 2) == 0;
 	}
 	else if (buffer[2] == 0) {
 		// empty (1541 and above): all 0x00
-		for (int i = 0; i < bytes_in_block; ++i) {
-			if (buffer[i] != 0) {
-				return 0;
-			}
-		}
-		return 1;
+		return buffer[0] == 0 && memcmp(&buffer[0], &buffer[1], bytes_in_block - 1) == 0;
 	}
 
 	return 0;
 }
 
-/** @brief get the unused/used state of a block in the BAM
+/** @brief @internal create the map of the really unused blocks
  *
  * @ingroup cbmimage_bam
  *
- * @param[in] image
- *    pointer to the image data
- *
- * @param[in] block
- *    the address of the block to check
+ * @param[in] settings
+ *    pointer to the image data internal settings
  *
  * @return
- *    - the BAM state (BAM_REALLY_FREE, BAM_USED, BAM_FREE).
+ *    - pointer to the map (cf. cbmimage_image_settings::really_unused_map)
+ *    - NULL if an error occurred
  *
  * @remark
- *    - If the block does not exist, the result is unspecified.
- *      Thus, be careful that you provide a valid track.
- *
+ *    - The map is only created once; afterwards, the cached map
+ *      is returned, until it is invalidated with cbmimage_i_bam_cache_invalidate().
  */
-cbmimage_BAM_state
-cbmimage_bam_get(
-		cbmimage_fileimage *   image,
-		cbmimage_blockaddress  block
+static
+const uint8_t *
+cbmimage_i_bam_get_really_unused_map(
+		cbmimage_image_settings * settings
 		)
 {
-	assert(image);
-	assert(image->settings);
+	if (settings->really_unused_map) {
+		return settings->really_unused_map;
+	}
 
-	/// @todo: optimize. Getting the whole track just to extract one byte
-	/// is a little bit of overhead. This can be optimized
-	bam_mask_t bam_of_track;
-	if (cbmimage_i_get_bam_of_track(image->settings, block.ts.track, &bam_of_track) < 0) {
-		return -1;
+	cbmimage_fileimage * image = settings->image;
+
+	uint16_t max_lba = cbmimage_get_max_lba(image);
+	uint16_t bytes_in_block = cbmimage_get_bytes_in_block(image);
+
+	uint8_t * really_unused_map = cbmimage_i_xalloc((max_lba + 1 + 7) / 8);
+
+	if (really_unused_map == NULL) {
+		return NULL;
 	}
 
-	unsigned int index = block.ts.sector / 8;
-	unsigned int bitpos = block.ts.sector % 8;
+	for (uint16_t lba = 1; lba <= max_lba; ++lba) {
+		cbmimage_blockaddress block;
+		CBMIMAGE_BLOCK_SET_FROM_LBA(image, block, lba);
 
-	cbmimage_BAM_state bam_state = (bam_of_track.mask[index] & (1ull << bitpos)) ? BAM_FREE : BAM_USED;
+		const uint8_t * buffer = cbmimage_i_get_address_of_block(image, block);
 
-	if (bam_state == BAM_FREE && cbmimage_i_bam_check_really_unused(image->settings, block)) {
-		bam_state = BAM_REALLY_FREE;
+		if (buffer && cbmimage_i_bam_classify_really_unused(buffer, bytes_in_block)) {
+			really_unused_map[lba / 8] |= 1u << (lba % 8);
+		}
 	}
 
-	return bam_state;
+	settings->really_unused_map = really_unused_map;
+
+	return really_unused_map;
 }
 
-/** @brief check the consistency of a BAM
+/** @brief @internal check if a block is really unused, that is, it's value is
+ * the same as after formatting
+ *
  * @ingroup cbmimage_bam
  *
- * @param[in] image
- *    pointer to the image data
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @param[in] block
+ *    the address of the block to check
  *
  * @return
- *    - 0 if the BAM is consistent
- *    - != 0 if not
+ *    - 0 if the block is used
+ *    - != 0 otherwise
  *
  * @remark
- *   A BAM is consistent if the following applies:
- *   - no track has free blocks for sectors that do not exist
- *   - the free block count of a track is the same as the number of free sectors \n
- *     (i.e., the number fits the bitmap)
- *
- * @todo How should details be given to the caller?
+ *    - If the block does not exist, the result is unspecified.
+ *      Thus, be careful that you provide a valid track.
  *
+ *    - On the first call, all blocks of the image are classified
+ *      (cf. cbmimage_i_bam_classify_really_unused()), and the result is
+ *      cached. Further calls only test one bit.
  */
 int
-cbmimage_bam_check_consistency(
-		cbmimage_fileimage * image
+cbmimage_i_bam_check_really_unused(
+		cbmimage_image_settings * settings,
+		cbmimage_blockaddress     block
 		)
 {
-	assert(image != NULL);
-	cbmimage_image_settings * settings = image->settings;
 	assert(settings != NULL);
 
-	uint16_t maxtrack = cbmimage_get_max_track(image);
+	const uint8_t * really_unused_map = cbmimage_i_bam_get_really_unused_map(settings);
 
-	for (uint16_t track = 1; track <= maxtrack; ++track) {
+	if (really_unused_map != NULL) {
+		return (really_unused_map[block.lba / 8] & (1u << (block.lba % 8))) != 0;
+	}
 
-		bam_mask_t bam_mask;
-		if (cbmimage_i_get_bam_of_track(settings, track, &bam_mask) < 0) {
-			return -1;
-		}
-		uint16_t bam_counter_of_track = cbmimage_i_get_bam_counter_of_track(settings, track);
-		uint16_t sectors_on_track = cbmimage_get_sectors_in_track(settings->image, track);
+	uint8_t * buffer = cbmimage_i_get_address_of_block(settings->image, block);
+
+	assert(buffer != NULL);
+
+	if (buffer == NULL) {
+		return 0;
+	}
+
+	return cbmimage_i_bam_classify_really_unused(buffer, cbmimage_get_bytes_in_block(settings->image));
+}
+
+/** @brief @internal check if the free blocks of a track are part of the blocks free
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @param[in] track
+ *    the track to check
+ *
+ * @return
+ *    - != 0 if the free blocks of the track are counted
+ *    - 0 if not, as the track is a directory track
+ *
+ * @remark
+ *    - The directory tracks are processed in the order they are stored in
+ *      cbmimage_image_settings::dir_tracks. Thus, a second directory track
+ *      with a lower number than the first one is counted (D80, D82).
+ */
+static
+int
+cbmimage_i_bam_track_counts_as_free(
+		cbmimage_image_settings * settings,
+		uint8_t                   track
+		)
+{
+	if (track == settings->dir_tracks[0]) {
+		return 0;
+	}
+
+	if (settings->dir_tracks[1] > settings->dir_tracks[0] && track == settings->dir_tracks[1]) {
+		return 0;
+	}
+
+	return 1;
+}
+
+/** @brief @internal discard the decoded BAM, the map of the really unused blocks and the free counts
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @remark
+ *    - The next access to the BAM decodes it again.
+ */
+void
+cbmimage_i_bam_cache_invalidate(
+		cbmimage_image_settings * settings
+		)
+{
+	assert(settings != NULL);
+
+	cbmimage_i_xfree(settings->bam_decoded);
+	settings->bam_decoded = NULL;
+
+	cbmimage_i_xfree(settings->really_unused_map);
+	settings->really_unused_map = NULL;
+
+	settings->bam_alloc_distance = 0;
+
+	settings->bam_blocks_free_valid = 0;
+}
+
+/** @brief @internal inform the BAM functions that a block has been written
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    the address of the block that has been written
+ *
+ * @remark
+ *    - If the block contains (a part of) the BAM of the current directory
+ *      or of one of its parents, the decoded BAM of that directory is discarded.
+ *    - The block is classified again for the map of the really unused
+ *      blocks of the current directory. The parents discard their maps,
+ *      as they address the block differently.
+ */
+void
+cbmimage_i_bam_cache_block_written(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block
+		)
+{
+	assert(image != NULL);
+
+	const uint8_t * buffer = cbmimage_i_get_address_of_block(image, block);
+
+	cbmimage_image_settings * settings_current = image->settings;
+
+	if (settings_current->really_unused_map && buffer) {
+		uint8_t bit = 1u << (block.lba % 8);
+
+		if (cbmimage_i_bam_classify_really_unused(buffer, cbmimage_get_bytes_in_block(image))) {
+			settings_current->really_unused_map[block.lba / 8] |= bit;
+		}
+		else {
+			settings_current->really_unused_map[block.lba / 8] &= ~bit;
+		}
+	}
+
+	for (cbmimage_image_settings * settings = settings_current->next_settings; settings; settings = settings->next_settings) {
+		cbmimage_i_xfree(settings->really_unused_map);
+		settings->really_unused_map = NULL;
+	}
+
+	for (cbmimage_image_settings * settings = image->settings; settings; settings = settings->next_settings) {
+		for (size_t i = 0; i < settings->bam_count; ++i) {
+			if ( (settings->bam[i].buffer == buffer)
+			  || (settings->bam_counter && settings->bam_counter[i].buffer == buffer)
+			   )
+			{
+				cbmimage_i_bam_cache_invalidate(settings);
+				break;
+			}
+		}
+	}
+}
+
+/** @brief get the unused/used state of a block in the BAM
+ *
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    the address of the block to check
+ *
+ * @return
+ *    - the BAM state (BAM_REALLY_FREE, BAM_USED, BAM_FREE).
+ *
+ * @remark
+ *    - If the block does not exist, the result is unspecified.
+ *      Thus, be careful that you provide a valid track.
+ *    - On the first call, the BAM is decoded into an LBA indexed bitmap.
+ *      Further calls only test one bit of it.
+ *
+ */
+cbmimage_BAM_state
+cbmimage_bam_get(
+		cbmimage_fileimage *   image,
+		cbmimage_blockaddress  block
+		)
+{
+	assert(image);
+	assert(image->settings);
+
+	const uint8_t * free_map = cbmimage_i_bam_get_free_map(image->settings);
+	if (free_map == NULL) {
+		return -1;
+	}
+
+	cbmimage_BAM_state bam_state = (free_map[block.lba / 8] & (1u << (block.lba % 8))) ? BAM_FREE : BAM_USED;
+
+	if (bam_state == BAM_FREE && cbmimage_i_bam_check_really_unused(image->settings, block)) {
+		bam_state = BAM_REALLY_FREE;
+	}
+
+	return bam_state;
+}
+
+/** @brief @internal get 64 bits of an LBA indexed bitmap
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] map
+ *    pointer to the bitmap. Bit (lba % 8) of byte (lba / 8) belongs to lba.
+ *
+ * @param[in] map_bytes
+ *    the size of the bitmap in bytes
+ *
+ * @param[in] word_index
+ *    the index of the word to get; the word contains the LBAs
+ *    word_index * 64 to word_index * 64 + 63.
+ *
+ * @return
+ *    the word, with bit (lba % 64) belonging to lba
+ */
+static
+uint64_t
+cbmimage_i_bam_get_map_word(
+		const uint8_t * map,
+		size_t          map_bytes,
+		size_t          word_index
+		)
+{
+	uint64_t word = 0;
+
+	for (size_t i = 8; i > 0; --i) {
+		size_t index = word_index * 8 + i - 1;
+
+		word <<= 8;
+		if (index < map_bytes) {
+			word |= map[index];
+		}
+	}
+
+	return word;
+}
+
+/** @brief @internal compare the BAM and the FAT and find the mismatches
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] used_in_fat_map
+ *    the bitmap of the blocks that are used in the FAT,
+ *    cf. cbmimage_i_fat_get_used_map()
+ *
+ * @param[out] mismatches
+ *    pointer to an array that receives the mismatches. \n
+ *    If this is NULL, the mismatches are only counted.
+ *
+ * @return
+ *    the number of mismatches (ranges)
+ *
+ * @remark
+ *    - The used bitmap of the FAT is XORed with the decoded BAM 64 blocks
+ *      at a time. Only words that are not 0 are examined bit by bit.
+ */
+static
+size_t
+cbmimage_i_bam_compare_fat(
+		cbmimage_fileimage *    image,
+		const uint64_t *        used_in_fat_map,
+		cbmimage_bam_mismatch * mismatches
+		)
+{
+	cbmimage_image_settings * settings = image->settings;
+
+	uint16_t max_lba = cbmimage_get_max_lba(image);
+
+	// if there is no BAM, all blocks are considered free in the BAM
+	const uint8_t * free_map = cbmimage_i_bam_get_free_map(settings);
+	size_t free_map_bytes = (max_lba + 1 + 7) / 8;
+
+	size_t count = 0;
+	cbmimage_bam_mismatch   mismatch_scratch;
+	cbmimage_bam_mismatch * mismatch = NULL;
+
+	for (size_t word_index = 0; word_index * 64 <= max_lba; ++word_index) {
+		uint64_t used_in_fat = used_in_fat_map[word_index];
+
+		uint64_t used_in_bam = free_map
+			? ~cbmimage_i_bam_get_map_word(free_map, free_map_bytes, word_index)
+			: 0;
+
+		uint64_t difference = used_in_fat ^ used_in_bam;
+
+		// mask out LBA 0 and the LBAs after the last one
+		if (word_index == 0) {
+			difference &= ~1ull;
+		}
+		if ((word_index + 1) * 64 > max_lba + 1u) {
+			difference &= (1ull << ((max_lba + 1u) % 64)) - 1;
+		}
+
+		while (difference != 0) {
+			unsigned int bit = 0;
+
+			while ((difference & (1ull << bit)) == 0) {
+				++bit;
+			}
+			difference &= ~(1ull << bit);
+
+			uint16_t lba = word_index * 64 + bit;
+			cbmimage_bam_mismatch_type type = (used_in_fat & (1ull << bit))
+				? BAM_MISMATCH_FREE_IN_BAM
+				: BAM_MISMATCH_USED_IN_BAM;
+
+			if (mismatch && mismatch->type == type && mismatch->block_last.lba + 1 == lba) {
+				mismatch->block_last.lba = lba;
+			}
+			else {
+				mismatch = mismatches ? &mismatches[count] : &mismatch_scratch;
+				++count;
+
+				mismatch->type = type;
+				mismatch->block_first.lba = lba;
+				mismatch->block_last.lba = lba;
+			}
+		}
+	}
+
+	return count;
+}
+
+/** @brief compare the BAM and the FAT
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[out] mismatches
+ *    pointer to a variable that receives an array of the mismatches.
+ *    The blocks of each array element are consecutive and have the same
+ *    type of mismatch. \n
+ *    If there are no mismatches, this is NULL.
+ *
+ * @param[out] count
+ *    pointer to a variable that receives the number of elements of mismatches.
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *    - The image must have been validated before (cf. cbmimage_validate()),
+ *      as this builds the FAT.
+ *    - The array must be freed with cbmimage_bam_mismatch_close().
+ */
+int
+cbmimage_bam_compare_fat(
+		cbmimage_fileimage *     image,
+		cbmimage_bam_mismatch ** mismatches,
+		size_t *                 count
+		)
+{
+	assert(image != NULL);
+	assert(mismatches != NULL);
+	assert(count != NULL);
+
+	*mismatches = NULL;
+	*count = 0;
+
+	if (image->settings->fat == NULL) {
+		return -1;
+	}
+
+	size_t word_count = cbmimage_get_max_lba(image) / 64 + 1;
+
+	uint64_t * used_in_fat_map = cbmimage_i_xalloc(word_count * sizeof *used_in_fat_map);
+
+	if (used_in_fat_map == NULL) {
+		return -1;
+	}
+
+	cbmimage_i_fat_get_used_map(image->settings->fat, used_in_fat_map, word_count);
+
+	// first pass: count the mismatches
+	size_t mismatch_count = cbmimage_i_bam_compare_fat(image, used_in_fat_map, NULL);
+
+	cbmimage_bam_mismatch * mismatch_array = NULL;
+
+	if (mismatch_count > 0) {
+		mismatch_array = cbmimage_i_xalloc(mismatch_count * sizeof *mismatch_array);
+	}
+
+	if (mismatch_array == NULL) {
+		cbmimage_i_xfree(used_in_fat_map);
+		return mismatch_count > 0 ? -1 : 0;
+	}
+
+	// second pass: fill the array
+	cbmimage_i_bam_compare_fat(image, used_in_fat_map, mismatch_array);
+
+	cbmimage_i_xfree(used_in_fat_map);
+
+	for (size_t i = 0; i < mismatch_count; ++i) {
+		cbmimage_blockaddress_init_from_lba(image, &mismatch_array[i].block_first);
+		cbmimage_blockaddress_init_from_lba(image, &mismatch_array[i].block_last);
+	}
+
+	*mismatches = mismatch_array;
+	*count = mismatch_count;
+
+	return 0;
+}
+
+/** @brief output the mismatches between the BAM and the FAT
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] mismatches
+ *    array of the mismatches, as returned by cbmimage_bam_compare_fat()
+ *
+ * @param[in] count
+ *    the number of elements of mismatches
+ *
+ * @remark
+ *    - One line is output for every block.
+ */
+void
+cbmimage_bam_mismatch_print(
+		cbmimage_fileimage *          image,
+		const cbmimage_bam_mismatch * mismatches,
+		size_t                        count
+		)
+{
+	assert(image != NULL);
+
+	for (size_t i = 0; i < count; ++i) {
+		cbmimage_blockaddress block = mismatches[i].block_first;
+
+		for (;;) {
+			if (mismatches[i].type == BAM_MISMATCH_FREE_IN_BAM) {
+				cbmimage_i_fmt_print("Block %u/%u(%03X) is marked as used, but the BAM tells us it is empty.\n",
+						block.ts.track, block.ts.sector, block.lba);
+			}
+			else {
+				cbmimage_i_fmt_print("Block %u/%u(%03X) is not marked as used, but the BAM tells us it is used.\n",
+						block.ts.track, block.ts.sector, block.lba);
+			}
+
+			if (block.lba >= mismatches[i].block_last.lba || cbmimage_blockaddress_advance(image, &block)) {
+				break;
+			}
+		}
+	}
+}
+
+/** @brief free the mismatches between the BAM and the FAT
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] mismatches
+ *    array of the mismatches, as returned by cbmimage_bam_compare_fat()
+ */
+void
+cbmimage_bam_mismatch_close(
+		cbmimage_bam_mismatch * mismatches
+		)
+{
+	cbmimage_i_xfree(mismatches);
+}
+
+/** @brief check the consistency of a BAM
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    - 0 if the BAM is consistent
+ *    - != 0 if not
+ *
+ * @remark
+ *   A BAM is consistent if the following applies:
+ *   - no track has free blocks for sectors that do not exist
+ *   - the free block count of a track is the same as the number of free sectors \n
+ *     (i.e., the number fits the bitmap)
+ *
+ * @todo How should details be given to the caller?
+ *
+ */
+int
+cbmimage_bam_check_consistency(
+		cbmimage_fileimage * image
+		)
+{
+	assert(image != NULL);
+	cbmimage_image_settings * settings = image->settings;
+	assert(settings != NULL);
+
+	uint16_t maxtrack = cbmimage_get_max_track(image);
+
+	for (uint16_t track = 1; track <= maxtrack; ++track) {
+
+		bam_mask_t bam_mask;
+		if (cbmimage_i_get_bam_of_track(settings, track, &bam_mask) < 0) {
+			return -1;
+		}
+		uint16_t bam_counter_of_track = cbmimage_i_get_bam_counter_of_track(settings, track);
+		uint16_t sectors_on_track = cbmimage_get_sectors_in_track(settings->image, track);
 
 		cbmimage_i_check_max_bam_of_track(settings, track, bam_mask);
 
-		uint16_t count_of_bam_blocks = cbmimage_i_countbits(bam_mask);
+		uint16_t count_of_bam_blocks = cbmimage_i_countbits(&bam_mask);
+
+		if (bam_counter_of_track > sectors_on_track) {
+			cbmimage_i_fmt_print("Track %u: Number of free blocks is reported as %u, but no. of sectors is %u.\n",
+					track, bam_counter_of_track, sectors_on_track);
+		}
+		if (count_of_bam_blocks != bam_counter_of_track) {
+			cbmimage_i_fmt_print("Track %u: Reported %u free blocks, but there are %u in %016llX.\n",
+					track, bam_counter_of_track, count_of_bam_blocks, bam_mask);
+		}
+	}
+
+	return 0;
+}
+
+/** @brief get the count of blocks free
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    count of free blocks on this image
+ *
+ * @remark
+ *    - The count is only calculated on the first call. Afterwards, it is
+ *      kept up to date by cbmimage_bam_alloc() and cbmimage_bam_free(),
+ *      and it is calculated again if a block of the BAM is written.
+ */
+int
+cbmimage_get_blocks_free(
+		cbmimage_fileimage * image
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+	assert(settings != NULL);
+
+	if (settings->bam_blocks_free_valid) {
+		return settings->bam_blocks_free;
+	}
+
+	uint16_t count = 0;
+	uint8_t  maxtrack = cbmimage_get_max_track(image);
+
+	for (uint8_t track = 1; track <= maxtrack; ++track) {
+		if (cbmimage_i_bam_track_counts_as_free(settings, track)) {
+			count += cbmimage_i_get_bam_counter_of_track(settings, track);
+		}
+	}
+
+	settings->bam_blocks_free = count;
+	settings->bam_blocks_free_valid = 1;
+
+	return count;
+}
+
+/** @brief get the blocks free on a specific track
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] track
+ *    the track number for which the number of tracks is requested
+ *
+ * @return
+ *    count of free blocks on this track
+ *
+ */
+int
+cbmimage_bam_get_free_on_track(
+		cbmimage_fileimage * image,
+		uint8_t              track
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+	assert(settings != NULL);
+
+	return cbmimage_i_get_bam_counter_of_track(settings, track);
+}
+
+/** @brief @internal mark a block as free or as used in the BAM
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @param[in] block
+ *    the address of the block to mark
+ *
+ * @param[in] is_free
+ *    - 0 if the block is to be marked as used
+ *    - != 0 if the block is to be marked as free
+ *
+ * @return
+ *    - 0 if the block has been marked
+ *    - 1 if the block was already marked that way
+ *    - -1 on error
+ *
+ * @remark
+ *    - The decoded BAM is updated, and the change is written through to
+ *      the BAM bitmap and the BAM counter on disk at once, as block
+ *      accessors access the image memory directly.
+ */
+static
+int
+cbmimage_i_bam_set_block(
+		cbmimage_image_settings * settings,
+		cbmimage_blockaddress     block,
+		int                       is_free
+		)
+{
+	if (settings->bam_track == NULL) {
+		return -1;
+	}
+
+	uint8_t track  = block.ts.track;
+	uint8_t sector = block.ts.sector;
+
+	if ( track < 1 || track > settings->maxtracks
+	  || sector >= cbmimage_get_sectors_in_track(settings->image, track)
+	   )
+	{
+		return -1;
+	}
+
+	cbmimage_i_bam_decoded * decoded = cbmimage_i_bam_decode(settings);
+
+	if (decoded == NULL) {
+		return -1;
+	}
+
+	cbmimage_i_bam_track * bam_track = &settings->bam_track[track];
+
+	uint8_t * bam = &bam_track->bam[sector / 8];
+	uint8_t   bit = bam_track->reverse_order ? 0x80u >> (sector % 8) : 1u << (sector % 8);
+
+	if (((*bam & bit) != 0) == (is_free != 0)) {
+		return 1;
+	}
+
+	// cbmimage_i_get_bam_counter_of_track() changes by one, too
+	int adjust_blocks_free = settings->bam_blocks_free_valid && cbmimage_i_bam_track_counts_as_free(settings, track);
+
+	if (is_free) {
+		decoded->free_map[block.lba / 8] |= 1u << (block.lba % 8);
+		++decoded->free_count[track];
+		++decoded->counter[track];
+		if (adjust_blocks_free) {
+			++settings->bam_blocks_free;
+		}
+
+		// write through to the BAM on disk
+		*bam |= bit;
+		if (bam_track->counter) {
+			++*bam_track->counter;
+		}
+	}
+	else {
+		decoded->free_map[block.lba / 8] &= ~(1u << (block.lba % 8));
+		--decoded->free_count[track];
+		--decoded->counter[track];
+		if (adjust_blocks_free) {
+			--settings->bam_blocks_free;
+		}
+
+		// write through to the BAM on disk
+		*bam &= ~bit;
+		if (bam_track->counter) {
+			--*bam_track->counter;
+		}
+	}
+
+	return 0;
+}
+
+/** @brief @internal get the track the allocation of blocks is oriented at
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @return
+ *    the directory track; if there is none (1581 sub-directories),
+ *    the track of the first directory block.
+ */
+static
+uint8_t
+cbmimage_i_bam_get_reference_track(
+		cbmimage_image_settings * settings
+		)
+{
+	return settings->dir_tracks[0] ? settings->dir_tracks[0] : settings->dir.ts.track;
+}
+
+/** @brief @internal check if a track can be used for allocating a block
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @param[in] free_count
+ *    the free counts of all tracks, cf. cbmimage_i_bam_decoded::free_count
+ *
+ * @param[in] track
+ *    the track to check
+ *
+ * @return
+ *    - != 0 if the track exists, is not a directory track, and has free blocks
+ *    - 0 otherwise
+ */
+static
+int
+cbmimage_i_bam_track_is_allocatable(
+		cbmimage_image_settings * settings,
+		const uint16_t *          free_count,
+		int                       track
+		)
+{
+	if (track < 1 || track > settings->maxtracks) {
+		return 0;
+	}
+
+	// the directory tracks are reserved for the directory
+	for (int i = 0; i < CBMIMAGE_ARRAYSIZE(settings->dir_tracks); ++i) {
+		if (track == settings->dir_tracks[i]) {
+			return 0;
+		}
+	}
 
-		if (bam_counter_of_track > sectors_on_track) {
-			cbmimage_i_fmt_print("Track %u: Number of free blocks is reported as %u, but no. of sectors is %u.\n",
-					track, bam_counter_of_track, sectors_on_track);
+	return free_count[track] > 0;
+}
+
+/** @brief allocate a block in the BAM
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block_previous
+ *    pointer to the address of the previous block of the file. \n
+ *    NULL if the first block of a file is to be allocated.
+ *
+ * @param[out] block
+ *    pointer to a block address that receives the allocated block
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if the image is full, or an error occurred
+ *
+ * @remark
+ *    - This follows the strategy of the CBM DOS:
+ *      - The first block of a file is allocated on the track nearest to
+ *        the directory track, taking the tracks below the directory first.
+ *      - The next block of a file is allocated on the same track as the
+ *        previous one, with the interleave of the drive
+ *        (cf. cbmimage_image_settings::interleave).
+ *      - If that track is full, the next track further away from the
+ *        directory is used. If there is none, the search starts again
+ *        at the directory track.
+ *      - The directory tracks are never used.
+ *    - The free blocks per track are cached, and the distance from the
+ *      directory track up to which all tracks are full is remembered.
+ *      Thus, allocating the blocks of a file does not search all tracks
+ *      for every block.
+ */
+int
+cbmimage_bam_alloc(
+		cbmimage_fileimage *          image,
+		const cbmimage_blockaddress * block_previous,
+		cbmimage_blockaddress *       block
+		)
+{
+	assert(image != NULL);
+	assert(block != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+	assert(settings != NULL);
+
+	cbmimage_i_bam_decoded * decoded = cbmimage_i_bam_decode(settings);
+
+	if (decoded == NULL) {
+		return -1;
+	}
+
+	const uint16_t * free_count = decoded->free_count;
+
+	int     reference_track = cbmimage_i_bam_get_reference_track(settings);
+	uint8_t interleave      = settings->interleave ? settings->interleave : 1;
+
+	int track  = 0;
+	int sector = 0;
+
+	if ( block_previous
+	  && block_previous->ts.track >= 1
+	  && block_previous->ts.track <= settings->maxtracks
+	   )
+	{
+		int track_previous = block_previous->ts.track;
+
+		if (cbmimage_i_bam_track_is_allocatable(settings, free_count, track_previous)) {
+			track  = track_previous;
+			sector = (block_previous->ts.sector + interleave) % cbmimage_get_sectors_in_track(image, track);
 		}
-		if (count_of_bam_blocks != bam_counter_of_track) {
-			cbmimage_i_fmt_print("Track %u: Reported %u free blocks, but there are %u in %016llX.\n",
-					track, bam_counter_of_track, count_of_bam_blocks, bam_mask);
+		else {
+			// move further away from the directory
+			int direction = track_previous < reference_track ? -1 : 1;
+
+			for (int track_next = track_previous + direction;
+			     track_next >= 1 && track_next <= settings->maxtracks;
+			     track_next += direction
+			    )
+			{
+				if (cbmimage_i_bam_track_is_allocatable(settings, free_count, track_next)) {
+					track = track_next;
+					break;
+				}
+			}
 		}
 	}
 
-	return 0;
+	if (track == 0) {
+		// find the track nearest to the directory
+		int distance_max = max(reference_track - 1, settings->maxtracks - reference_track);
+		int distance;
+
+		for (distance = settings->bam_alloc_distance; distance <= distance_max; ++distance) {
+			if (cbmimage_i_bam_track_is_allocatable(settings, free_count, reference_track - distance)) {
+				track = reference_track - distance;
+				break;
+			}
+			if (cbmimage_i_bam_track_is_allocatable(settings, free_count, reference_track + distance)) {
+				track = reference_track + distance;
+				break;
+			}
+		}
+
+		settings->bam_alloc_distance = min(distance, UINT8_MAX);
+
+		if (track == 0) {
+			// the image is full
+			return -1;
+		}
+	}
+
+	// find the next free sector on the track, starting at the wanted one
+	bam_mask_t bam_mask;
+
+	if (cbmimage_i_get_bam_of_track(settings, track, &bam_mask) < 0) {
+		return -1;
+	}
+
+	uint16_t sectors_on_track = cbmimage_get_sectors_in_track(image, track);
+
+	for (uint16_t i = 0; i < sectors_on_track; ++i) {
+		if (bam_mask.mask[sector / 8] & (1u << (sector % 8))) {
+			if (cbmimage_blockaddress_init_from_ts_value(image, block, track, sector)) {
+				return -1;
+			}
+			return cbmimage_i_bam_set_block(settings, *block, 0);
+		}
+
+		if (++sector >= sectors_on_track) {
+			sector = 0;
+		}
+	}
+
+	// the free count did not match the BAM bitmap
+	return -1;
 }
 
-/** @brief get the count of blocks free
+/** @brief @internal allocate a block on a specific track
  * @ingroup cbmimage_bam
  *
  * @param[in] image
  *    pointer to the image data
  *
+ * @param[in] block_previous
+ *    the block after which a block is to be allocated. The block is
+ *    allocated on the same track.
+ *
+ * @param[in] interleave
+ *    the interleave to use after block_previous. 0 is handled like 1.
+ *
+ * @param[out] block
+ *    pointer to a block address that receives the allocated block
+ *
  * @return
- *    count of free blocks on this image
+ *    - 0 on success
+ *    - != 0 if the track is full, or an error occurred
  *
+ * @remark
+ *    - In contrast to cbmimage_bam_alloc(), this can allocate blocks on
+ *      the directory tracks; it is used for extending the directory.
+ *    - The search starts interleave sectors after block_previous. If that
+ *      sector is used, the following ones are tried, as the DOS does.
  */
 int
-cbmimage_get_blocks_free(
-		cbmimage_fileimage * image
+cbmimage_i_bam_alloc_on_track(
+		cbmimage_fileimage *    image,
+		cbmimage_blockaddress   block_previous,
+		uint8_t                 interleave,
+		cbmimage_blockaddress * block
 		)
 {
-	uint16_t count = 0;
-	uint8_t  dir_track_location = 0;
-	uint8_t  maxtrack = cbmimage_get_max_track(image);
+	assert(image != NULL);
+	assert(block != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+	assert(settings != NULL);
+
+	uint8_t track = block_previous.ts.track;
+
+	if (track < 1 || track > settings->maxtracks) {
+		return -1;
+	}
+
+	bam_mask_t bam_mask;
+
+	if (cbmimage_i_get_bam_of_track(settings, track, &bam_mask) < 0) {
+		return -1;
+	}
+
+	uint16_t sectors_on_track = cbmimage_get_sectors_in_track(image, track);
+	uint16_t sector = (block_previous.ts.sector + (interleave ? interleave : 1)) % sectors_on_track;
+
+	for (uint16_t i = 0; i < sectors_on_track; ++i) {
+		if (bam_mask.mask[sector / 8] & (1u << (sector % 8))) {
+			if (cbmimage_blockaddress_init_from_ts_value(image, block, track, sector)) {
+				return -1;
+			}
+			return cbmimage_i_bam_set_block(settings, *block, 0);
+		}
+
+		if (++sector >= sectors_on_track) {
+			sector = 0;
+		}
+	}
+
+	// the track is full
+	return -1;
+}
 
+/** @brief free a block in the BAM
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    the address of the block to free
+ *
+ * @return
+ *    - 0 on success
+ *    - 1 if the block was already free
+ *    - -1 on error
+ */
+int
+cbmimage_bam_free(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block
+		)
+{
 	assert(image != NULL);
 
 	cbmimage_image_settings * settings = image->settings;
 	assert(settings != NULL);
 
-	for (uint8_t track = 1; track <= maxtrack; ++track) {
+	int ret = cbmimage_i_bam_set_block(settings, block, 1);
+
+	if (ret == 0) {
+		int distance = block.ts.track - cbmimage_i_bam_get_reference_track(settings);
 
-		// do not count directory tracks
-		if (track == settings->dir_tracks[dir_track_location]) {
-			// advance to next track location, ensuring that we do not move beyond the last one
-			dir_track_location = (++dir_track_location) % CBMIMAGE_ARRAYSIZE(settings->dir_tracks);
-			continue;
+		if (distance < 0) {
+			distance = -distance;
+		}
+
+		if (distance < settings->bam_alloc_distance) {
+			settings->bam_alloc_distance = distance;
 		}
-		count += cbmimage_i_get_bam_counter_of_track(settings, track);
 	}
-	return count;
+
+	return ret;
 }
 
-/** @brief get the blocks free on a specific track
+/** @brief rebuild the BAM from the FAT
  * @ingroup cbmimage_bam
  *
  * @param[in] image
  *    pointer to the image data
  *
- * @param[in] track
- *    the track number for which the number of tracks is requested
+ * @return
+ *    - 0 on success
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *    - The image must have been validated before (cf. cbmimage_validate()),
+ *      as this builds the FAT.
+ *    - Every block that is not used according to the FAT is marked as free,
+ *      every other block as used. The BAM counters are set accordingly.
+ *    - The blocks that are occupied in a special way (e.g., track 53 on D71,
+ *      or the blocks outside of a 1581 partition) are part of the FAT
+ *      after validation, thus, they are handled, too.
+ *    - The BAM blocks are changed in place. Afterwards, the decoded BAM
+ *      is updated as if these blocks had been written with
+ *      cbmimage_write_block().
+ */
+int
+cbmimage_bam_rebuild(
+		cbmimage_fileimage * image
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+	assert(settings != NULL);
+
+	cbmimage_fat * fat = settings->fat;
+
+	if (fat == NULL || settings->bam_track == NULL || settings->is_partition_table) {
+		return -1;
+	}
+
+	for (uint16_t track = 1; track <= settings->maxtracks; ++track) {
+		cbmimage_i_bam_track * bam_track = &settings->bam_track[track];
+
+		bam_mask_t bam_mask = { 0 };
+
+		cbmimage_blockaddress block;
+		if (cbmimage_blockaddress_init_from_ts_value(image, &block, track, 0)) {
+			return -1;
+		}
+
+		uint16_t sectors_on_track = cbmimage_get_sectors_in_track(image, track);
+
+		for (uint16_t sector = 0; sector < sectors_on_track; ++sector) {
+			if (cbmimage_i_fat_get_lba(fat, block.lba + sector) == CBMIMAGE_FAT_UNUSED) {
+				bam_mask.mask[sector / 8] |= 1u << (sector % 8);
+			}
+		}
+
+		for (int i = 0; i < bam_track->data_count; ++i) {
+			bam_track->bam[i] = bam_track->reverse_order ? reverse_bit_order(bam_mask.mask[i]) : bam_mask.mask[i];
+		}
+
+		if (bam_track->counter) {
+			*bam_track->counter = cbmimage_i_countbits(&bam_mask);
+		}
+	}
+
+	// the BAM blocks have been changed
+	for (size_t i = 0; i < settings->bam_count; ++i) {
+		cbmimage_i_bam_cache_block_written(image, settings->bam[i].block);
+
+		if (settings->bam_counter) {
+			cbmimage_i_bam_cache_block_written(image, settings->bam_counter[i].block);
+		}
+	}
+
+	return 0;
+}
+
+/** @brief @internal count the files and their fragments
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[inout] statistics
+ *    the statistics that receive the number of files and fragments
  *
  * @return
- *    count of free blocks on this track
+ *    - 0 on success
+ *    - != 0 if an error occurred
  *
+ * @remark
+ *    - A file gets a new fragment whenever one of its blocks links to a block
+ *      that is neither on the same track nor on a neighbouring one. Links
+ *      inside of a track are not counted, as the DOS uses an interleave.
  */
+static
 int
-cbmimage_bam_get_free_on_track(
-		cbmimage_fileimage * image,
-		uint8_t              track
+cbmimage_i_bam_statistics_files(
+		cbmimage_fileimage *      image,
+		cbmimage_bam_statistics * statistics
+		)
+{
+	cbmimage_fat * fat = image->settings->fat;
+
+	uint16_t max_lba = cbmimage_get_max_lba(image);
+
+	// one bit for every possible directory index
+	uint8_t * files_seen = cbmimage_i_xalloc((UINT16_MAX + 1) / 8);
+
+	if (files_seen == NULL) {
+		return -1;
+	}
+
+	cbmimage_blockaddress block;
+	cbmimage_blockaddress_init_from_lba_value(image, &block, 1);
+
+	for (uint16_t lba = 1; lba <= max_lba; ++lba) {
+		cbmimage_block_owner owner = cbmimage_i_fat_get_owner_lba(fat, lba);
+
+		if (owner.type == BLOCK_OWNER_FILE) {
+			uint8_t bit = 1u << (owner.dir_index % 8);
+
+			if ((files_seen[owner.dir_index / 8] & bit) == 0) {
+				files_seen[owner.dir_index / 8] |= bit;
+				++statistics->files;
+				++statistics->files_fragments;
+			}
+
+			uint16_t target = cbmimage_i_fat_get_lba(fat, lba);
+
+			if (target != CBMIMAGE_FAT_LASTBLOCK && target != CBMIMAGE_FAT_UNUSED) {
+				cbmimage_blockaddress block_target;
+				cbmimage_blockaddress_init_from_lba_value(image, &block_target, target);
+
+				int track_distance = block_target.ts.track - block.ts.track;
+
+				if (track_distance < -1 || track_distance > 1) {
+					++statistics->files_fragments;
+				}
+			}
+		}
+
+		cbmimage_blockaddress_advance(image, &block);
+	}
+
+	cbmimage_i_xfree(files_seen);
+
+	return 0;
+}
+
+/** @brief get statistics of the free space and the fragmentation of an image
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    - pointer to the statistics
+ *    - NULL if the image has no BAM, or an error occurred
+ *
+ * @remark
+ *    - The free space is taken from the decoded BAM in one pass.
+ *    - The numbers of files and fragments are only available if the image
+ *      has been validated before (cf. cbmimage_validate()). Otherwise, they are 0.
+ *    - The statistics must be freed with cbmimage_bam_statistics_close().
+ */
+cbmimage_bam_statistics *
+cbmimage_bam_statistics_get(
+		cbmimage_fileimage * image
 		)
 {
 	assert(image != NULL);
@@ -595,5 +1842,91 @@ cbmimage_bam_get_free_on_track(
 	cbmimage_image_settings * settings = image->settings;
 	assert(settings != NULL);
 
-	return cbmimage_i_get_bam_counter_of_track(settings, track);
+	const uint8_t * free_map = cbmimage_i_bam_get_free_map(settings);
+
+	if (free_map == NULL) {
+		return NULL;
+	}
+
+	uint16_t maxtrack = cbmimage_get_max_track(image);
+
+	// the statistics and the per track statistics are allocated together
+	cbmimage_bam_statistics * statistics = cbmimage_i_xalloc(sizeof *statistics
+			+ (maxtrack + 1) * sizeof *statistics->track);
+
+	if (statistics == NULL) {
+		return NULL;
+	}
+
+	statistics->track_count = maxtrack + 1;
+	statistics->track = (cbmimage_bam_track_statistics *) &statistics[1];
+	statistics->blocks = cbmimage_get_max_lba(image);
+
+	uint16_t run_first = 0;
+	uint16_t run_count = 0;
+
+	for (uint16_t track = 1; track <= maxtrack; ++track) {
+		cbmimage_bam_track_statistics * track_statistics = &statistics->track[track];
+
+		cbmimage_blockaddress block;
+		if (cbmimage_blockaddress_init_from_ts_value(image, &block, track, 0)) {
+			cbmimage_bam_statistics_close(statistics);
+			return NULL;
+		}
+
+		uint16_t sectors_on_track = cbmimage_get_sectors_in_track(image, track);
+		uint16_t track_run_count = 0;
+
+		for (uint16_t lba = block.lba; lba < block.lba + sectors_on_track; ++lba) {
+			if ((free_map[lba / 8] & (1u << (lba % 8))) == 0) {
+				// the block is used: end the runs
+				track_run_count = 0;
+				run_count = 0;
+				continue;
+			}
+
+			++track_statistics->free;
+
+			if (track_run_count++ == 0) {
+				++track_statistics->free_runs;
+			}
+			track_statistics->free_run_largest = max(track_statistics->free_run_largest, track_run_count);
+
+			if (run_count++ == 0) {
+				run_first = lba;
+				++statistics->free_runs;
+			}
+			if (run_count > statistics->free_extent_largest_count) {
+				statistics->free_extent_largest_count = run_count;
+				statistics->free_extent_largest_first.lba = run_first;
+			}
+		}
+
+		statistics->blocks_free += track_statistics->free;
+	}
+
+	if (statistics->free_extent_largest_count > 0) {
+		cbmimage_blockaddress_init_from_lba(image, &statistics->free_extent_largest_first);
+	}
+
+	if (settings->fat && cbmimage_i_bam_statistics_files(image, statistics)) {
+		cbmimage_bam_statistics_close(statistics);
+		return NULL;
+	}
+
+	return statistics;
+}
+
+/** @brief free the statistics of an image
+ * @ingroup cbmimage_bam
+ *
+ * @param[in] statistics
+ *    the statistics, as returned by cbmimage_bam_statistics_get()
+ */
+void
+cbmimage_bam_statistics_close(
+		cbmimage_bam_statistics * statistics
+		)
+{
+	cbmimage_i_xfree(statistics);
 }
@@ -40,10 +40,11 @@ cbmimage_i_d1m_d2m_d4m_set_bam(
 
 	// iterate through all files and mark their blocks as used
 	cbmimage_dir_entry * dir_entry;
+	uint16_t dir_index = 0;
 
 	for (dir_entry = cbmimage_dir_get_first(image);
 			 cbmimage_dir_get_is_valid(dir_entry);
-			 cbmimage_dir_get_next(dir_entry)
+			 cbmimage_dir_get_next(dir_entry), ++dir_index
 			)
 	{
 		if (cbmimage_dir_is_deleted(dir_entry)) {
@@ -58,7 +59,8 @@ cbmimage_i_d1m_d2m_d4m_set_bam(
 		settings->subdir_relative_addressing = 0;
 
 		// mark the partition as used
-		ret = cbmimage_i_validate_1581_partition(image, dir_entry->start_block, dir_entry->block_count) || ret;
+		cbmimage_block_owner owner = { .type = BLOCK_OWNER_FILE, .dir_index = dir_index };
+		ret = cbmimage_i_validate_1581_partition(image, dir_entry->start_block, dir_entry->block_count, owner) || ret;
 
 		// restore the relative addressing
 		settings->subdir_relative_addressing = tmp_subdir_relative_addressing;
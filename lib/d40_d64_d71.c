@@ -281,17 +281,21 @@ cbmimage_i_d71_set_bam(
 	cbmimage_blockaddress block_current;
 	cbmimage_blockaddress_init_from_ts_value(image, &block_current, 18 + 35, 0);
 
+	cbmimage_blockaddress block_start = block_current;
 	cbmimage_blockaddress block_next = block_current;
 	cbmimage_blockaddress_advance(image, &block_next);
 
 	for (int last_run = 0; 1; /* nothing */) {
-		if (cbmimage_fat_is_used(settings->fat, block_current)) {
-			cbmimage_i_fmt_print("====> Marking already marked block following from %u/%u(%03X) at %u/%u(%03X).\n",
-					settings->block_subdir_first.ts.track, settings->block_subdir_first.ts.sector, settings->block_subdir_first.lba,
-					block_current.ts.track, block_current.ts.sector, block_current.lba);
+		// the first block of the 2nd dir track holds the BAM of the 2nd side
+		cbmimage_block_owner owner = { .type = BLOCK_OWNER_RESERVED, .dir_index = 0 };
+
+		if (block_current.lba == settings->bam[1].block.lba) {
+			owner.type = BLOCK_OWNER_BAM;
+		}
+
+		if (cbmimage_i_mark_global_and_local(image, NULL, block_start, block_current, block_next, owner)) {
 			ret = -1;
 		}
-		cbmimage_fat_set(image->settings->fat, block_current, block_next);
 
 		if (last_run) {
 			break;
@@ -436,6 +440,8 @@ cbmimage_i_d40_d64_d71_chdir_partition_init(
 			settings->fct = d64_fileimage_functions;
 			settings->dir_tracks[1] = 0;
 			settings->bam_count = 1;
+			settings->interleave = 10;
+			settings->dir_interleave = 3;
 			settings->d40_d64_d71 = i_d40_d64;
 			settings->d40_d64_d71.sectors_in_track = sectors_in_track_d40;
 			break;
@@ -449,6 +455,8 @@ cbmimage_i_d40_d64_d71_chdir_partition_init(
 			settings->fct = d64_fileimage_functions;
 			settings->dir_tracks[1] = 0;
 			settings->bam_count = 1;
+			settings->interleave = 10;
+			settings->dir_interleave = 3;
 			settings->d40_d64_d71 = i_d40_d64;
 			settings->d40_d64_d71.sectors_in_track = sectors_in_track_d64;
 			break;
@@ -457,6 +465,8 @@ cbmimage_i_d40_d64_d71_chdir_partition_init(
 			settings->fct = d71_fileimage_functions;
 			settings->dir_tracks[1] = 18 + 35;
 			settings->bam_count = 2;
+			settings->interleave = 6;
+			settings->dir_interleave = 3;
 			settings->d40_d64_d71 = i_d71;
 			settings->d40_d64_d71.sectors_in_track = sectors_in_track_d71;
 			break;
@@ -266,6 +266,9 @@ cbmimage_i_d80_d82_image_create(
 		.dir_tracks[0] = 39,
 		.dir_tracks[1] = 38,
 
+		.interleave = 6,
+		.dir_interleave = 3,
+
 		.d80_d82.sectors_in_track = sectors_in_track_d82,
 
 		CBMIMAGE_BAM_AND_BAM_COUNTER_CREATE(.d80_d82, 0,   1, 0x06, 5, 4, 38, 0),
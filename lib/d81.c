@@ -168,14 +168,13 @@ cbmimage_i_d81_set_bam(
 		cbmimage_blockaddress block_next = block_current;
 		cbmimage_blockaddress_advance(image, &block_next);
 
+		// the blocks outside of the partition are not accessible from inside of it
+		cbmimage_block_owner owner = { .type = BLOCK_OWNER_RESERVED, .dir_index = 0 };
+
 		for (int last_run = 0; 1; /* nothing */) {
-			if (cbmimage_fat_is_used(settings->fat, block_current)) {
-				cbmimage_i_fmt_print("====> Marking already marked block following from %u/%u(%03X) at %u/%u(%03X).\n",
-						settings->block_subdir_first.ts.track, settings->block_subdir_first.ts.sector, settings->block_subdir_first.lba,
-						block_current.ts.track, block_current.ts.sector, block_current.lba);
+			if (cbmimage_i_mark_global_and_local(image, NULL, settings->block_subdir_first, block_current, block_next, owner)) {
 				ret = -1;
 			}
-			cbmimage_fat_set(image->settings->fat, block_current, block_next);
 
 			if (last_run) {
 				break;
@@ -277,6 +276,8 @@ cbmimage_i_d81_chdir_partition_init(
 	settings->info_offset_diskname = 0x04;
 	settings->dir_tracks[0] = 40;
 	settings->dir_tracks[1] = 0;
+	settings->interleave = 1;
+	settings->dir_interleave = 1;
 
 	settings->d81 = i_d81;
 
@@ -13,6 +13,118 @@
 #include <assert.h>
 #include <string.h>
 
+/** @brief get the cached header entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    A pointer to the header entry.
+ *    If there is no header (partition table), the pointer will be NULL.
+ *
+ * @remark
+ *    - The header entry belongs to the image; it must not be freed. It is
+ *      valid until the image is closed, or until the directory it belongs
+ *      to is left with cbmimage_dir_chdir_close().
+ *    - The header entry is allocated on the first call only.
+ *    - The name, disk ID and DOS type are only read from the info block
+ *      on the first call, and after the info block has been written with
+ *      cbmimage_write_block().
+ *    - The count of free blocks is kept up to date with
+ *      cbmimage_get_blocks_free() on every call.
+ */
+const cbmimage_dir_header *
+cbmimage_dir_get_header_cached(
+		cbmimage_fileimage * image
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+
+	if (settings->is_partition_table) {
+		return NULL;
+	}
+
+	if (settings->dir_header == NULL) {
+		settings->dir_header = cbmimage_i_xalloc(sizeof *settings->dir_header);
+
+		if (settings->dir_header == NULL) {
+			return NULL;
+		}
+	}
+
+	cbmimage_dir_header * dir_header = settings->dir_header;
+
+	if (!settings->dir_header_valid) {
+		const uint8_t * info_name = &settings->info->data[settings->info_offset_diskname];
+
+		memcpy((char*)dir_header->name.text, info_name, sizeof dir_header->name.text);
+
+		dir_header->name.length = sizeof dir_header->name.text;
+		dir_header->name.end_index = CBMIMAGE_HEADER_ENTRY_NAME_LENGTH;
+
+		memcpy(dir_header->id, &info_name[CBMIMAGE_HEADER_ENTRY_ID_OFFSET], sizeof dir_header->id);
+		memcpy(dir_header->dos_type, &info_name[CBMIMAGE_HEADER_ENTRY_DOS_TYPE_OFFSET], sizeof dir_header->dos_type);
+
+		dir_header->is_geos = settings->is_geos;
+
+		settings->dir_header_valid = 1;
+	}
+
+	// this is cached by the BAM functions
+	dir_header->free_block_count = cbmimage_get_blocks_free(image);
+
+	return dir_header;
+}
+
+/** @brief @internal inform the cached header that a block has been written
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    the address of the block that has been written
+ *
+ * @remark
+ *    - If the block is the info block, the cached header is discarded,
+ *      cf. cbmimage_dir_get_header_cached().
+ */
+void
+cbmimage_i_dir_header_block_written(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+
+	if (settings->info && settings->info->block.lba == block.lba) {
+		settings->dir_header_valid = 0;
+	}
+}
+
+/** @brief @internal free the cached header
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ */
+void
+cbmimage_i_dir_header_cache_close(
+		cbmimage_image_settings * settings
+		)
+{
+	assert(settings != NULL);
+
+	cbmimage_i_xfree(settings->dir_header);
+	settings->dir_header = NULL;
+	settings->dir_header_valid = 0;
+}
+
 /** @brief get the header entry
  * @ingroup cbmimage_dir
  *
@@ -26,29 +138,24 @@
  * @remark
  *    - the structure obtained by this function has to be freed by
  *      cbmimage_dir_get_header_close() once the processing is done.
+ *    - This is a copy of the header from cbmimage_dir_get_header_cached().
  */
 cbmimage_dir_header *
 cbmimage_dir_get_header(
 		cbmimage_fileimage * image
 		)
 {
-	if (image->settings->is_partition_table) {
+	const cbmimage_dir_header * dir_header_cached = cbmimage_dir_get_header_cached(image);
+
+	if (dir_header_cached == NULL) {
 		return NULL;
 	}
 
 	cbmimage_dir_header * dir_header = cbmimage_i_xalloc(sizeof * dir_header);
 
-	cbmimage_image_settings * settings = image->settings;
-
-	// get the info buffer
-	memcpy((char*)dir_header->name.text, &settings->info->data[settings->info_offset_diskname], sizeof dir_header->name.text);
-
-	dir_header->name.length = sizeof dir_header->name.text;
-	dir_header->name.end_index = CBMIMAGE_HEADER_ENTRY_NAME_LENGTH;
-
-	dir_header->free_block_count = cbmimage_get_blocks_free(image);
-
-	dir_header->is_geos = image->settings->is_geos;
+	if (dir_header) {
+		memcpy(dir_header, dir_header_cached, sizeof * dir_header);
+	}
 
 	return dir_header;
 }
@@ -76,8 +183,11 @@ cbmimage_dir_get_header_close(
 /** @brief internal store date and time of directory entry
  * @ingroup cbmimage_dir @internal
  *
- * @param[inout] dei
- *    ptr to a *internal* directory entry that will be initialized
+ * @param[in] slot
+ *    pointer to the raw directory entry in the directory block
+ *
+ * @param[inout] entry
+ *    ptr to the directory entry that will be initialized
  *
  * @return
  *    - 0 on success
@@ -92,287 +202,677 @@ cbmimage_dir_get_header_close(
 static
 int
 cbmimage_i_dir_entry_store_datetime(
-		cbmimage_i_dir_entry_internal * dei
+		const uint8_t *      slot,
+		cbmimage_dir_entry * entry
 		)
 {
-	assert(dei != NULL);
+	assert(slot != NULL);
+	assert(entry != NULL);
 
 	if (
-			dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_YEAR]
+			slot[CBMIMAGE_DIR_ENTRY_YEAR]
 			||
-			dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_MONTH]
+			slot[CBMIMAGE_DIR_ENTRY_MONTH]
 			||
-			dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_DAY]
+			slot[CBMIMAGE_DIR_ENTRY_DAY]
 			||
-			dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_HOUR]
+			slot[CBMIMAGE_DIR_ENTRY_HOUR]
 			||
-			dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_MINUTE]
+			slot[CBMIMAGE_DIR_ENTRY_MINUTE]
 		 )
 	{
-		dei->entry.has_datetime = 1;
-		uint16_t year = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_YEAR];
+		entry->has_datetime = 1;
+		uint16_t year = slot[CBMIMAGE_DIR_ENTRY_YEAR];
 		if (year > 83) {
 			year += 1900;
 		}
 		else {
 			year += 2000;
 		}
-		dei->entry.year   = year;
-		dei->entry.month  = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_MONTH];
-		dei->entry.day    = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_DAY];
-		dei->entry.hour   = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_HOUR];
-		dei->entry.minute = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_MINUTE];
+		entry->year   = year;
+		entry->month  = slot[CBMIMAGE_DIR_ENTRY_MONTH];
+		entry->day    = slot[CBMIMAGE_DIR_ENTRY_DAY];
+		entry->hour   = slot[CBMIMAGE_DIR_ENTRY_HOUR];
+		entry->minute = slot[CBMIMAGE_DIR_ENTRY_MINUTE];
 	}
 	else {
-		dei->entry.has_datetime = 0;
-		dei->entry.year   = 0;
-		dei->entry.month  = 0;
-		dei->entry.day    = 0;
-		dei->entry.hour   = 0;
-		dei->entry.minute = 0;
+		entry->has_datetime = 0;
+		entry->year   = 0;
+		entry->month  = 0;
+		entry->day    = 0;
+		entry->hour   = 0;
+		entry->minute = 0;
 	}
 
 	return 0;
 }
 
-/** @brief create a directory entry
- * @ingroup cbmimage_dir @internal
+/** @brief @internal decode the type of a raw directory entry
+ * @ingroup cbmimage_dir
  *
- * @param[inout] dei
- *    ptr to a *internal* directory entry that will be initialized
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slot
+ *    pointer to the raw directory entry in the directory block
  *
  * @return
- *    - 0 on success
- *    - -1 if there are no more directory entries
+ *    the type of the directory entry
+ */
+static cbmimage_dir_type
+cbmimage_i_dir_decode_type(
+		cbmimage_fileimage * image,
+		const uint8_t *      slot
+		)
+{
+	uint8_t type = slot[CBMIMAGE_DIR_ENTRY_TYPE_OFFSET];
+
+	if (image->settings->is_partition_table) {
+		return type + DIR_TYPE_PART_OFFSET;
+	}
+
+	return type & CBMIMAGE_DIR_ENTRY_TYPE_MASK_TYPE;
+}
+
+/** @brief @internal decode the start block of a raw directory entry
+ * @ingroup cbmimage_dir
  *
- * @remark
- *    - If needed, this function reads in the next block of the directory
- *    - After the call, the pointer to the directory entry is advanced to the
- *      next one
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slot
+ *    pointer to the raw directory entry in the directory block
+ *
+ * @return
+ *    the start block of the file or partition
  */
-static int
-cbmimage_i_dir_get(
-		cbmimage_i_dir_entry_internal * dei
+static cbmimage_blockaddress
+cbmimage_i_dir_decode_start_block(
+		cbmimage_fileimage * image,
+		const uint8_t *      slot
 		)
 {
-	if (dei->dir_block_offset >= cbmimage_get_bytes_in_block(dei->image)) {
-		// advance to next block
-		int v = cbmimage_blockaccessor_follow(dei->dir_block_accessor);
+	cbmimage_blockaddress block = cbmimage_block_unused;
 
-		if (v != 0) {
-			return -1;
-		}
+	if (image->settings->is_partition_table) {
+		unsigned int lba =
+				 slot[CBMIMAGE_DIR_ENTRY_PARTITION_START_LOW]
+			| (slot[CBMIMAGE_DIR_ENTRY_PARTITION_START_HIGH] << 8);
 
-		dei->dir_block_offset -= cbmimage_get_bytes_in_block(dei->image);
+		CBMIMAGE_BLOCK_SET_FROM_LBA(
+				image,
+				block,
+				lba * 2 + 1
+				);
 	}
-
-	if (dei->dir_block_offset == 0) {
-		if (cbmimage_loop_mark(dei->loop_detector, dei->dir_block_accessor->block)) {
-			// we fell in a loop, we're done
-			return -1;
-		}
+	else {
+		CBMIMAGE_BLOCK_SET_FROM_TS(
+				image,
+				block,
+				slot[CBMIMAGE_DIR_ENTRY_TRACK_OFFSET],  // track
+				slot[CBMIMAGE_DIR_ENTRY_SECTOR_OFFSET]  // sector
+				);
 	}
 
-	// get the directory data
-	uint8_t type = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_TYPE_OFFSET];
+	return block;
+}
 
-	dei->is_empty = type == 0;
+/** @brief @internal decode the block count of a raw directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slot
+ *    pointer to the raw directory entry in the directory block
+ *
+ * @return
+ *    the count of occupied blocks
+ */
+static uint16_t
+cbmimage_i_dir_decode_block_count(
+		cbmimage_fileimage * image,
+		const uint8_t *      slot
+		)
+{
+	if (image->settings->is_partition_table) {
+		uint16_t block_count =
+				 slot[CBMIMAGE_DIR_ENTRY_PARTITION_BLOCK_COUNT_LOW]
+			| (slot[CBMIMAGE_DIR_ENTRY_PARTITION_BLOCK_COUNT_HIGH] << 8);
 
-	dei->entry.start_block = cbmimage_block_unused;
-	dei->entry.rel_sidesector_block = cbmimage_block_unused;
-	dei->entry.rel_recordlength = 0;
-	dei->entry.is_geos = 0;
-	dei->entry.geos_infoblock = cbmimage_block_unused;
-	dei->entry.geos_filetype = GEOS_FILETYPE_NON_GEOS;
-	dei->entry.geos_is_vlir = 0;
+		return block_count * 2;
+	}
 
-	if (dei->image->settings->is_partition_table) {
-		dei->entry.type = type + DIR_TYPE_PART_OFFSET;
-		dei->entry.is_locked = 0;
-		dei->entry.is_closed = 1;
+	return
+			 slot[CBMIMAGE_DIR_ENTRY_BLOCK_COUNT_LOW]
+		| (slot[CBMIMAGE_DIR_ENTRY_BLOCK_COUNT_HIGH] << 8);
+}
 
-		unsigned int lba =
-				 dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_PARTITION_START_LOW]
-			| (dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_PARTITION_START_HIGH] << 8);
+/** @brief @internal decode a raw directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slot
+ *    pointer to the raw directory entry (CBMIMAGE_DIR_ENTRY_NEXT_ONE bytes)
+ *    in the directory block
+ *
+ * @param[out] entry
+ *    ptr to the directory entry that will be initialized. \n
+ *    is_valid is not changed.
+ *
+ * @return
+ *    - 0 if the entry is in use
+ *    - != 0 if the entry is empty, that is, its CBM DOS file type is 0
+ */
+int
+cbmimage_i_dir_decode(
+		cbmimage_fileimage * image,
+		const uint8_t *      slot,
+		cbmimage_dir_entry * entry
+		)
+{
+	// get the directory data
+	uint8_t type = slot[CBMIMAGE_DIR_ENTRY_TYPE_OFFSET];
 
-		CBMIMAGE_BLOCK_SET_FROM_LBA(
-				dei->image,
-				dei->entry.start_block,
-				lba * 2 + 1
-				);
+	entry->rel_sidesector_block = cbmimage_block_unused;
+	entry->rel_recordlength = 0;
+	entry->is_geos = 0;
+	entry->geos_infoblock = cbmimage_block_unused;
+	entry->geos_filetype = GEOS_FILETYPE_NON_GEOS;
+	entry->geos_is_vlir = 0;
 
-		dei->entry.block_count =
-				 dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_PARTITION_BLOCK_COUNT_LOW]
-			| (dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_PARTITION_BLOCK_COUNT_HIGH] << 8);
+	entry->type = cbmimage_i_dir_decode_type(image, slot);
+	entry->start_block = cbmimage_i_dir_decode_start_block(image, slot);
+	entry->block_count = cbmimage_i_dir_decode_block_count(image, slot);
 
-		dei->entry.block_count *= 2;
+	if (image->settings->is_partition_table) {
+		entry->is_locked = 0;
+		entry->is_closed = 1;
 
-		dei->entry.is_geos = 0;
+		entry->is_geos = 0;
 	}
 	else {
-		dei->entry.type = type & CBMIMAGE_DIR_ENTRY_TYPE_MASK_TYPE;
-		dei->entry.is_locked = type & CBMIMAGE_DIR_ENTRY_TYPE_MASK_LOCKED ? 1 : 0;
-		dei->entry.is_closed = type & CBMIMAGE_DIR_ENTRY_TYPE_MASK_CLOSED ? 1 : 0;
-
-		CBMIMAGE_BLOCK_SET_FROM_TS(
-				dei->image,
-				dei->entry.start_block,
-				dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_TRACK_OFFSET],  // track
-				dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_SECTOR_OFFSET]  // sector
-				);
+		entry->is_locked = type & CBMIMAGE_DIR_ENTRY_TYPE_MASK_LOCKED ? 1 : 0;
+		entry->is_closed = type & CBMIMAGE_DIR_ENTRY_TYPE_MASK_CLOSED ? 1 : 0;
 
 		// check if this is a GEOS file
-		if (dei->entry.type < DIR_TYPE_REL) {
-			uint8_t geos_filetype = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_GEOS_FILETYPE];
-			uint8_t is_vlir = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_GEOS_FILESTRUCTURE];
+		if (entry->type < DIR_TYPE_REL) {
+			uint8_t geos_filetype = slot[CBMIMAGE_DIR_ENTRY_GEOS_FILETYPE];
+			uint8_t is_vlir = slot[CBMIMAGE_DIR_ENTRY_GEOS_FILESTRUCTURE];
 
 			if (geos_filetype != 0 || is_vlir == 1) {
-				dei->entry.is_geos = 1;
-				dei->entry.geos_filetype = geos_filetype;
-				dei->entry.geos_is_vlir = is_vlir;
+				entry->is_geos = 1;
+				entry->geos_filetype = geos_filetype;
+				entry->geos_is_vlir = is_vlir;
 
 				CBMIMAGE_BLOCK_SET_FROM_TS(
-						dei->image,
-						dei->entry.geos_infoblock,
-						dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_GEOS_INFO_TRACK],  // track of GEOS info block
-						dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_GEOS_INFO_SECTOR]  // sector of GEOS info block
+						image,
+						entry->geos_infoblock,
+						slot[CBMIMAGE_DIR_ENTRY_GEOS_INFO_TRACK],  // track of GEOS info block
+						slot[CBMIMAGE_DIR_ENTRY_GEOS_INFO_SECTOR]  // sector of GEOS info block
 						);
 			}
 		}
 
-		if (!dei->entry.is_geos) {
+		if (!entry->is_geos) {
 			CBMIMAGE_BLOCK_SET_FROM_TS(
-					dei->image,
-					dei->entry.rel_sidesector_block,
-					dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_SS_TRACK_OFFSET],  // track of side-sector
-					dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_SS_SECTOR_OFFSET]  // sector of side-sector
+					image,
+					entry->rel_sidesector_block,
+					slot[CBMIMAGE_DIR_ENTRY_SS_TRACK_OFFSET],  // track of side-sector
+					slot[CBMIMAGE_DIR_ENTRY_SS_SECTOR_OFFSET]  // sector of side-sector
 					);
 
-			dei->entry.rel_recordlength = dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_REL_RECORD_LENGTH];
+			entry->rel_recordlength = slot[CBMIMAGE_DIR_ENTRY_REL_RECORD_LENGTH];
 		}
 
-		dei->entry.block_count =
-				 dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_BLOCK_COUNT_LOW]
-			| (dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_BLOCK_COUNT_HIGH] << 8);
-
-		cbmimage_i_dir_entry_store_datetime(dei);
+		cbmimage_i_dir_entry_store_datetime(slot, entry);
 	}
 
 	memcpy(
-			(char*)&dei->entry.name.text[0],
-			&dei->dir_block_accessor->data[dei->dir_block_offset + CBMIMAGE_DIR_ENTRY_NAME_OFFSET],
+			(char*)&entry->name.text[0],
+			&slot[CBMIMAGE_DIR_ENTRY_NAME_OFFSET],
 			CBMIMAGE_DIR_ENTRY_NAME_LENGTH
 			);
 
-	const char * p = strchr(dei->entry.name.text, CBMIMAGE_DIR_ENTRY_NAME_SHIFTSPACE);
+	const char * p = strchr(entry->name.text, CBMIMAGE_DIR_ENTRY_NAME_SHIFTSPACE);
 	if (p) {
-		dei->entry.name.end_index = p - dei->entry.name.text;
+		entry->name.end_index = p - entry->name.text;
 	}
 	else {
-		dei->entry.name.end_index = 16;
+		entry->name.end_index = 16;
+	}
+	entry->name.length = CBMIMAGE_DIR_ENTRY_NAME_LENGTH;
+
+	return type == 0;
+}
+
+/** @brief @internal check if a raw directory entry has never been used
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slot
+ *    pointer to the raw directory entry in the directory block
+ *
+ * @return
+ *    - != 0 if the directory entry has never been used. Such entries are
+ *      skipped when the directory is enumerated.
+ *    - 0 otherwise
+ *
+ * @remark
+ *    - An entry has never been used if it is DEL, neither locked nor closed,
+ *      has no start track and no name. \n
+ *      Entries of a partition table are never unused.
+ */
+int
+cbmimage_i_dir_slot_is_unused(
+		cbmimage_fileimage * image,
+		const uint8_t *      slot
+		)
+{
+	return !image->settings->is_partition_table
+		&& ((slot[CBMIMAGE_DIR_ENTRY_TYPE_OFFSET] & (CBMIMAGE_DIR_ENTRY_TYPE_MASK_TYPE | CBMIMAGE_DIR_ENTRY_TYPE_MASK_LOCKED | CBMIMAGE_DIR_ENTRY_TYPE_MASK_CLOSED)) == 0)
+		&& (slot[CBMIMAGE_DIR_ENTRY_TRACK_OFFSET] == 0)
+		&& (slot[CBMIMAGE_DIR_ENTRY_NAME_OFFSET] == 0);
+}
+
+/** @brief @internal filter for cbmimage_i_dir_get_filtered() that skips unused entries
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slot
+ *    pointer to the raw directory entry in the directory block
+ *
+ * @param[in] context
+ *    unused
+ *
+ * @return
+ *    - != 0 if the directory entry has been used
+ *    - 0 otherwise
+ */
+static int
+cbmimage_i_dir_filter_used(
+		cbmimage_fileimage * image,
+		const uint8_t *      slot,
+		const void *         context
+		)
+{
+	(void) context;
+
+	return !cbmimage_i_dir_slot_is_unused(image, slot);
+}
+
+/** @brief get the raw data of the current directory entry
+ * @ingroup cbmimage_dir @internal
+ *
+ * @param[inout] dei
+ *    ptr to a *internal* directory entry
+ *
+ * @return
+ *    - pointer to the raw directory entry in the directory block
+ *    - NULL if there are no more directory entries
+ *
+ * @remark
+ *    - If needed, this function reads in the next block of the directory
+ *    - The pointer to the directory entry is not advanced.
+ */
+static const uint8_t *
+cbmimage_i_dir_get_raw(
+		cbmimage_i_dir_entry_internal * dei
+		)
+{
+	if (dei->dir_block_offset >= cbmimage_get_bytes_in_block(dei->image)) {
+		// advance to next block
+		int v = cbmimage_blockaccessor_follow(dei->dir_block_accessor);
+
+		if (v != 0) {
+			return NULL;
+		}
+
+		dei->dir_block_offset -= cbmimage_get_bytes_in_block(dei->image);
+	}
+
+	if (dei->dir_block_offset == 0) {
+		if (cbmimage_loop_mark(dei->loop_detector, dei->dir_block_accessor->block)) {
+			// we fell in a loop, we're done
+			return NULL;
+		}
+	}
+
+	return &dei->dir_block_accessor->data[dei->dir_block_offset];
+}
+
+/** @brief create a directory entry
+ * @ingroup cbmimage_dir @internal
+ *
+ * @param[inout] dei
+ *    ptr to a *internal* directory entry that will be initialized
+ *
+ * @return
+ *    - 0 on success
+ *    - -1 if there are no more directory entries
+ *
+ * @remark
+ *    - If needed, this function reads in the next block of the directory
+ *    - After the call, the pointer to the directory entry is advanced to the
+ *      next one
+ */
+static int
+cbmimage_i_dir_get(
+		cbmimage_i_dir_entry_internal * dei
+		)
+{
+	const uint8_t * slot = cbmimage_i_dir_get_raw(dei);
+
+	if (slot == NULL) {
+		return -1;
+	}
+
+	dei->is_empty = cbmimage_i_dir_decode(dei->image, slot, &dei->entry);
+
+	dei->dir_block_offset += CBMIMAGE_DIR_ENTRY_NEXT_ONE;
+
+	return 0;
+}
+
+/** @brief get the next non-empty directory entry
+ * @ingroup cbmimage_dir @internal
+ *
+ * @param[inout] dei
+ *    ptr to a *internal* directory entry that will be initialized
+ *
+ * @return
+ *    - 0 on success
+ *    - -1 if there are no more directory entries
+ *
+ * @remark
+ *    - If needed, this function reads in the next block or blocks of the
+ *      directory until it finds a non-empty entry, or the last directory entry
+ *      has been checked.
+ *    - After the call, the pointer to the directory entry is advanced to the
+ *      next one after the one returned.
+ */
+static int
+cbmimage_i_dir_get_nonempty(
+		cbmimage_i_dir_entry_internal * dei
+		)
+{
+	return cbmimage_i_dir_get_filtered(&dei->entry, cbmimage_i_dir_filter_used, NULL);
+}
+
+/** @brief get the first (non-empty) directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    A pointer to the directory entry. \n
+ *    If there is none, it returns 0.
+ *
+ * @remark
+ *    - the structure obtained by this function has to be freed by
+ *      cbmimage_dir_get_close() once the processing is done.
+ *    - If needed, this function reads in the next block or blocks of the
+ *      directory until it finds a non-empty entry, or the last directory entry
+ *      has been checked.
+ *    - After the call, the pointer to the directory entry is advanced to the
+ *      next one after the one returned.
+ *    - Subsequent entries can be obtained with a call to cbmimage_dir_get_next().
+ *    - If the directory processing is done, the returned pointer and
+ *      associated resources must be freed with a call to cbmimage_dir_get_close().
+ */
+cbmimage_dir_entry *
+cbmimage_dir_get_first(
+		cbmimage_fileimage * image
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) cbmimage_i_dir_open(image);
+
+	if (!dei) {
+		return 0;
+	}
+
+	int ret = cbmimage_i_dir_get_nonempty(dei);
+	return &dei->entry;
+}
+
+/** @brief get the first (non-empty) directory entry without decoding it
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    A pointer to the directory entry. \n
+ *    If there is none, it returns 0.
+ *
+ * @remark
+ *    - This works like cbmimage_dir_get_first(), but neither this function
+ *      nor subsequent calls to cbmimage_dir_get_next() decode the directory
+ *      entry. Only is_valid is set; all other fields are unspecified.
+ *    - The fields can be obtained on demand with cbmimage_dir_get_type(),
+ *      cbmimage_dir_get_raw_name(), cbmimage_dir_get_start_block(),
+ *      cbmimage_dir_get_block_count() and cbmimage_dir_is_deleted(),
+ *      or all at once with cbmimage_dir_decode().
+ *    - the structure obtained by this function has to be freed by
+ *      cbmimage_dir_get_close() once the processing is done.
+ */
+cbmimage_dir_entry *
+cbmimage_dir_get_first_lazy(
+		cbmimage_fileimage * image
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) cbmimage_i_dir_open(image);
+
+	if (!dei) {
+		return 0;
+	}
+
+	dei->is_lazy = 1;
+
+	cbmimage_i_dir_get_nonempty(dei);
+	return &dei->entry;
+}
+
+/** @brief @internal start the processing of the directory
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    A pointer to the directory entry, which is positioned before the
+ *    first entry of the directory and not valid yet. \n
+ *    If an error occurred, it returns NULL.
+ *
+ * @remark
+ *    - the structure obtained by this function has to be freed by
+ *      cbmimage_dir_get_close() once the processing is done.
+ */
+cbmimage_dir_entry *
+cbmimage_i_dir_open(
+		cbmimage_fileimage * image
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = cbmimage_i_xalloc(sizeof * dei);
+
+	if (!dei) {
+		return NULL;
 	}
-	dei->entry.name.length = CBMIMAGE_DIR_ENTRY_NAME_LENGTH;
 
-	dei->dir_block_offset += CBMIMAGE_DIR_ENTRY_NEXT_ONE;
+	dei->image = image;
 
-	return 0;
+	// create a loop detector in order to not fall into a loop
+	dei->loop_detector = cbmimage_loop_create(image);
+
+	dei->dir_block_accessor = cbmimage_blockaccessor_create(image, image->settings->dir);
+	dei->dir_block_offset = 0;
+
+	return &dei->entry;
 }
 
-/** @brief get the next non-empty directory entry
- * @ingroup cbmimage_dir @internal
+/** @brief @internal get the next directory entry that passes a filter
+ * @ingroup cbmimage_dir
  *
- * @param[inout] dei
- *    ptr to a *internal* directory entry that will be initialized
+ * @param[inout] dir_entry
+ *    ptr to a directory entry that was the result of a previous
+ *    cbmimage_i_dir_open(), cbmimage_dir_get_first() or cbmimage_dir_get_next() call.
+ *
+ * @param[in] filter
+ *    the filter that is called on the raw data of each directory entry
+ *
+ * @param[in] context
+ *    the context that is given to the filter
  *
  * @return
  *    - 0 on success
  *    - -1 if there are no more directory entries
  *
  * @remark
- *    - If needed, this function reads in the next block or blocks of the
- *      directory until it finds a non-empty entry, or the last directory entry
- *      has been checked.
- *    - After the call, the pointer to the directory entry is advanced to the
- *      next one after the one returned.
+ *    - Only the entries that pass the filter are decoded; all others are
+ *      skipped on the raw data.
+ *    - If the directory entry has been obtained with cbmimage_dir_get_first_lazy(),
+ *      the entries that pass the filter are not decoded either.
  */
-static int
-cbmimage_i_dir_get_nonempty(
-		cbmimage_i_dir_entry_internal * dei
+int
+cbmimage_i_dir_get_filtered(
+		cbmimage_dir_entry *   dir_entry,
+		cbmimage_i_dir_filter  filter,
+		const void *           context
 		)
 {
-	int ret;
-
-	do {
-		ret = cbmimage_i_dir_get(dei);
-		if (ret) {
-			dei->entry.is_valid = 0;
-			return ret;
-		}
+	assert(dir_entry);
+	assert(filter);
 
-		if (
-				(dei->entry.type == DIR_TYPE_DEL)
-				&& (dei->entry.is_locked == 0)
-				&& (dei->entry.is_closed == 0)
-				&& (dei->entry.start_block.ts.track == 0)
-				&& (dei->entry.name.text[0] == 0)
-				) {
-			continue;
-		}
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
 
-		break;
+	const uint8_t * slot;
 
-	} while (1);
+	while ((slot = cbmimage_i_dir_get_raw(dei)) != NULL) {
+		if (filter(dei->image, slot, context)) {
+			if (dei->is_lazy) {
+				dei->is_empty = slot[CBMIMAGE_DIR_ENTRY_TYPE_OFFSET] == 0;
+			}
+			else {
+				dei->is_empty = cbmimage_i_dir_decode(dei->image, slot, &dei->entry);
+			}
+			dei->dir_block_offset += CBMIMAGE_DIR_ENTRY_NEXT_ONE;
+			dei->entry.is_valid = 1;
+			return 0;
+		}
 
-	dei->entry.is_valid = (ret == 0);
+		dei->dir_block_offset += CBMIMAGE_DIR_ENTRY_NEXT_ONE;
+	}
 
-	return ret;
+	dei->entry.is_valid = 0;
+	return -1;
 }
 
-/** @brief get the first (non-empty) directory entry
+/** @brief @internal get the directory entry at a specific slot
  * @ingroup cbmimage_dir
  *
  * @param[in] image
  *    pointer to the image data
  *
+ * @param[in] block
+ *    the directory block that contains the slot
+ *
+ * @param[in] offset
+ *    the offset of the slot in the directory block
+ *
  * @return
  *    A pointer to the directory entry. \n
- *    If there is none, it returns 0.
+ *    If an error occurred, it returns NULL.
  *
  * @remark
  *    - the structure obtained by this function has to be freed by
  *      cbmimage_dir_get_close() once the processing is done.
- *    - If needed, this function reads in the next block or blocks of the
- *      directory until it finds a non-empty entry, or the last directory entry
- *      has been checked.
- *    - After the call, the pointer to the directory entry is advanced to the
- *      next one after the one returned.
+ *    - The entry is returned even if it is empty.
  *    - Subsequent entries can be obtained with a call to cbmimage_dir_get_next().
- *    - If the directory processing is done, the returned pointer and
- *      associated resources must be freed with a call to cbmimage_dir_get_close().
  */
 cbmimage_dir_entry *
-cbmimage_dir_get_first(
-		cbmimage_fileimage * image
+cbmimage_i_dir_get_at_slot(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block,
+		uint16_t              offset
 		)
 {
 	cbmimage_i_dir_entry_internal * dei = cbmimage_i_xalloc(sizeof * dei);
 
 	if (!dei) {
-		return 0;
+		return NULL;
 	}
 
 	dei->image = image;
-
-	// create a loop detector in order to not fall into a loop
 	dei->loop_detector = cbmimage_loop_create(image);
+	dei->dir_block_accessor = cbmimage_blockaccessor_create(image, block);
+	dei->dir_block_offset = offset;
 
-	dei->dir_block_accessor = cbmimage_blockaccessor_create(image, image->settings->dir);
-	dei->dir_block_offset = 0;
+	if (dei->loop_detector == NULL || dei->dir_block_accessor == NULL || dei->dir_block_accessor->data == NULL) {
+		cbmimage_dir_get_close(&dei->entry);
+		return NULL;
+	}
+
+	// cbmimage_i_dir_get() only marks the block if the slot is the first one in it
+	if (offset != 0) {
+		cbmimage_loop_mark(dei->loop_detector, block);
+	}
+
+	if (cbmimage_i_dir_get(dei)) {
+		cbmimage_dir_get_close(&dei->entry);
+		return NULL;
+	}
+
+	dei->entry.is_valid = 1;
 
-	int ret = cbmimage_i_dir_get_nonempty(dei);
 	return &dei->entry;
 }
 
+/** @brief @internal get the slot of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    ptr to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first() or cbmimage_dir_get_next() call.
+ *
+ * @param[out] block
+ *    pointer to a block address that receives the directory block
+ *    that contains the entry
+ *
+ * @param[out] offset
+ *    pointer to a variable that receives the offset of the entry
+ *    in the directory block
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if the directory entry is not valid
+ */
+int
+cbmimage_i_dir_get_slot(
+		cbmimage_dir_entry *    dir_entry,
+		cbmimage_blockaddress * block,
+		uint16_t *              offset
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	if (dei == NULL || !dei->entry.is_valid || dei->dir_block_accessor == NULL) {
+		return -1;
+	}
+
+	// the offset has already been advanced to the next entry
+	*block = dei->dir_block_accessor->block;
+	*offset = dei->dir_block_offset - CBMIMAGE_DIR_ENTRY_NEXT_ONE;
+
+	return 0;
+}
+
 /** @brief get the next (non-empty) directory entry
  * @ingroup cbmimage_dir
  *
@@ -488,6 +988,172 @@ cbmimage_dir_is_deleted(
 	return dei->is_empty;
 }
 
+/** @brief @internal get the raw data of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    pointer to a valid directory entry
+ *
+ * @return
+ *    pointer to the raw directory entry in the directory block
+ */
+static const uint8_t *
+cbmimage_i_dir_get_slot_data(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	assert(dei->entry.is_valid);
+	assert(dei->dir_block_accessor != NULL);
+
+	// the offset has already been advanced to the next entry
+	return &dei->dir_block_accessor->data[dei->dir_block_offset - CBMIMAGE_DIR_ENTRY_NEXT_ONE];
+}
+
+/** @brief get the raw data of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first(), cbmimage_dir_get_first_lazy() or
+ *    cbmimage_dir_get_next() call.
+ *
+ * @return
+ *    pointer to the 32 byte of the directory entry, as stored on the disk
+ *
+ * @remark
+ *    - The pointer is only valid until the next call to cbmimage_dir_get_next()
+ *      or cbmimage_dir_get_close().
+ */
+const uint8_t *
+cbmimage_dir_get_raw(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	return cbmimage_i_dir_get_slot_data(dir_entry);
+}
+
+/** @brief get the raw name of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first(), cbmimage_dir_get_first_lazy() or
+ *    cbmimage_dir_get_next() call.
+ *
+ * @return
+ *    pointer to the 16 byte of the name, padded with shifted spaces (0xA0).
+ *    No processing (for example, PETSCII conversion) is performed!
+ *
+ * @remark
+ *    - The pointer is only valid until the next call to cbmimage_dir_get_next()
+ *      or cbmimage_dir_get_close().
+ */
+const uint8_t *
+cbmimage_dir_get_raw_name(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	return &cbmimage_i_dir_get_slot_data(dir_entry)[CBMIMAGE_DIR_ENTRY_NAME_OFFSET];
+}
+
+/** @brief get the type of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first(), cbmimage_dir_get_first_lazy() or
+ *    cbmimage_dir_get_next() call.
+ *
+ * @return
+ *    the type of the directory entry, as in the field type of cbmimage_dir_entry
+ */
+cbmimage_dir_type
+cbmimage_dir_get_type(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	return cbmimage_i_dir_decode_type(dei->image, cbmimage_i_dir_get_slot_data(dir_entry));
+}
+
+/** @brief get the start block of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first(), cbmimage_dir_get_first_lazy() or
+ *    cbmimage_dir_get_next() call.
+ *
+ * @return
+ *    the start block, as in the field start_block of cbmimage_dir_entry
+ */
+cbmimage_blockaddress
+cbmimage_dir_get_start_block(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	return cbmimage_i_dir_decode_start_block(dei->image, cbmimage_i_dir_get_slot_data(dir_entry));
+}
+
+/** @brief get the block count of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first(), cbmimage_dir_get_first_lazy() or
+ *    cbmimage_dir_get_next() call.
+ *
+ * @return
+ *    the count of occupied blocks, as in the field block_count of cbmimage_dir_entry
+ */
+uint16_t
+cbmimage_dir_get_block_count(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	return cbmimage_i_dir_decode_block_count(dei->image, cbmimage_i_dir_get_slot_data(dir_entry));
+}
+
+/** @brief decode all fields of a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[inout] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first_lazy() or cbmimage_dir_get_next() call.
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if the directory entry is not valid
+ *
+ * @remark
+ *    - After the call, all fields of the directory entry are set as if
+ *      it had been obtained with cbmimage_dir_get_first().
+ *    - For a directory entry that is not lazy, this function does not change
+ *      anything.
+ */
+int
+cbmimage_dir_decode(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	if (dei == NULL || !dei->entry.is_valid) {
+		return -1;
+	}
+
+	cbmimage_i_dir_decode(dei->image, cbmimage_i_dir_get_slot_data(dir_entry), &dei->entry);
+
+	return 0;
+}
+
 /** @brief extract the name of a directory entry as a C string
  * @ingroup cbmimage_dir
  *
@@ -528,7 +1194,7 @@ cbmimage_dir_extract_name(
 
 	memset(name_buffer, 0, name_buffer_len);
 
-	memcpy(name_buffer, dir_name->text, name_buffer_len);
+	memcpy(name_buffer, dir_name->text, dir_name->length);
 	name_buffer[dir_name->end_index] = 0;
 	name_buffer[dir_name->length] = 0;
 
@@ -576,6 +1242,66 @@ cbmimage_i_dir_get_clone(
 	return &dei_cloned->entry;
 }
 
+/** @brief @internal perform a chdir into given settings
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first() or cbmimage_dir_get_next() call.
+ *
+ * @param[in] new_settings
+ *    the memory for the settings of the new directory
+ *
+ * @param[in] is_borrowed
+ *    if != 0, new_settings is not freed by cbmimage_dir_chdir_close()
+ *
+ * @return
+ *  - 0 on success
+ *  - != 0 otherwise. In this case, new_settings is already freed,
+ *    unless is_borrowed is set.
+ */
+static int
+cbmimage_i_dir_chdir_to(
+		cbmimage_dir_entry *      dir_entry,
+		cbmimage_image_settings * new_settings,
+		int                       is_borrowed
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (cbmimage_i_dir_entry_internal *) dir_entry;
+
+	cbmimage_fileimage * image = dei->image;
+
+	memcpy(new_settings, image->settings, sizeof *new_settings);
+
+	new_settings->next_settings = image->settings;
+	new_settings->fat = 0;
+	new_settings->bam_decoded = NULL;
+	new_settings->really_unused_map = NULL;
+	new_settings->bam_track = NULL;
+	new_settings->bam_alloc_distance = 0;
+	new_settings->bam_blocks_free_valid = 0;
+	new_settings->dir_index = NULL;
+	new_settings->dir_slots = NULL;
+	new_settings->dir_header = NULL;
+	new_settings->dir_header_valid = 0;
+	new_settings->is_borrowed = is_borrowed ? 1 : 0;
+
+	new_settings->info = NULL;
+
+	image->settings = new_settings;
+
+	if ( (image->settings->fct.chdir(image->settings, dir_entry) == 0)
+	  && (cbmimage_i_bam_track_table_create(image->settings) == 0)
+	   )
+	{
+		return 0;
+	}
+
+	cbmimage_dir_chdir_close(image);
+
+	return 1;
+}
+
 /** @brief perform a chdir to a partition marked by a directory entry
  * @ingroup cbmimage_dir
  *
@@ -598,34 +1324,51 @@ cbmimage_dir_chdir(
 
 	cbmimage_fileimage * image = dei ? dei->image : NULL;
 
-	int error = 1;
-
 	if (image && image->settings && image->settings->fct.chdir) {
-		new_settings = cbmimage_i_xalloc_and_copy(sizeof *new_settings, dei->image->settings, sizeof *new_settings);
+		new_settings = cbmimage_i_xalloc(sizeof *new_settings);
 	}
 
-	if (new_settings) {
-		new_settings->next_settings = image->settings;
-		new_settings->fat = 0;
+	if (new_settings == NULL) {
+		return 1;
+	}
 
-		new_settings->info = NULL;
+	return cbmimage_i_dir_chdir_to(dir_entry, new_settings, 0);
+}
 
-		image->settings = new_settings;
-		new_settings = NULL;
-		if (image->settings->fct.chdir(image->settings, dir_entry) == 0) {
-			error = 0;
-		}
-		else {
-			cbmimage_dir_chdir_close(image);
-		}
-	}
+/** @brief @internal perform a chdir into settings provided by the caller
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first() or cbmimage_dir_get_next() call.
+ *
+ * @param[in] frame
+ *    the memory for the settings of the new directory
+ *
+ * @return
+ *  - 0 on success
+ *  - != 0 otherwise
+ *
+ * @remark
+ *   - This works like cbmimage_dir_chdir(), but the settings are not
+ *     allocated. Thus, the same frame can be used again after
+ *     cbmimage_dir_chdir_close(), which does not free it.
+ */
+int
+cbmimage_i_dir_chdir_frame(
+		cbmimage_dir_entry *      dir_entry,
+		cbmimage_image_settings * frame
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (cbmimage_i_dir_entry_internal *) dir_entry;
+
+	cbmimage_fileimage * image = dei ? dei->image : NULL;
 
-	if (new_settings) {
-		// an error occurred, free the memory block
-		cbmimage_i_xfree(new_settings);
+	if (!image || !image->settings || !image->settings->fct.chdir || !frame) {
+		return 1;
 	}
 
-	return error;
+	return cbmimage_i_dir_chdir_to(dir_entry, frame, 1);
 }
 
 /** @brief "close a chdir"; that is, go back to the parent directory
@@ -661,12 +1404,21 @@ cbmimage_dir_chdir_close(
 			settings_to_pop->fat = NULL;
 		}
 
+		cbmimage_i_bam_cache_invalidate(settings_to_pop);
+		cbmimage_i_dir_index_invalidate(settings_to_pop);
+		cbmimage_i_dir_slots_invalidate(settings_to_pop);
+		cbmimage_i_dir_header_cache_close(settings_to_pop);
+		cbmimage_i_bam_track_table_close(settings_to_pop);
+
 		if (image->settings->info != settings_to_pop->info) {
 			cbmimage_blockaccessor_close(settings_to_pop->info);
 			settings_to_pop->info = NULL;
 		}
 		settings_to_pop->next_settings = NULL;
-		cbmimage_i_xfree(settings_to_pop);
+
+		if (!settings_to_pop->is_borrowed) {
+			cbmimage_i_xfree(settings_to_pop);
+		}
 
 		error = 0;
 	}
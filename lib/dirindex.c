@@ -0,0 +1,432 @@
+/** @file lib/dirindex.c \n
+ * @author Spiro Trikaliotis \n
+ * \n
+ * @brief cbmimage: index of the directory for finding files by name
+ *
+ * Finding a file by its name would require to walk the directory and to
+ * decode every entry. Instead, the directory is walked once, and the names
+ * of all entries are stored in a hash table, together with the location
+ * (directory block and offset) of their slots. Afterwards, a file can be
+ * found without walking the directory again.
+ *
+ * The index is discarded as soon as a block of the directory chain is
+ * written with cbmimage_write_block().
+ */
+#include "cbmimage/internal.h"
+#include "cbmimage/alloc.h"
+
+#include "cbmimage/internal/dir.h"
+
+#include <assert.h>
+#include <string.h>
+
+/** @brief @internal normalize a file name for comparison
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] name
+ *    pointer to the name
+ *
+ * @param[in] name_length
+ *    the maximum length of the name. The name ends earlier
+ *    at a NUL or a shifted space (0xA0).
+ *
+ * @param[out] normalized
+ *    buffer of CBMIMAGE_DIR_ENTRY_NAME_LENGTH bytes that receives the
+ *    normalized name
+ *
+ * @remark
+ *    - The normalized name is the name as it is stored in a directory
+ *      entry, that is, padded with shifted spaces. Everything after the
+ *      first shifted space is ignored, as the CBM DOS does.
+ */
+void
+cbmimage_i_dir_name_normalize(
+		const uint8_t * name,
+		size_t          name_length,
+		uint8_t *       normalized
+		)
+{
+	size_t i;
+
+	for (i = 0; i < CBMIMAGE_DIR_ENTRY_NAME_LENGTH && i < name_length; ++i) {
+		if (name[i] == 0 || name[i] == CBMIMAGE_DIR_ENTRY_NAME_SHIFTSPACE) {
+			break;
+		}
+		normalized[i] = name[i];
+	}
+
+	for ( /* unchanged */ ; i < CBMIMAGE_DIR_ENTRY_NAME_LENGTH; ++i) {
+		normalized[i] = CBMIMAGE_DIR_ENTRY_NAME_SHIFTSPACE;
+	}
+}
+
+/** @brief @internal calculate the hash of a normalized file name
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] normalized
+ *    the normalized name, cf. cbmimage_i_dir_name_normalize()
+ *
+ * @return
+ *    the hash of the name (32 bit FNV-1a)
+ */
+static
+uint32_t
+cbmimage_i_dir_index_hash(
+		const uint8_t * normalized
+		)
+{
+	uint32_t hash = 0x811C9DC5u;
+
+	for (size_t i = 0; i < CBMIMAGE_DIR_ENTRY_NAME_LENGTH; ++i) {
+		hash ^= normalized[i];
+		hash *= 0x01000193u;
+	}
+
+	return hash;
+}
+
+/** @brief @internal free the directory index
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @remark
+ *    - The next lookup builds the index again.
+ */
+void
+cbmimage_i_dir_index_invalidate(
+		cbmimage_image_settings * settings
+		)
+{
+	assert(settings != NULL);
+
+	cbmimage_i_dir_index * index = settings->dir_index;
+
+	if (index) {
+		cbmimage_i_xfree(index->slot);
+		cbmimage_i_xfree(index->table);
+		cbmimage_i_xfree(index->block_lba);
+		cbmimage_i_xfree(index);
+		settings->dir_index = NULL;
+	}
+}
+
+/** @brief @internal inform the directory index that a block has been written
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    the address of the block that has been written
+ *
+ * @remark
+ *    - If the block is part of the directory, the index is discarded.
+ */
+void
+cbmimage_i_dir_index_block_written(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+	cbmimage_i_dir_index * index = settings->dir_index;
+
+	if (index) {
+		for (size_t i = 0; i < index->block_count; ++i) {
+			if (index->block_lba[i] == block.lba) {
+				cbmimage_i_dir_index_invalidate(settings);
+				break;
+			}
+		}
+	}
+}
+
+/** @brief @internal grow an array that is built while walking the directory
+ * @ingroup cbmimage_dir
+ *
+ * @param[inout] array
+ *    pointer to the pointer to the array
+ *
+ * @param[inout] capacity
+ *    pointer to the number of elements the array can hold
+ *
+ * @param[in] element_size
+ *    the size of one element of the array
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if an error occurred. In this case, the array is unchanged.
+ *
+ * @remark
+ *    - The capacity is doubled, starting with 16 elements.
+ */
+int
+cbmimage_i_dir_array_grow(
+		void **  array,
+		size_t * capacity,
+		size_t   element_size
+		)
+{
+	size_t capacity_new = *capacity ? *capacity * 2 : 16;
+
+	void * array_new = cbmimage_i_xalloc_and_copy(capacity_new * element_size, *array, *capacity * element_size);
+
+	if (array_new == NULL) {
+		return -1;
+	}
+
+	cbmimage_i_xfree(*array);
+	*array = array_new;
+	*capacity = capacity_new;
+
+	return 0;
+}
+
+/** @brief @internal remember the blocks of the directory in the directory index
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[inout] index
+ *    the directory index
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *    - All blocks of the directory chain are remembered, not only the ones
+ *      holding a used entry: Otherwise, an entry that is created in an
+ *      empty or a newly appended directory block would not discard the index.
+ *    - The walk stops at a loop in the directory chain.
+ */
+static
+int
+cbmimage_i_dir_index_record_blocks(
+		cbmimage_fileimage *   image,
+		cbmimage_i_dir_index * index
+		)
+{
+	size_t block_capacity = 0;
+	int error = 0;
+
+	cbmimage_loop * loop_detector = cbmimage_loop_create(image);
+	cbmimage_blockaccessor * accessor = cbmimage_blockaccessor_create(image, image->settings->dir);
+
+	if (loop_detector == NULL || accessor == NULL || accessor->data == NULL) {
+		error = 1;
+	}
+
+	while (!error && !cbmimage_loop_mark(loop_detector, accessor->block)) {
+		if ( index->block_count == block_capacity
+		  && cbmimage_i_dir_array_grow((void **) &index->block_lba, &block_capacity, sizeof *index->block_lba)
+		   )
+		{
+			error = 1;
+			break;
+		}
+
+		index->block_lba[index->block_count++] = accessor->block.lba;
+
+		if (cbmimage_blockaccessor_follow(accessor) != 0) {
+			break;
+		}
+	}
+
+	if (accessor) {
+		cbmimage_blockaccessor_close(accessor);
+	}
+
+	if (loop_detector) {
+		cbmimage_loop_close(loop_detector);
+	}
+
+	return error;
+}
+
+/** @brief @internal build the directory index
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    - pointer to the index
+ *    - NULL if an error occurred
+ *
+ * @remark
+ *    - The index is only built once; afterwards, the cached index is
+ *      returned, until it is invalidated with cbmimage_i_dir_index_invalidate().
+ */
+static
+cbmimage_i_dir_index *
+cbmimage_i_dir_index_get(
+		cbmimage_fileimage * image
+		)
+{
+	cbmimage_image_settings * settings = image->settings;
+
+	if (settings->dir_index) {
+		return settings->dir_index;
+	}
+
+	cbmimage_i_dir_index * index = cbmimage_i_xalloc(sizeof *index);
+
+	if (index == NULL) {
+		return NULL;
+	}
+
+	settings->dir_index = index;
+
+	size_t slot_capacity = 0;
+	int error = cbmimage_i_dir_index_record_blocks(image, index);
+
+	cbmimage_dir_entry * dir_entry;
+
+	for (dir_entry = error ? NULL : cbmimage_dir_get_first(image);
+	     cbmimage_dir_get_is_valid(dir_entry);
+	     cbmimage_dir_get_next(dir_entry)
+	    )
+	{
+		cbmimage_blockaddress block;
+		uint16_t              offset;
+
+		if (cbmimage_i_dir_get_slot(dir_entry, &block, &offset)) {
+			error = 1;
+			break;
+		}
+
+		if (cbmimage_dir_is_deleted(dir_entry)) {
+			continue;
+		}
+
+		if ( index->slot_count == slot_capacity
+		  && cbmimage_i_dir_array_grow((void **) &index->slot, &slot_capacity, sizeof *index->slot)
+		   )
+		{
+			error = 1;
+			break;
+		}
+
+		uint8_t normalized[CBMIMAGE_DIR_ENTRY_NAME_LENGTH];
+		cbmimage_i_dir_name_normalize((const uint8_t *) dir_entry->name.text, CBMIMAGE_DIR_ENTRY_NAME_LENGTH, normalized);
+
+		cbmimage_i_dir_index_slot * slot = &index->slot[index->slot_count++];
+
+		slot->hash = cbmimage_i_dir_index_hash(normalized);
+		slot->block = block;
+		slot->offset = offset;
+	}
+
+	cbmimage_dir_get_close(dir_entry);
+
+	if (!error) {
+		// the hash table is at most half full
+		index->table_size = 16;
+		while (index->table_size < 2 * index->slot_count) {
+			index->table_size *= 2;
+		}
+
+		index->table = cbmimage_i_xalloc(index->table_size * sizeof *index->table);
+
+		if (index->table == NULL) {
+			error = 1;
+		}
+	}
+
+	if (error) {
+		cbmimage_i_dir_index_invalidate(settings);
+		return NULL;
+	}
+
+	// insert the slots in directory order, so that the first of
+	// multiple entries with the same name is found first
+	for (size_t i = 0; i < index->slot_count; ++i) {
+		size_t position = index->slot[i].hash & (index->table_size - 1);
+
+		while (index->table[position] != 0) {
+			position = (position + 1) & (index->table_size - 1);
+		}
+
+		index->table[position] = i + 1;
+	}
+
+	return index;
+}
+
+/** @brief find a file in the directory by its name
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] name
+ *    the name of the file, as PETSCII. At most 16 characters are used;
+ *    a shifted space (0xA0) ends the name, too.
+ *
+ * @return
+ *    A pointer to the directory entry of the file. \n
+ *    If there is no such file, it returns NULL.
+ *
+ * @remark
+ *    - the structure obtained by this function has to be freed by
+ *      cbmimage_dir_get_close() once the processing is done.
+ *    - The name must match exactly; no wildcards are processed.
+ *    - If there are multiple files with the same name, the first one in the
+ *      directory is returned.
+ *    - On the first call, the directory is walked once and its entries are
+ *      stored in an index. Further calls only look up that index.
+ */
+cbmimage_dir_entry *
+cbmimage_dir_find(
+		cbmimage_fileimage * image,
+		const char *         name
+		)
+{
+	assert(image != NULL);
+	assert(name != NULL);
+
+	cbmimage_i_dir_index * index = cbmimage_i_dir_index_get(image);
+
+	if (index == NULL) {
+		return NULL;
+	}
+
+	uint8_t normalized[CBMIMAGE_DIR_ENTRY_NAME_LENGTH];
+	cbmimage_i_dir_name_normalize((const uint8_t *) name, strlen(name), normalized);
+
+	uint32_t hash = cbmimage_i_dir_index_hash(normalized);
+
+	for (size_t position = hash & (index->table_size - 1);
+	     index->table[position] != 0;
+	     position = (position + 1) & (index->table_size - 1)
+	    )
+	{
+		cbmimage_i_dir_index_slot * slot = &index->slot[index->table[position] - 1];
+
+		if (slot->hash != hash) {
+			continue;
+		}
+
+		// compare the name in the directory block, as different names can have the same hash
+		const uint8_t * data = cbmimage_i_get_address_of_block(image, slot->block);
+
+		if (data == NULL) {
+			continue;
+		}
+
+		uint8_t normalized_slot[CBMIMAGE_DIR_ENTRY_NAME_LENGTH];
+		cbmimage_i_dir_name_normalize(&data[slot->offset + CBMIMAGE_DIR_ENTRY_NAME_OFFSET], CBMIMAGE_DIR_ENTRY_NAME_LENGTH, normalized_slot);
+
+		if (memcmp(normalized, normalized_slot, sizeof normalized) == 0) {
+			return cbmimage_i_dir_get_at_slot(image, slot->block, slot->offset);
+		}
+	}
+
+	return NULL;
+}
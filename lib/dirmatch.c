@@ -0,0 +1,241 @@
+/** @file lib/dirmatch.c \n
+ * @author Spiro Trikaliotis \n
+ * \n
+ * @brief cbmimage: search the directory with CBM DOS file name patterns
+ *
+ * A pattern like "GAME*" or "A?C=P" is compiled once with
+ * cbmimage_dir_match_compile(). Afterwards, the directory is searched with
+ * cbmimage_dir_match_first() and cbmimage_dir_match_next(). The compiled
+ * pattern is checked on the raw directory entry in the directory block;
+ * only the entries that match are decoded.
+ */
+#include "cbmimage/internal.h"
+
+#include "cbmimage/internal/dir.h"
+
+#include <assert.h>
+#include <string.h>
+
+/** @brief compile a CBM DOS file name pattern
+ * @ingroup cbmimage_dir
+ *
+ * @param[out] match
+ *    pointer to the compiled pattern
+ *
+ * @param[in] pattern
+ *    the pattern, as PETSCII. It consists of the name, optionally followed
+ *    by a type filter:
+ *    - '?' matches any character of the name
+ *    - '*' matches the rest of the name, including an empty one.
+ *      Everything after a '*' is ignored, as the CBM DOS does.
+ *    - "=D", "=S", "=P", "=U", "=R" or "=C" only matches DEL, SEQ, PRG,
+ *      USR, REL or CBM files.
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if the pattern is invalid
+ *
+ * @remark
+ *    - The compiled pattern does not depend on an image; it can be used on
+ *      as many images as wanted.
+ */
+int
+cbmimage_dir_match_compile(
+		cbmimage_dir_match * match,
+		const char *         pattern
+		)
+{
+	assert(match != NULL);
+	assert(pattern != NULL);
+
+	memset(match, 0, sizeof *match);
+	match->type = -1;
+
+	int is_wildcard_rest = 0;
+	size_t i = 0;
+
+	for ( ; *pattern && *pattern != '='; ++pattern) {
+		if (is_wildcard_rest) {
+			continue;
+		}
+
+		if (*pattern == '*') {
+			is_wildcard_rest = 1;
+			continue;
+		}
+
+		if (i >= sizeof match->name) {
+			return -1;
+		}
+
+		if (*pattern == '?') {
+			match->any_char |= 1u << i;
+		}
+		else {
+			match->name[i] = (uint8_t) *pattern;
+			match->mask[i] = 0xFFu;
+		}
+
+		++i;
+	}
+
+	if (!is_wildcard_rest && i < sizeof match->name) {
+		// the name must end here
+		match->name[i] = CBMIMAGE_DIR_ENTRY_NAME_SHIFTSPACE;
+		match->mask[i] = 0xFFu;
+	}
+
+	if (*pattern == '=') {
+		switch (pattern[1]) {
+			case 'D': case 'd': match->type = DIR_TYPE_DEL;      break;
+			case 'S': case 's': match->type = DIR_TYPE_SEQ;      break;
+			case 'P': case 'p': match->type = DIR_TYPE_PRG;      break;
+			case 'U': case 'u': match->type = DIR_TYPE_USR;      break;
+			case 'R': case 'r': match->type = DIR_TYPE_REL;      break;
+			case 'C': case 'c': match->type = DIR_TYPE_PART1581; break;
+			default:
+				return -1;
+		}
+
+		if (pattern[2] != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** @brief @internal check if a raw directory entry matches a compiled pattern
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slot
+ *    pointer to the raw directory entry in the directory block
+ *
+ * @param[in] context
+ *    the compiled pattern, cf. cbmimage_dir_match_compile()
+ *
+ * @return
+ *    - != 0 if the directory entry matches
+ *    - 0 if not
+ *
+ * @remark
+ *    - Deleted entries never match.
+ *    - The name is compared 8 byte at a time.
+ */
+static int
+cbmimage_i_dir_match_filter(
+		cbmimage_fileimage * image,
+		const uint8_t *      slot,
+		const void *         context
+		)
+{
+	const cbmimage_dir_match * match = context;
+
+	uint8_t type = slot[CBMIMAGE_DIR_ENTRY_TYPE_OFFSET];
+
+	if (type == 0) {
+		return 0;
+	}
+
+	if (match->type >= 0) {
+		if ( image->settings->is_partition_table
+		  || (type & CBMIMAGE_DIR_ENTRY_TYPE_MASK_TYPE) != match->type
+		   )
+		{
+			return 0;
+		}
+	}
+
+	const uint8_t * name = &slot[CBMIMAGE_DIR_ENTRY_NAME_OFFSET];
+
+	uint64_t name_word[2];
+	uint64_t pattern_word[2];
+	uint64_t mask_word[2];
+
+	memcpy(name_word, name, sizeof name_word);
+	memcpy(pattern_word, match->name, sizeof pattern_word);
+	memcpy(mask_word, match->mask, sizeof mask_word);
+
+	if ( ((name_word[0] ^ pattern_word[0]) & mask_word[0])
+	  || ((name_word[1] ^ pattern_word[1]) & mask_word[1])
+	   )
+	{
+		return 0;
+	}
+
+	for (unsigned int i = 0; match->any_char >> i; ++i) {
+		if ((match->any_char & (1u << i)) && name[i] == CBMIMAGE_DIR_ENTRY_NAME_SHIFTSPACE) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/** @brief get the first directory entry that matches a pattern
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] match
+ *    the compiled pattern, cf. cbmimage_dir_match_compile()
+ *
+ * @return
+ *    A pointer to the directory entry. \n
+ *    If there is no matching entry, it is not valid, cf. cbmimage_dir_get_is_valid(). \n
+ *    If an error occurred, it returns NULL.
+ *
+ * @remark
+ *    - the structure obtained by this function has to be freed by
+ *      cbmimage_dir_get_close() once the processing is done.
+ *    - Subsequent entries can be obtained with a call to cbmimage_dir_match_next().
+ */
+cbmimage_dir_entry *
+cbmimage_dir_match_first(
+		cbmimage_fileimage *       image,
+		const cbmimage_dir_match * match
+		)
+{
+	assert(image != NULL);
+	assert(match != NULL);
+
+	cbmimage_dir_entry * dir_entry = cbmimage_i_dir_open(image);
+
+	if (dir_entry) {
+		cbmimage_i_dir_get_filtered(dir_entry, cbmimage_i_dir_match_filter, match);
+	}
+
+	return dir_entry;
+}
+
+/** @brief get the next directory entry that matches a pattern
+ * @ingroup cbmimage_dir
+ *
+ * @param[inout] dir_entry
+ *    ptr to a directory entry that was the result of a previous
+ *    cbmimage_dir_match_first() or cbmimage_dir_match_next() call. \n
+ *    On return, this dir_entry contains the next matching directory entry
+ *    if the return value is 0.
+ *
+ * @param[in] match
+ *    the compiled pattern, cf. cbmimage_dir_match_compile()
+ *
+ * @return
+ *    - 0 on success
+ *    - -1 if there are no more matching directory entries
+ */
+int
+cbmimage_dir_match_next(
+		cbmimage_dir_entry *       dir_entry,
+		const cbmimage_dir_match * match
+		)
+{
+	assert(dir_entry != NULL);
+	assert(match != NULL);
+
+	return cbmimage_i_dir_get_filtered(dir_entry, cbmimage_i_dir_match_filter, match);
+}
@@ -0,0 +1,138 @@
+/** @file lib/dirsnapshot.c \n
+ * @author Spiro Trikaliotis \n
+ * \n
+ * @brief cbmimage: snapshot of the whole directory
+ *
+ * Enumerating the directory with cbmimage_dir_get_first() and
+ * cbmimage_dir_get_next() decodes one entry per call. If the whole directory
+ * is needed anyway (for example, for a listing), cbmimage_dir_snapshot()
+ * walks the directory chain once and returns all entries in one array.
+ */
+#include "cbmimage/internal.h"
+#include "cbmimage/alloc.h"
+
+#include "cbmimage/internal/dir.h"
+
+#include <assert.h>
+#include <string.h>
+
+/** @brief get a snapshot of the directory
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[out] count
+ *    pointer to a variable that receives the number of entries
+ *    in the snapshot
+ *
+ * @return
+ *    - pointer to an array of *count entries, in directory order
+ *    - NULL if an error occurred, or if the directory is empty. \n
+ *      In this case, *count is 0.
+ *
+ * @remark
+ *    - the array obtained by this function has to be freed by
+ *      cbmimage_dir_snapshot_close() once the processing is done.
+ *    - The snapshot contains the same entries as an enumeration with
+ *      cbmimage_dir_get_first() and cbmimage_dir_get_next(), including
+ *      the deleted ones.
+ *    - The location of each entry (slot_block and slot_offset) is
+ *      recorded, so that the entry can be updated later.
+ *    - The snapshot is not updated if the directory is changed afterwards.
+ */
+cbmimage_dir_snapshot_entry *
+cbmimage_dir_snapshot(
+		cbmimage_fileimage * image,
+		size_t *             count
+		)
+{
+	assert(image != NULL);
+	assert(count != NULL);
+
+	cbmimage_dir_snapshot_entry * snapshot = NULL;
+	size_t snapshot_capacity = 0;
+	int error = 0;
+
+	*count = 0;
+
+	cbmimage_loop * loop_detector = cbmimage_loop_create(image);
+	cbmimage_blockaccessor * accessor = cbmimage_blockaccessor_create(image, image->settings->dir);
+
+	if (loop_detector == NULL || accessor == NULL) {
+		error = 1;
+	}
+
+	uint16_t bytes_in_block = cbmimage_get_bytes_in_block(image);
+
+	while (!error && accessor->data) {
+		if (cbmimage_loop_mark(loop_detector, accessor->block)) {
+			// we fell in a loop, we're done
+			break;
+		}
+
+		for (uint16_t offset = 0; offset < bytes_in_block; offset += CBMIMAGE_DIR_ENTRY_NEXT_ONE) {
+			if (cbmimage_i_dir_slot_is_unused(image, &accessor->data[offset])) {
+				continue;
+			}
+
+			// the scratch entry is cleared, as the name is processed as a C string
+			cbmimage_dir_entry entry;
+			memset(&entry, 0, sizeof entry);
+
+			int is_empty = cbmimage_i_dir_decode(image, &accessor->data[offset], &entry);
+
+			if ( *count == snapshot_capacity
+			  && cbmimage_i_dir_array_grow((void **) &snapshot, &snapshot_capacity, sizeof *snapshot)
+			   )
+			{
+				error = 1;
+				break;
+			}
+
+			cbmimage_dir_snapshot_entry * record = &snapshot[(*count)++];
+
+			memcpy(record->name, entry.name.text, sizeof record->name);
+			record->name_end_index = entry.name.end_index;
+			record->is_deleted = is_empty ? 1 : 0;
+			record->is_locked = entry.is_locked;
+			record->is_closed = entry.is_closed;
+			record->is_geos = entry.is_geos;
+			record->type = entry.type;
+			record->block_count = entry.block_count;
+			record->start_block = entry.start_block;
+			record->slot_block = accessor->block;
+			record->slot_offset = offset;
+		}
+
+		if (cbmimage_blockaccessor_follow(accessor) != 0) {
+			break;
+		}
+	}
+
+	cbmimage_blockaccessor_close(accessor);
+	cbmimage_loop_close(loop_detector);
+
+	if (error || *count == 0) {
+		cbmimage_i_xfree(snapshot);
+		snapshot = NULL;
+		*count = 0;
+	}
+
+	return snapshot;
+}
+
+/** @brief free the resources from a cbmimage_dir_snapshot()
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] snapshot
+ *    ptr to the array that was the result of a previous
+ *    cbmimage_dir_snapshot() call. Can be NULL.
+ */
+void
+cbmimage_dir_snapshot_close(
+		cbmimage_dir_snapshot_entry * snapshot
+		)
+{
+	cbmimage_i_xfree(snapshot);
+}
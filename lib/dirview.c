@@ -0,0 +1,326 @@
+/** @file lib/dirview.c \n
+ * @author Spiro Trikaliotis \n
+ * \n
+ * @brief cbmimage: sorted and filtered views of a directory snapshot
+ *
+ * A view is a permutation of the indices of a directory snapshot
+ * (cf. cbmimage_dir_snapshot()). Only the entries that pass a filter are
+ * part of the view, and they can be sorted by name, size or type.
+ *
+ * For sorting, a sort key of a fixed width is calculated once for every
+ * entry. The keys are compared byte by byte, thus, the view is sorted
+ * with a (stable) LSD radix sort, without any comparison function.
+ */
+#include "cbmimage/internal.h"
+#include "cbmimage/alloc.h"
+
+#include <assert.h>
+#include <string.h>
+
+/** @brief @internal the maximum width of a sort key
+ * @ingroup cbmimage_dir
+ *
+ * A sort key consists of 2 byte for the block count or type,
+ * followed by the 16 byte of the name.
+ */
+#define CBMIMAGE_I_DIR_VIEW_KEY_WIDTH_MAX (2 + 16)
+
+/** @brief @internal check if a flag passes a filter
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] filter
+ *    the filter, cf. cbmimage_dir_view_filter
+ *
+ * @param[in] flag
+ *    the value of the flag
+ *
+ * @return
+ *    - != 0 if the flag passes the filter
+ *    - 0 otherwise
+ */
+static int
+cbmimage_i_dir_view_flag_passes(
+		int          filter,
+		unsigned int flag
+		)
+{
+	return filter < 0 || (filter ? 1u : 0u) == flag;
+}
+
+/** @brief @internal check if an entry passes a filter
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] entry
+ *    the entry of the snapshot
+ *
+ * @param[in] filter
+ *    the filter
+ *
+ * @return
+ *    - != 0 if the entry is part of the view
+ *    - 0 otherwise
+ */
+static int
+cbmimage_i_dir_view_passes(
+		const cbmimage_dir_snapshot_entry * entry,
+		const cbmimage_dir_view_filter *    filter
+		)
+{
+	return (filter->type < 0 || filter->type == entry->type)
+		&& cbmimage_i_dir_view_flag_passes(filter->is_deleted, entry->is_deleted)
+		&& cbmimage_i_dir_view_flag_passes(filter->is_locked, entry->is_locked)
+		&& cbmimage_i_dir_view_flag_passes(filter->is_closed, entry->is_closed)
+		&& cbmimage_i_dir_view_flag_passes(filter->is_geos, entry->is_geos);
+}
+
+/** @brief @internal calculate the sort key of an entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] entry
+ *    the entry of the snapshot
+ *
+ * @param[in] order
+ *    the order of the view
+ *
+ * @param[out] key
+ *    the buffer for the key
+ *
+ * @return
+ *    the width of the key
+ *
+ * @remark
+ *    - The name ends at name_end_index; the rest of the key is 0, so that
+ *      a name is sorted before every longer name that starts with it.
+ *    - Numbers are stored big endian, so that the keys can be sorted bytewise.
+ */
+static size_t
+cbmimage_i_dir_view_key(
+		const cbmimage_dir_snapshot_entry * entry,
+		cbmimage_dir_view_order             order,
+		uint8_t *                           key
+		)
+{
+	size_t width = 0;
+
+	switch (order) {
+		case DIR_VIEW_ORDER_SIZE:
+			key[width++] = (uint8_t) (entry->block_count >> 8);
+			key[width++] = (uint8_t) entry->block_count;
+			break;
+
+		case DIR_VIEW_ORDER_TYPE:
+			key[width++] = (uint8_t) (entry->type >> 8);
+			key[width++] = (uint8_t) entry->type;
+			break;
+
+		default:
+			break;
+	}
+
+	size_t name_length = entry->name_end_index < sizeof entry->name ? entry->name_end_index : sizeof entry->name;
+
+	memcpy(&key[width], entry->name, name_length);
+	memset(&key[width + name_length], 0, sizeof entry->name - name_length);
+
+	return width + sizeof entry->name;
+}
+
+/** @brief @internal sort the view by the keys
+ * @ingroup cbmimage_dir
+ *
+ * @param[inout] view
+ *    the indices of the view. On return, they are sorted.
+ *
+ * @param[in] scratch
+ *    a buffer for twice as many indices as view
+ *
+ * @param[in] rank
+ *    a buffer for as many indices as view
+ *
+ * @param[in] view_count
+ *    the number of indices in view
+ *
+ * @param[in] keys
+ *    the keys; the key of view[i] is at keys[i * width]
+ *
+ * @param[in] width
+ *    the width of one key
+ *
+ * @remark
+ *    - This is a LSD radix sort, one pass per byte of the key. Passes where
+ *      all keys have the same byte are skipped; thus, the trailing bytes
+ *      of short names do not cost anything.
+ *    - The sort is stable, entries with the same key remain in directory order.
+ *    - The keys are not moved; rank[] holds the position of the key of each
+ *      element of view.
+ */
+static void
+cbmimage_i_dir_view_sort(
+		size_t *        view,
+		size_t *        scratch,
+		size_t *        rank,
+		size_t          view_count,
+		const uint8_t * keys,
+		size_t          width
+		)
+{
+	size_t * rank_scratch = &scratch[view_count];
+
+	for (size_t i = 0; i < view_count; ++i) {
+		rank[i] = i;
+	}
+
+	for (size_t byte = width; byte-- > 0; ) {
+		size_t bucket[256] = { 0 };
+
+		for (size_t i = 0; i < view_count; ++i) {
+			++bucket[keys[rank[i] * width + byte]];
+		}
+
+		if (bucket[keys[rank[0] * width + byte]] == view_count) {
+			// all keys are equal in this byte
+			continue;
+		}
+
+		size_t position = 0;
+
+		for (size_t i = 0; i < 256; ++i) {
+			size_t bucket_count = bucket[i];
+			bucket[i] = position;
+			position += bucket_count;
+		}
+
+		for (size_t i = 0; i < view_count; ++i) {
+			size_t target = bucket[keys[rank[i] * width + byte]]++;
+
+			scratch[target] = view[i];
+			rank_scratch[target] = rank[i];
+		}
+
+		memcpy(view, scratch, view_count * sizeof *view);
+		memcpy(rank, rank_scratch, view_count * sizeof *rank);
+	}
+}
+
+/** @brief get a sorted and filtered view of a directory snapshot
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] snapshot
+ *    the snapshot, as returned by cbmimage_dir_snapshot()
+ *
+ * @param[in] count
+ *    the number of entries of snapshot
+ *
+ * @param[in] order
+ *    the order of the view
+ *
+ * @param[in] filter
+ *    the filter for the entries of the view. \n
+ *    If this is NULL, all entries that are not deleted are part of the view.
+ *
+ * @param[out] view_count
+ *    pointer to a variable that receives the number of entries in the view
+ *
+ * @return
+ *    - pointer to an array of *view_count indices into snapshot
+ *    - NULL if an error occurred, or if the view is empty. \n
+ *      In this case, *view_count is 0.
+ *
+ * @remark
+ *    - the array obtained by this function has to be freed by
+ *      cbmimage_dir_view_close() once the processing is done.
+ *    - Names are compared as PETSCII, without any conversion.
+ *    - Entries that are equal in the order remain in directory order.
+ */
+size_t *
+cbmimage_dir_view(
+		const cbmimage_dir_snapshot_entry * snapshot,
+		size_t                              count,
+		cbmimage_dir_view_order             order,
+		const cbmimage_dir_view_filter *    filter,
+		size_t *                            view_count
+		)
+{
+	assert(view_count != NULL);
+
+	static const cbmimage_dir_view_filter filter_default = {
+		.type       = -1,
+		.is_deleted = 0,
+		.is_locked  = -1,
+		.is_closed  = -1,
+		.is_geos    = -1,
+	};
+
+	*view_count = 0;
+
+	if (snapshot == NULL || count == 0) {
+		return NULL;
+	}
+
+	if (filter == NULL) {
+		filter = &filter_default;
+	}
+
+	size_t * view = cbmimage_i_xalloc(count * sizeof *view);
+
+	if (view == NULL) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		if (cbmimage_i_dir_view_passes(&snapshot[i], filter)) {
+			view[(*view_count)++] = i;
+		}
+	}
+
+	if (*view_count == 0) {
+		cbmimage_i_xfree(view);
+		return NULL;
+	}
+
+	if (order == DIR_VIEW_ORDER_DIRECTORY || *view_count == 1) {
+		return view;
+	}
+
+	// the width of the key only depends on the order
+	uint8_t key[CBMIMAGE_I_DIR_VIEW_KEY_WIDTH_MAX];
+	size_t width = cbmimage_i_dir_view_key(&snapshot[view[0]], order, key);
+
+	// one block for the rank, the two scratch buffers and the keys
+	size_t * buffer = cbmimage_i_xalloc(*view_count * (3 * sizeof *buffer + width));
+
+	if (buffer == NULL) {
+		cbmimage_i_xfree(view);
+		*view_count = 0;
+		return NULL;
+	}
+
+	size_t * rank = buffer;
+	size_t * scratch = &buffer[*view_count];
+	uint8_t * keys = (uint8_t *) &buffer[3 * *view_count];
+
+	for (size_t i = 0; i < *view_count; ++i) {
+		cbmimage_i_dir_view_key(&snapshot[view[i]], order, &keys[i * width]);
+	}
+
+	cbmimage_i_dir_view_sort(view, scratch, rank, *view_count, keys, width);
+
+	cbmimage_i_xfree(buffer);
+
+	return view;
+}
+
+/** @brief free the resources from a cbmimage_dir_view()
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] view
+ *    ptr to the array that was the result of a previous
+ *    cbmimage_dir_view() call. Can be NULL.
+ */
+void
+cbmimage_dir_view_close(
+		size_t * view
+		)
+{
+	cbmimage_i_xfree(view);
+}
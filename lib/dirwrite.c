@@ -0,0 +1,827 @@
+/** @file lib/dirwrite.c \n
+ * @author Spiro Trikaliotis \n
+ * \n
+ * @brief cbmimage: create, delete and rename directory entries, and compact the directory
+ *
+ * New directory entries are placed in the first free slot of the directory,
+ * as the CBM DOS does. In order not to walk the directory for every new
+ * entry, the free slots of all directory blocks are stored in an index
+ * when the first entry is created. If there is no free slot, the directory
+ * is extended by a new block on the track of its last block.
+ *
+ * Deleted entries remain in the directory. cbmimage_dir_compact() packs
+ * the remaining entries into as few blocks as possible, and frees the
+ * other blocks of the directory.
+ *
+ * All changes are written with cbmimage_write_block(), thus, the BAM
+ * and FAT caches are kept up to date.
+ */
+#include "cbmimage/internal.h"
+#include "cbmimage/alloc.h"
+
+#include "cbmimage/internal/dir.h"
+
+#include <assert.h>
+#include <string.h>
+
+/** @brief @internal the size of the buffer for a copy of a directory block
+ * @ingroup cbmimage_dir
+ */
+#define CBMIMAGE_I_DIR_BLOCK_BUFFER_SIZE 256
+
+/** @brief @internal the number of slots in a directory block
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    the number of slots
+ */
+static unsigned int
+cbmimage_i_dir_slots_per_block(
+		cbmimage_fileimage * image
+		)
+{
+	unsigned int slots = cbmimage_get_bytes_in_block(image) / CBMIMAGE_DIR_ENTRY_NEXT_ONE;
+
+	// cbmimage_i_dir_slots_block::free_mask has 8 bits
+	assert(slots <= 8);
+
+	return slots;
+}
+
+/** @brief @internal get the free slots of a directory block
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] data
+ *    the contents of the directory block
+ *
+ * @return
+ *    the free mask, cf. cbmimage_i_dir_slots_block::free_mask
+ *
+ * @remark
+ *    - A slot is free if its CBM DOS file type is 0, as the CBM DOS
+ *      reuses the slots of deleted files, too.
+ */
+static uint8_t
+cbmimage_i_dir_slots_get_free_mask(
+		cbmimage_fileimage * image,
+		const uint8_t *      data
+		)
+{
+	uint8_t free_mask = 0;
+
+	for (unsigned int i = 0; i < cbmimage_i_dir_slots_per_block(image); ++i) {
+		if (data[i * CBMIMAGE_DIR_ENTRY_NEXT_ONE + CBMIMAGE_DIR_ENTRY_TYPE_OFFSET] == 0) {
+			free_mask |= 1u << i;
+		}
+	}
+
+	return free_mask;
+}
+
+/** @brief @internal free the free slot index
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] settings
+ *    pointer to the image data internal settings
+ *
+ * @remark
+ *    - The next cbmimage_dir_create_entry() builds the index again.
+ */
+void
+cbmimage_i_dir_slots_invalidate(
+		cbmimage_image_settings * settings
+		)
+{
+	assert(settings != NULL);
+
+	cbmimage_i_dir_slots * slots = settings->dir_slots;
+
+	if (slots) {
+		cbmimage_i_xfree(slots->block);
+		cbmimage_i_xfree(slots);
+		settings->dir_slots = NULL;
+	}
+}
+
+/** @brief @internal inform the free slot index that a block has been written
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    the address of the block that has been written
+ *
+ * @remark
+ *    - If the block is part of the directory, the index is discarded. \n
+ *      The functions in this file keep the index up to date themselves,
+ *      cf. cbmimage_i_dir_slots_write().
+ */
+void
+cbmimage_i_dir_slots_block_written(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+	cbmimage_i_dir_slots * slots = settings->dir_slots;
+
+	if (slots) {
+		for (size_t i = 0; i < slots->block_count; ++i) {
+			if (slots->block[i].block.lba == block.lba) {
+				cbmimage_i_dir_slots_invalidate(settings);
+				break;
+			}
+		}
+	}
+}
+
+/** @brief @internal write a directory block without discarding the free slot index
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    the address of the block to write
+ *
+ * @param[in] data
+ *    the contents of the block
+ *
+ * @return
+ *    - 0 on success
+ *    - -1 if an error occurred
+ *
+ * @remark
+ *    - The caller has to update the free slot index itself.
+ */
+static int
+cbmimage_i_dir_slots_write(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block,
+		uint8_t *             data
+		)
+{
+	cbmimage_image_settings * settings = image->settings;
+
+	// hide the index, so that cbmimage_write_block() does not discard it
+	cbmimage_i_dir_slots * slots = settings->dir_slots;
+	settings->dir_slots = NULL;
+
+	int ret = cbmimage_write_block(image, block, data, cbmimage_get_bytes_in_block(image));
+
+	settings->dir_slots = slots;
+
+	return ret;
+}
+
+/** @brief @internal build the free slot index
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    - pointer to the index
+ *    - NULL if an error occurred
+ *
+ * @remark
+ *    - The index is only built once; afterwards, the cached index is
+ *      returned, until it is invalidated with cbmimage_i_dir_slots_invalidate().
+ */
+static cbmimage_i_dir_slots *
+cbmimage_i_dir_slots_get(
+		cbmimage_fileimage * image
+		)
+{
+	cbmimage_image_settings * settings = image->settings;
+
+	if (settings->dir_slots) {
+		return settings->dir_slots;
+	}
+
+	cbmimage_i_dir_slots * slots = cbmimage_i_xalloc(sizeof *slots);
+
+	if (slots == NULL) {
+		return NULL;
+	}
+
+	settings->dir_slots = slots;
+
+	int error = 0;
+
+	cbmimage_loop * loop_detector = cbmimage_loop_create(image);
+	cbmimage_blockaccessor * accessor = cbmimage_blockaccessor_create(image, settings->dir);
+
+	if (loop_detector == NULL || accessor == NULL || accessor->data == NULL) {
+		error = 1;
+	}
+
+	while (!error) {
+		if (cbmimage_loop_mark(loop_detector, accessor->block)) {
+			// the directory must not be extended behind a loop
+			error = 1;
+			break;
+		}
+
+		if ( slots->block_count == slots->block_capacity
+		  && cbmimage_i_dir_array_grow((void **) &slots->block, &slots->block_capacity, sizeof *slots->block)
+		   )
+		{
+			error = 1;
+			break;
+		}
+
+		cbmimage_i_dir_slots_block * slots_block = &slots->block[slots->block_count++];
+
+		slots_block->block = accessor->block;
+		slots_block->free_mask = cbmimage_i_dir_slots_get_free_mask(image, accessor->data);
+
+		if (cbmimage_blockaccessor_follow(accessor) != 0) {
+			break;
+		}
+	}
+
+	cbmimage_blockaccessor_close(accessor);
+	cbmimage_loop_close(loop_detector);
+
+	if (error) {
+		cbmimage_i_dir_slots_invalidate(settings);
+		return NULL;
+	}
+
+	return slots;
+}
+
+/** @brief @internal append a new block to the directory
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] slots
+ *    the free slot index
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if there is no free block on the track of the last
+ *      directory block, or an error occurred
+ *
+ * @remark
+ *    - The new block is allocated on the track of the last directory block,
+ *      with the directory interleave of the DOS
+ *      (cf. cbmimage_image_settings::dir_interleave): For example, the
+ *      directory of a D64 continues 18/1, 18/4, 18/7, ... \n
+ *      All its slots are free.
+ */
+static int
+cbmimage_i_dir_slots_extend(
+		cbmimage_fileimage *   image,
+		cbmimage_i_dir_slots * slots
+		)
+{
+	uint8_t data[CBMIMAGE_I_DIR_BLOCK_BUFFER_SIZE];
+
+	if ( slots->block_count == slots->block_capacity
+	  && cbmimage_i_dir_array_grow((void **) &slots->block, &slots->block_capacity, sizeof *slots->block)
+	   )
+	{
+		return -1;
+	}
+
+	cbmimage_blockaddress block_last = slots->block[slots->block_count - 1].block;
+	cbmimage_blockaddress block_new;
+
+	if (cbmimage_i_bam_alloc_on_track(image, block_last, image->settings->dir_interleave, &block_new)) {
+		return -1;
+	}
+
+	// the new block is the last one of the directory
+	memset(data, 0, sizeof data);
+	data[0] = 0;
+	data[1] = 0xFF;
+
+	if (cbmimage_i_dir_slots_write(image, block_new, data)) {
+		cbmimage_bam_free(image, block_new);
+		return -1;
+	}
+
+	// link the old last block to it
+	if (cbmimage_read_block(image, block_last, data, sizeof data) < 0) {
+		cbmimage_bam_free(image, block_new);
+		return -1;
+	}
+
+	data[0] = block_new.ts.track;
+	data[1] = block_new.ts.sector;
+
+	if (cbmimage_i_dir_slots_write(image, block_last, data)) {
+		cbmimage_bam_free(image, block_new);
+		return -1;
+	}
+
+	cbmimage_i_dir_slots_block * slots_block = &slots->block[slots->block_count++];
+
+	slots_block->block = block_new;
+	slots_block->free_mask = (uint8_t) ((1u << cbmimage_i_dir_slots_per_block(image)) - 1);
+
+	return 0;
+}
+
+/** @brief @internal mark a slot as free in the free slot index
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    the directory block that contains the slot
+ *
+ * @param[in] offset
+ *    the offset of the slot in the directory block
+ */
+static void
+cbmimage_i_dir_slots_release(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block,
+		uint16_t              offset
+		)
+{
+	cbmimage_i_dir_slots * slots = image->settings->dir_slots;
+
+	if (slots == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < slots->block_count; ++i) {
+		if (slots->block[i].block.lba == block.lba) {
+			slots->block[i].free_mask |= 1u << (offset / CBMIMAGE_DIR_ENTRY_NEXT_ONE);
+
+			if (i < slots->block_first_free) {
+				slots->block_first_free = i;
+			}
+			break;
+		}
+	}
+}
+
+/** @brief @internal update a directory entry after its slot has been written
+ * @ingroup cbmimage_dir
+ *
+ * @param[inout] dir_entry
+ *    the directory entry
+ */
+static void
+cbmimage_i_dir_entry_refresh(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	dei->is_empty = cbmimage_i_dir_decode(dei->image, cbmimage_dir_get_raw(dir_entry), &dei->entry);
+}
+
+/** @brief create a new directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] name
+ *    the name of the file, as PETSCII. At most 16 characters are used;
+ *    a shifted space (0xA0) ends the name, too.
+ *
+ * @param[in] type
+ *    the type of the file. It must be one of the CBM DOS file types
+ *    (DIR_TYPE_DEL to DIR_TYPE_CMD_NATIVE).
+ *
+ * @param[in] start_block
+ *    the first block of the file. Except for DIR_TYPE_DEL, it must be a
+ *    block that exists in the image.
+ *
+ * @param[in] block_count
+ *    the number of blocks of the file
+ *
+ * @return
+ *    A pointer to the new directory entry. \n
+ *    If an error occurred, the start block does not exist, or the directory
+ *    is full, it returns NULL.
+ *
+ * @remark
+ *    - the structure obtained by this function has to be freed by
+ *      cbmimage_dir_get_close() once the processing is done.
+ *    - The entry is created as a closed file. As such, it must have a valid
+ *      start block, as the other functions of the library follow it. All other data of the entry
+ *      (for example, the side-sector of REL files or the GEOS data) is 0.
+ *    - The first free slot in the directory is used. If there is none, the
+ *      directory is extended by a block on the track of its last block.
+ *    - This function neither allocates the blocks of the file nor checks if
+ *      a file with the same name already exists.
+ *    - On the first call, the directory is walked once and its free slots are
+ *      stored in an index. Further calls only look up that index.
+ */
+cbmimage_dir_entry *
+cbmimage_dir_create_entry(
+		cbmimage_fileimage *  image,
+		const char *          name,
+		cbmimage_dir_type     type,
+		cbmimage_blockaddress start_block,
+		uint16_t              block_count
+		)
+{
+	assert(image != NULL);
+	assert(name != NULL);
+
+	uint8_t data[CBMIMAGE_I_DIR_BLOCK_BUFFER_SIZE];
+
+	if (image->settings->is_partition_table || type > DIR_TYPE_CMD_NATIVE) {
+		return NULL;
+	}
+
+	if ( type != DIR_TYPE_DEL
+	  && !cbmimage_blockaddress_ts_exists(image, start_block.ts.track, start_block.ts.sector)
+	   )
+	{
+		return NULL;
+	}
+
+	cbmimage_i_dir_slots * slots = cbmimage_i_dir_slots_get(image);
+
+	if (slots == NULL) {
+		return NULL;
+	}
+
+	while ( slots->block_first_free < slots->block_count
+	     && slots->block[slots->block_first_free].free_mask == 0
+	      )
+	{
+		++slots->block_first_free;
+	}
+
+	if (slots->block_first_free == slots->block_count && cbmimage_i_dir_slots_extend(image, slots)) {
+		return NULL;
+	}
+
+	cbmimage_i_dir_slots_block * slots_block = &slots->block[slots->block_first_free];
+
+	unsigned int slot_number = 0;
+
+	while ((slots_block->free_mask & (1u << slot_number)) == 0) {
+		++slot_number;
+	}
+
+	uint16_t offset = slot_number * CBMIMAGE_DIR_ENTRY_NEXT_ONE;
+
+	if (cbmimage_read_block(image, slots_block->block, data, sizeof data) < 0) {
+		return NULL;
+	}
+
+	uint8_t * slot = &data[offset];
+
+	// the first two byte of the slot are the link of the directory block
+	memset(&slot[CBMIMAGE_DIR_ENTRY_TYPE_OFFSET], 0, CBMIMAGE_DIR_ENTRY_NEXT_ONE - CBMIMAGE_DIR_ENTRY_TYPE_OFFSET);
+
+	slot[CBMIMAGE_DIR_ENTRY_TYPE_OFFSET]     = (uint8_t) type | CBMIMAGE_DIR_ENTRY_TYPE_MASK_CLOSED;
+	slot[CBMIMAGE_DIR_ENTRY_TRACK_OFFSET]    = start_block.ts.track;
+	slot[CBMIMAGE_DIR_ENTRY_SECTOR_OFFSET]   = start_block.ts.sector;
+	slot[CBMIMAGE_DIR_ENTRY_BLOCK_COUNT_LOW] = block_count & 0xFFu;
+	slot[CBMIMAGE_DIR_ENTRY_BLOCK_COUNT_HIGH]= block_count >> 8;
+
+	cbmimage_i_dir_name_normalize((const uint8_t *) name, strlen(name), &slot[CBMIMAGE_DIR_ENTRY_NAME_OFFSET]);
+
+	if (cbmimage_i_dir_slots_write(image, slots_block->block, data)) {
+		return NULL;
+	}
+
+	slots_block->free_mask &= ~(1u << slot_number);
+
+	return cbmimage_i_dir_get_at_slot(image, slots_block->block, offset);
+}
+
+/** @brief delete a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[inout] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first(), cbmimage_dir_get_next() or
+ *    cbmimage_dir_create_entry() call. \n
+ *    On return, it describes the deleted entry.
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if the directory entry is not valid, it is already deleted,
+ *      or an error occurred
+ *
+ * @remark
+ *    - As the CBM DOS does on a scratch, only the file type is set to 0.
+ *      The slot is reused by the next cbmimage_dir_create_entry().
+ *    - The blocks of the file are not freed in the BAM; use
+ *      cbmimage_bam_free() for this.
+ */
+int
+cbmimage_dir_delete_entry(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	uint8_t data[CBMIMAGE_I_DIR_BLOCK_BUFFER_SIZE];
+
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	cbmimage_blockaddress block;
+	uint16_t              offset;
+
+	if ( cbmimage_i_dir_get_slot(dir_entry, &block, &offset)
+	  || dei->image->settings->is_partition_table
+	  || dei->is_empty
+	   )
+	{
+		return -1;
+	}
+
+	if (cbmimage_read_block(dei->image, block, data, sizeof data) < 0) {
+		return -1;
+	}
+
+	data[offset + CBMIMAGE_DIR_ENTRY_TYPE_OFFSET] = 0;
+
+	if (cbmimage_i_dir_slots_write(dei->image, block, data)) {
+		return -1;
+	}
+
+	cbmimage_i_dir_slots_release(dei->image, block, offset);
+	cbmimage_i_dir_entry_refresh(dir_entry);
+
+	return 0;
+}
+
+/** @brief rename a directory entry
+ * @ingroup cbmimage_dir
+ *
+ * @param[inout] dir_entry
+ *    pointer to a directory entry that was the result of a previous
+ *    cbmimage_dir_get_first(), cbmimage_dir_get_next() or
+ *    cbmimage_dir_create_entry() call. \n
+ *    On return, it has the new name.
+ *
+ * @param[in] name
+ *    the new name of the file, as PETSCII. At most 16 characters are used;
+ *    a shifted space (0xA0) ends the name, too.
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if the directory entry is not valid, or an error occurred
+ *
+ * @remark
+ *    - This function does not check if a file with the same name already exists.
+ */
+int
+cbmimage_dir_rename_entry(
+		cbmimage_dir_entry * dir_entry,
+		const char *         name
+		)
+{
+	assert(name != NULL);
+
+	uint8_t data[CBMIMAGE_I_DIR_BLOCK_BUFFER_SIZE];
+
+	cbmimage_i_dir_entry_internal * dei = (void*) dir_entry;
+
+	cbmimage_blockaddress block;
+	uint16_t              offset;
+
+	if (cbmimage_i_dir_get_slot(dir_entry, &block, &offset) || dei->image->settings->is_partition_table) {
+		return -1;
+	}
+
+	if (cbmimage_read_block(dei->image, block, data, sizeof data) < 0) {
+		return -1;
+	}
+
+	cbmimage_i_dir_name_normalize((const uint8_t *) name, strlen(name), &data[offset + CBMIMAGE_DIR_ENTRY_NAME_OFFSET]);
+
+	if (cbmimage_i_dir_slots_write(dei->image, block, data)) {
+		return -1;
+	}
+
+	cbmimage_i_dir_entry_refresh(dir_entry);
+
+	return 0;
+}
+
+/** @brief compact the directory
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] keep_deleted
+ *    - 0 if deleted entries are removed
+ *    - != 0 if deleted entries are kept (for example, for undeleting them
+ *      later). Entries that have never been used are removed anyway.
+ *
+ * @return
+ *    - the number of directory blocks that have been freed in the BAM
+ *    - -1 if an error occurred
+ *
+ * @remark
+ *    - The entries are packed into the first blocks of the directory chain,
+ *      in directory order. The chain is truncated after the last block that
+ *      is needed, and the blocks after it are freed in the BAM. The first
+ *      block of the directory is always kept.
+ *    - The new contents of all blocks are built, and it is checked that all
+ *      blocks can be written and freed, before the image is changed. If
+ *      anything fails up to then, the directory is not changed.
+ *    - If the directory chain contains a loop, the directory is not changed.
+ *    - A block that is removed from the chain, but that was already marked
+ *      as free in a damaged BAM, is not counted as freed.
+ *    - If freeing a block fails nonetheless, the directory has already been
+ *      compacted, but the BAM might not have been updated completely;
+ *      -1 is returned in this case.
+ *    - Directory entries that have been obtained before are not valid anymore.
+ */
+int
+cbmimage_dir_compact(
+		cbmimage_fileimage * image,
+		int                  keep_deleted
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+
+	if (settings->is_partition_table) {
+		return -1;
+	}
+
+	cbmimage_blockaddress * block = NULL;
+	size_t block_count = 0;
+	size_t block_capacity = 0;
+
+	uint8_t * entry = NULL;
+	size_t entry_count = 0;
+	size_t entry_capacity = 0;
+
+	int error = 0;
+
+	uint16_t bytes_in_block = cbmimage_get_bytes_in_block(image);
+	unsigned int slots_per_block = cbmimage_i_dir_slots_per_block(image);
+
+	cbmimage_loop * loop_detector = cbmimage_loop_create(image);
+	cbmimage_blockaccessor * accessor = cbmimage_blockaccessor_create(image, settings->dir);
+
+	if (loop_detector == NULL || accessor == NULL || accessor->data == NULL) {
+		error = 1;
+	}
+
+	// collect the directory blocks and the entries to keep
+	while (!error) {
+		if (cbmimage_loop_mark(loop_detector, accessor->block)) {
+			error = 1;
+			break;
+		}
+
+		if ( block_count == block_capacity
+		  && cbmimage_i_dir_array_grow((void **) &block, &block_capacity, sizeof *block)
+		   )
+		{
+			error = 1;
+			break;
+		}
+
+		block[block_count++] = accessor->block;
+
+		for (uint16_t offset = 0; offset < bytes_in_block; offset += CBMIMAGE_DIR_ENTRY_NEXT_ONE) {
+			const uint8_t * slot = &accessor->data[offset];
+
+			if ( cbmimage_i_dir_slot_is_unused(image, slot)
+			  || (!keep_deleted && slot[CBMIMAGE_DIR_ENTRY_TYPE_OFFSET] == 0)
+			   )
+			{
+				continue;
+			}
+
+			if ( entry_count == entry_capacity
+			  && cbmimage_i_dir_array_grow((void **) &entry, &entry_capacity, CBMIMAGE_DIR_ENTRY_NEXT_ONE)
+			   )
+			{
+				error = 1;
+				break;
+			}
+
+			memcpy(&entry[entry_count++ * CBMIMAGE_DIR_ENTRY_NEXT_ONE], slot, CBMIMAGE_DIR_ENTRY_NEXT_ONE);
+		}
+
+		if (cbmimage_blockaccessor_follow(accessor) != 0) {
+			break;
+		}
+	}
+
+	cbmimage_blockaccessor_close(accessor);
+	cbmimage_loop_close(loop_detector);
+
+	size_t block_count_needed = (entry_count + slots_per_block - 1) / slots_per_block;
+
+	if (block_count_needed == 0) {
+		block_count_needed = 1;
+	}
+
+	// build the new contents of all blocks that are kept, before anything is written
+	uint8_t * data = NULL;
+
+	if (!error) {
+		data = cbmimage_i_xalloc(block_count_needed * bytes_in_block);
+
+		if (data == NULL) {
+			error = 1;
+		}
+		else {
+			memset(data, 0, block_count_needed * bytes_in_block);
+		}
+	}
+
+	for (size_t i = 0; !error && i < block_count_needed; ++i) {
+		uint8_t * block_data = &data[i * bytes_in_block];
+
+		if (i + 1 < block_count_needed) {
+			block_data[0] = block[i + 1].ts.track;
+			block_data[1] = block[i + 1].ts.sector;
+		}
+		else {
+			block_data[0] = 0;
+			block_data[1] = 0xFF;
+		}
+
+		for (unsigned int slot_number = 0; slot_number < slots_per_block; ++slot_number) {
+			size_t entry_number = i * slots_per_block + slot_number;
+
+			if (entry_number >= entry_count) {
+				break;
+			}
+
+			// the first two byte of the slot are the link of the directory block
+			memcpy(
+					&block_data[slot_number * CBMIMAGE_DIR_ENTRY_NEXT_ONE + CBMIMAGE_DIR_ENTRY_TYPE_OFFSET],
+					&entry[entry_number * CBMIMAGE_DIR_ENTRY_NEXT_ONE + CBMIMAGE_DIR_ENTRY_TYPE_OFFSET],
+					CBMIMAGE_DIR_ENTRY_NEXT_ONE - CBMIMAGE_DIR_ENTRY_TYPE_OFFSET
+					);
+		}
+
+		// make sure the block can be written, so that the chain is not left half-written
+		if (cbmimage_i_get_address_of_block(image, block[i]) == NULL) {
+			error = 1;
+		}
+	}
+
+	// make sure the blocks that are not needed anymore can be freed
+	for (size_t i = block_count_needed; !error && i < block_count; ++i) {
+		cbmimage_BAM_state bam_state = cbmimage_bam_get(image, block[i]);
+
+		if (bam_state == BAM_UNKNOWN || bam_state == BAM_DOES_NOT_EXIST) {
+			error = 1;
+		}
+	}
+
+	int ret = -1;
+
+	if (!error) {
+		// write the entries into the blocks that are kept
+		for (size_t i = 0; i < block_count_needed; ++i) {
+			if (cbmimage_write_block(image, block[i], &data[i * bytes_in_block], bytes_in_block)) {
+				error = 1;
+				break;
+			}
+		}
+
+		int blocks_freed = 0;
+
+		// free the blocks that are not needed anymore
+		for (size_t i = block_count_needed; !error && i < block_count; ++i) {
+			int ret_free = cbmimage_bam_free(image, block[i]);
+
+			if (ret_free < 0) {
+				error = 1;
+			}
+			else if (ret_free == 0) {
+				++blocks_freed;
+			}
+		}
+
+		if (!error) {
+			ret = blocks_freed;
+		}
+	}
+
+	cbmimage_i_xfree(data);
+	cbmimage_i_xfree(entry);
+	cbmimage_i_xfree(block);
+
+	return ret;
+}
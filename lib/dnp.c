@@ -101,12 +101,12 @@ cbmimage_i_dnp_set_bam(
 	cbmimage_blockaddress block_next = cbmimage_block_unused;
 	cbmimage_blockaddress_init_from_ts_value(image, &block_current, 1, 0);
 
-	if (cbmimage_fat_is_used(settings->fat, block_current)) {
-		cbmimage_i_fmt_print("====> Marking already marked C128 boot block at %u/%u(%03X).\n",
-				block_current.ts.track, block_current.ts.sector, block_current.lba);
+	cbmimage_block_owner owner_boot = { .type = BLOCK_OWNER_RESERVED, .dir_index = 0 };
+	cbmimage_block_owner owner_bam  = { .type = BLOCK_OWNER_BAM,      .dir_index = 0 };
+
+	if (cbmimage_i_mark_global_and_local(image, NULL, block_current, block_current, block_next, owner_boot)) {
 		ret = -1;
 	}
-	cbmimage_fat_set(image->settings->fat, block_current, block_next);
 
 	cbmimage_blockaddress_advance(image, &block_current);
 	cbmimage_blockaddress_advance(image, &block_current);
@@ -114,13 +114,12 @@ cbmimage_i_dnp_set_bam(
 	block_next = block_current;
 	cbmimage_blockaddress_advance(image, &block_next);
 
+	cbmimage_blockaddress block_start = block_current;
+
 	for (int i = 3; i < 34; ++i) {
-		if (cbmimage_fat_is_used(settings->fat, block_current)) {
-			cbmimage_i_fmt_print("====> Marking already marked BAM block at %u/%u(%03X).\n",
-					block_current.ts.track, block_current.ts.sector, block_current.lba);
+		if (cbmimage_i_mark_global_and_local(image, NULL, block_start, block_current, block_next, owner_bam)) {
 			ret = -1;
 		}
-		cbmimage_fat_set(image->settings->fat, block_current, block_next);
 
 		if (block_next.lba > 0) {
 			block_current = block_next;
@@ -200,6 +199,8 @@ cbmimage_i_dnp_chdir_partition_init(
 	settings->info_offset_diskname = 0x04;
 	settings->dir_tracks[0] = 1;
 	settings->dir_tracks[1] = 0;
+	settings->interleave = 1;
+	settings->dir_interleave = 1;
 
 	settings->maxtracks = 255; // for now, will be set correctly later
 	settings->maxsectors = 256;
@@ -9,16 +9,306 @@
 #include "cbmimage/alloc.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 // #define CBMIMAGE_FAT_DEBUG 1
 
-/** @brief @internal mark for the last block of a FAT
+/** @brief @internal allocate the dense representation of a FAT
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @return
+ *    - 0 if everything is ok
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *  - The owner and the entry arrays share one allocation; owner is the
+ *    start of it.
+ */
+static
+int
+cbmimage_i_fat_alloc_dense(
+		cbmimage_fat * fat
+		)
+{
+	uint8_t * buffer = cbmimage_i_xalloc(fat->elements * (sizeof(fat->owner[0]) + sizeof(fat->entry[0])));
+
+	if (buffer == NULL) {
+		return -1;
+	}
+
+	fat->owner = (cbmimage_block_owner *) &buffer[0];
+	fat->entry = (cbmimage_fat_entry *) &buffer[fat->elements * sizeof(fat->owner[0])];
+
+	return 0;
+}
+
+/** @brief @internal free the extent representation of a FAT
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ */
+static
+void
+cbmimage_i_fat_free_extents(
+		cbmimage_fat * fat
+		)
+{
+	cbmimage_i_xfree(fat->extent);
+	cbmimage_i_xfree(fat->owner_extent);
+
+	fat->extent = NULL;
+	fat->extent_count = 0;
+	fat->owner_extent = NULL;
+	fat->owner_extent_count = 0;
+}
+
+/** @brief @internal find the extent that contains an LBA
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a compacted fat structure
+ *
+ * @param[in] lba
+ *    The LBA to search for
+ *
+ * @return
+ *    pointer to the extent that contains the LBA
+ */
+static
+const cbmimage_fat_extent *
+cbmimage_i_fat_find_extent(
+		const cbmimage_fat * fat,
+		uint16_t             lba
+		)
+{
+	size_t low  = 0;
+	size_t high = fat->extent_count;
+
+	// the extents cover all LBAs without gaps, thus, search for the last one starting at or before lba
+	while (high - low > 1) {
+		size_t mid = low + (high - low) / 2;
+
+		if (fat->extent[mid].start <= lba) {
+			low = mid;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	return &fat->extent[low];
+}
+
+/** @brief @internal find the owner extent that contains an LBA
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a compacted fat structure
+ *
+ * @param[in] lba
+ *    The LBA to search for
+ *
+ * @return
+ *    pointer to the owner extent that contains the LBA
+ */
+static
+const cbmimage_fat_owner_extent *
+cbmimage_i_fat_find_owner_extent(
+		const cbmimage_fat * fat,
+		uint16_t             lba
+		)
+{
+	size_t low  = 0;
+	size_t high = fat->owner_extent_count;
+
+	while (high - low > 1) {
+		size_t mid = low + (high - low) / 2;
+
+		if (fat->owner_extent[mid].start <= lba) {
+			low = mid;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	return &fat->owner_extent[low];
+}
+
+/** @brief @internal get the target of an LBA in the FAT
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @param[in] lba
+ *    The LBA to be examined
+ *
+ * @return
+ *    The target LBA as written in the FAT, including the special values
+ *    CBMIMAGE_FAT_UNUSED and CBMIMAGE_FAT_LASTBLOCK.
+ *
+ * @remark
+ *   - This works for the dense as well as for the compacted representation.
  */
-#define CBMIMAGE_FAT_LASTBLOCK 0xFFFFu
+uint16_t
+cbmimage_i_fat_get_lba(
+		const cbmimage_fat * fat,
+		uint16_t             lba
+		)
+{
+	assert(fat != NULL);
+	assert(lba < fat->elements);
 
-/** @brief @internal mark for an unused block in a FAT
+	if (fat->entry) {
+		return fat->entry[lba].lba;
+	}
+
+	const cbmimage_fat_extent * extent = cbmimage_i_fat_find_extent(fat, lba);
+
+	return (uint16_t) (extent->target + (lba - extent->start) * extent->step);
+}
+
+/** @brief @internal get the owner of an LBA in the FAT
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @param[in] lba
+ *    The LBA to be examined
+ *
+ * @return
+ *    The owner of the LBA
+ *
+ * @remark
+ *   - This works for the dense as well as for the compacted representation.
  */
-#define CBMIMAGE_FAT_UNUSED    0x0000u
+cbmimage_block_owner
+cbmimage_i_fat_get_owner_lba(
+		const cbmimage_fat * fat,
+		uint16_t             lba
+		)
+{
+	assert(fat != NULL);
+	assert(lba < fat->elements);
+
+	if (fat->owner) {
+		return fat->owner[lba];
+	}
+
+	return cbmimage_i_fat_find_owner_extent(fat, lba)->owner;
+}
+
+/** @brief @internal convert a compacted FAT back into the dense representation
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @return
+ *    - 0 if everything is ok
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *  - If the FAT is already dense, nothing is done.
+ *  - This is called before every modification of the FAT, as the
+ *    extents cannot be modified in place.
+ */
+static
+int
+cbmimage_i_fat_make_dense(
+		cbmimage_fat * fat
+		)
+{
+	assert(fat != NULL);
+
+	if (fat->entry != NULL) {
+		return 0;
+	}
+
+	if (cbmimage_i_fat_alloc_dense(fat)) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < fat->extent_count; ++i) {
+		const cbmimage_fat_extent * extent = &fat->extent[i];
+
+		for (uint16_t j = 0; j < extent->count; ++j) {
+			fat->entry[extent->start + j].lba = (uint16_t) (extent->target + j * extent->step);
+		}
+	}
+
+	for (size_t i = 0; i < fat->owner_extent_count; ++i) {
+		const cbmimage_fat_owner_extent * extent = &fat->owner_extent[i];
+
+		for (uint16_t j = 0; j < extent->count; ++j) {
+			fat->owner[extent->start + j] = extent->owner;
+		}
+	}
+
+	cbmimage_i_fat_free_extents(fat);
+
+	return 0;
+}
+
+/** @brief @internal get a bitmap of the used blocks of the FAT
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @param[out] used_map
+ *    pointer to an array of word_count words. On return, bit (lba % 64) of
+ *    word (lba / 64) is set if lba is used in the FAT.
+ *
+ * @param[in] word_count
+ *    the number of words in used_map. LBAs that do not fit are ignored.
+ *
+ * @remark
+ *   - The dense entries or the extents are walked once, linearly; thus,
+ *     the extents do not have to be searched for every LBA.
+ */
+void
+cbmimage_i_fat_get_used_map(
+		const cbmimage_fat * fat,
+		uint64_t *           used_map,
+		size_t               word_count
+		)
+{
+	assert(fat != NULL);
+	assert(used_map != NULL);
+
+	memset(used_map, 0, word_count * sizeof *used_map);
+
+	size_t lba_count = fat->elements < word_count * 64 ? fat->elements : word_count * 64;
+
+	if (fat->entry) {
+		for (size_t lba = 0; lba < lba_count; ++lba) {
+			if (fat->entry[lba].lba != CBMIMAGE_FAT_UNUSED) {
+				used_map[lba / 64] |= 1ull << (lba % 64);
+			}
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < fat->extent_count; ++i) {
+		const cbmimage_fat_extent * extent = &fat->extent[i];
+
+		for (size_t j = 0; j < extent->count && extent->start + j < lba_count; ++j) {
+			size_t lba = extent->start + j;
+
+			if ((uint16_t) (extent->target + j * extent->step) != CBMIMAGE_FAT_UNUSED) {
+				used_map[lba / 64] |= 1ull << (lba % 64);
+			}
+		}
+	}
+}
 
 /** @brief create a FAT structure
  * @ingroup cbmimage_fat
@@ -45,12 +335,16 @@ cbmimage_fat_create(
 
 	size_t elements = cbmimage_get_max_lba(settings->image) + 1;
 
-	cbmimage_fat * fat = cbmimage_i_xalloc(sizeof * fat + elements * sizeof(fat->entry[0]) );
+	cbmimage_fat * fat = cbmimage_i_xalloc(sizeof * fat);
 
 	if (fat != NULL) {
 		fat->image = image;
-		fat->entry = (cbmimage_fat_entry *) &fat->bufferarray[0];
 		fat->elements = elements;
+
+		if (cbmimage_i_fat_alloc_dense(fat)) {
+			cbmimage_i_xfree(fat);
+			fat = NULL;
+		}
 	}
 
 	return fat;
@@ -67,9 +361,183 @@ cbmimage_fat_close(
 		cbmimage_fat * fat
 		)
 {
+	if (fat) {
+		cbmimage_i_xfree(fat->owner);
+		cbmimage_i_fat_free_extents(fat);
+	}
 	cbmimage_i_xfree(fat);
 }
 
+/** @brief @internal build the extents of a dense FAT
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a dense fat structure
+ *
+ * @param[out] extent_buffer
+ *    pointer to the array that gets the extents. \n
+ *    If this is NULL, the extents are only counted.
+ *
+ * @return
+ *    the number of extents
+ */
+static
+size_t
+cbmimage_i_fat_build_extents(
+		const cbmimage_fat *  fat,
+		cbmimage_fat_extent * extent_buffer
+		)
+{
+	size_t extent_count = 1;
+
+	cbmimage_fat_extent extent = { .start = 0, .count = 1, .target = fat->entry[0].lba, .step = 0 };
+
+	for (size_t i = 1; i < fat->elements; ++i) {
+		uint16_t lba = fat->entry[i].lba;
+
+		if (extent.count < UINT16_MAX) {
+			if (extent.count == 1) {
+				if (lba == extent.target) {
+					extent.step = 0;
+					++extent.count;
+					continue;
+				}
+				else if ( lba == (uint16_t) (extent.target + 1)
+				       && extent.target != CBMIMAGE_FAT_UNUSED
+				       && extent.target != CBMIMAGE_FAT_LASTBLOCK
+				        )
+				{
+					extent.step = 1;
+					++extent.count;
+					continue;
+				}
+			}
+			else if (lba == (uint16_t) (extent.target + extent.count * extent.step)) {
+				++extent.count;
+				continue;
+			}
+		}
+
+		if (extent_buffer) {
+			extent_buffer[extent_count - 1] = extent;
+		}
+
+		++extent_count;
+
+		extent.start  = i;
+		extent.count  = 1;
+		extent.target = lba;
+		extent.step   = 0;
+	}
+
+	if (extent_buffer) {
+		extent_buffer[extent_count - 1] = extent;
+	}
+
+	return extent_count;
+}
+
+/** @brief compact a FAT structure into extents
+ * @ingroup cbmimage_fat
+ *
+ * The FAT is converted into runs of consecutive LBAs (cf. cbmimage_fat_extent
+ * and cbmimage_fat_owner_extent). As files are mostly written with a regular
+ * interleave, this needs much less memory than one entry per LBA.
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @return
+ *    - 0 if the FAT has been compacted
+ *    - 1 if the FAT stays dense, as the extents would not be smaller
+ *    - -1 if an error occurred
+ *
+ * @remark
+ *  - All functions accessing the FAT work on both representations.
+ *  - As soon as the FAT is modified, it is automatically converted back
+ *    into the dense representation.
+ */
+int
+cbmimage_fat_compact(
+		cbmimage_fat * fat
+		)
+{
+	assert(fat != NULL);
+
+	if (fat->entry == NULL) {
+		// already compacted
+		return 0;
+	}
+
+	// first pass: count the extents that are needed
+	size_t extent_count = cbmimage_i_fat_build_extents(fat, NULL);
+	size_t owner_extent_count = 1;
+	size_t owner_extent_length = 1;
+
+	for (size_t i = 1; i < fat->elements; ++i) {
+		if ( fat->owner[i].type != fat->owner[i - 1].type
+		  || fat->owner[i].dir_index != fat->owner[i - 1].dir_index
+		  || owner_extent_length == UINT16_MAX
+		   )
+		{
+			++owner_extent_count;
+			owner_extent_length = 0;
+		}
+		++owner_extent_length;
+	}
+
+	size_t size_dense   = fat->elements * (sizeof(fat->owner[0]) + sizeof(fat->entry[0]));
+	size_t size_extents = extent_count * sizeof(fat->extent[0]) + owner_extent_count * sizeof(fat->owner_extent[0]);
+
+	if (size_extents >= size_dense) {
+		return 1;
+	}
+
+	fat->extent       = cbmimage_i_xalloc(extent_count * sizeof(fat->extent[0]));
+	fat->owner_extent = cbmimage_i_xalloc(owner_extent_count * sizeof(fat->owner_extent[0]));
+
+	if (fat->extent == NULL || fat->owner_extent == NULL) {
+		cbmimage_i_fat_free_extents(fat);
+		return -1;
+	}
+
+	// second pass: fill the extents
+	fat->extent_count = cbmimage_i_fat_build_extents(fat, fat->extent);
+
+	cbmimage_fat_owner_extent * owner_extent = &fat->owner_extent[0];
+
+	owner_extent->start = 0;
+	owner_extent->count = 1;
+	owner_extent->owner = fat->owner[0];
+
+	for (size_t i = 1; i < fat->elements; ++i) {
+		if ( fat->owner[i].type == owner_extent->owner.type
+		  && fat->owner[i].dir_index == owner_extent->owner.dir_index
+		  && owner_extent->count < UINT16_MAX
+		   )
+		{
+			++owner_extent->count;
+		}
+		else {
+			++owner_extent;
+			owner_extent->start = i;
+			owner_extent->count = 1;
+			owner_extent->owner = fat->owner[i];
+		}
+	}
+
+	fat->owner_extent_count = owner_extent - &fat->owner_extent[0] + 1;
+
+	assert(fat->extent_count == extent_count);
+	assert(fat->owner_extent_count == owner_extent_count);
+
+	cbmimage_i_xfree(fat->owner);
+	fat->owner = NULL;
+	fat->entry = NULL;
+
+	return 0;
+}
+
 
 /** @brief @internal set a FAT block to a specific LBA target
  * @ingroup cbmimage_fat
@@ -112,6 +580,10 @@ cbmimage_i_fat_set(
 			target_lba);
 #endif
 
+	if (cbmimage_i_fat_make_dense(fat)) {
+		return -1;
+	}
+
 	fat->entry[block.lba].lba = target_lba;
 
 	return 0;
@@ -157,6 +629,81 @@ cbmimage_fat_set(
 	return cbmimage_i_fat_set(fat, block, lba);
 }
 
+/** @brief claim a block in the FAT for an owner
+ * @ingroup cbmimage_fat
+ *
+ * This function combines cbmimage_fat_is_used(), cbmimage_fat_set_owner()
+ * and cbmimage_fat_set() into one compare-and-set like operation: \n
+ * If the block is not used yet, it is claimed by the given owner. \n
+ * If it is already used, the previous owner is kept and reported back.
+ * This way, cross-links are detected at the time a block is claimed.
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @param[in] block
+ *    The address of the block that is to be claimed
+ *
+ * @param[in] target
+ *    The target to which the block links to
+ *
+ * @param[in] owner
+ *    The owner that claims the block
+ *
+ * @param[out] owner_previous
+ *    pointer to a cbmimage_block_owner. If the block was already claimed,
+ *    it will contain the owner that claimed it before. \n
+ *    Can be NULL; in this case, nothing will be returned.
+ *
+ * @return
+ *    - 0 if the block was unused and is now claimed by owner
+ *    - 1 if the block was already claimed before
+ *    - -1 if an error occurred (block or target out of range, or no memory)
+ *
+ * @remark
+ *   - If no error occurred, the link of the block is set to target.
+ */
+int
+cbmimage_fat_claim(
+		cbmimage_fat *         fat,
+		cbmimage_blockaddress  block,
+		cbmimage_blockaddress  target,
+		cbmimage_block_owner   owner,
+		cbmimage_block_owner * owner_previous
+		)
+{
+	int ret = 0;
+
+	assert(fat != NULL);
+	assert(block.lba < fat->elements);
+	assert(target.lba < fat->elements);
+
+	if (block.lba >= fat->elements || target.lba >= fat->elements) {
+		return -1;
+	}
+
+	if (cbmimage_i_fat_make_dense(fat)) {
+		return -1;
+	}
+
+	cbmimage_fat_entry *   entry       = &fat->entry[block.lba];
+	cbmimage_block_owner * entry_owner = &fat->owner[block.lba];
+
+	if (entry->lba != CBMIMAGE_FAT_UNUSED) {
+		if (owner_previous) {
+			*owner_previous = *entry_owner;
+		}
+		ret = 1;
+	}
+	else {
+		*entry_owner = owner;
+	}
+
+	entry->lba = (target.lba == 0) ? CBMIMAGE_FAT_LASTBLOCK : target.lba;
+
+	return ret;
+}
+
 /** @brief set a block in the FAT to unused
  * @ingroup cbmimage_fat
  *
@@ -169,6 +716,9 @@ cbmimage_fat_set(
  * @return
  *    - 0 if everything is ok
  *    - != 0 if an error occurred
+ *
+ * @remark
+ *    - The owner of the block is reset, too.
  */
 int
 cbmimage_fat_clear(
@@ -181,6 +731,10 @@ cbmimage_fat_clear(
 			block.ts.track, block.ts.sector, block.lba);
 #endif
 
+	cbmimage_block_owner owner_none = { .type = BLOCK_OWNER_NONE, .dir_index = 0 };
+
+	cbmimage_fat_set_owner(fat, block, owner_none);
+
 	return cbmimage_i_fat_set(fat, block, CBMIMAGE_FAT_UNUSED);
 }
 
@@ -212,7 +766,7 @@ cbmimage_i_fat_get_target_lba(
 
 	assert(block.lba < fat->elements);
 
-	return fat->entry[block.lba].lba;
+	return cbmimage_i_fat_get_lba(fat, block.lba);
 }
 
 /** @brief get the target of a block in the FAT
@@ -235,7 +789,7 @@ cbmimage_fat_get(
 		cbmimage_blockaddress block
 		)
 {
-	int lba = cbmimage_i_fat_get_target_lba(fat, block) != CBMIMAGE_FAT_UNUSED;
+	uint16_t lba = cbmimage_i_fat_get_target_lba(fat, block);
 
 	cbmimage_blockaddress target = cbmimage_block_unused;
 
@@ -249,7 +803,7 @@ cbmimage_fat_get(
 			break;
 
 		default:
-			CBMIMAGE_BLOCK_SET_FROM_LBA(fat->image, block, lba);
+			CBMIMAGE_BLOCK_SET_FROM_LBA(fat->image, target, lba);
 			break;
 	}
 
@@ -279,6 +833,346 @@ cbmimage_fat_is_used(
 }
 
 
+/** @brief @internal get the LBA a block links to
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] link
+ *    pointer to the link (track and sector) at the beginning of a block
+ *
+ * @return
+ *    - the LBA of the block the link points to
+ *    - CBMIMAGE_FAT_LASTBLOCK if this is the last block of a chain, or if
+ *      the link points to a block that does not exist.
+ */
+static
+uint16_t
+cbmimage_i_fat_get_link_lba(
+		cbmimage_fileimage * image,
+		const uint8_t *      link
+		)
+{
+	cbmimage_blockaddress block;
+
+	if (!cbmimage_blockaddress_ts_exists(image, link[0], link[1])) {
+		return CBMIMAGE_FAT_LASTBLOCK;
+	}
+
+	cbmimage_blockaddress_init_from_ts_value(image, &block, link[0], link[1]);
+
+	return block.lba;
+}
+
+/** @brief @internal update the FAT after the link of a block has changed
+ * @ingroup cbmimage_fat
+ *
+ * This function is called after a block was written. If the block is part
+ * of a chain in the FAT and the link at the beginning of the block changed,
+ * the FAT is updated incrementally:
+ * - the blocks that are now reachable through the new link, and that were
+ *   unused before, are added to the FAT with the owner of the block.
+ * - the blocks that were reachable through the old link only are removed
+ *   from the FAT.
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @param[in] block
+ *    The address of the block that has been written
+ *
+ * @param[in] link_old
+ *    pointer to the link (track and sector) that the block had
+ *    before it was written
+ *
+ * @return
+ *    - 0 if everything is ok
+ *    - 1 if the new link leads into the blocks of another owner, that is,
+ *      the chain is cross-linked now. The blocks up to the cross-link are
+ *      added to the FAT; the blocks of the other owner keep their owner.
+ *    - 2 if the FAT entry of the block does not correspond to the old link.
+ *      In this case, the FAT is not changed.
+ *    - -1 if an error occurred
+ *
+ * @remark
+ *   - The cross-link and the mismatch of the FAT entry are reported
+ *     with an output, as cbmimage_validate() does.
+ *   - The FAT entry of a block does not correspond to its old link if it
+ *     was not created from the link (for example, for a partition or for
+ *     reserved blocks).
+ */
+int
+cbmimage_i_fat_update_link(
+		cbmimage_fat *        fat,
+		cbmimage_blockaddress block,
+		const uint8_t *       link_old
+		)
+{
+	assert(fat != NULL);
+	assert(link_old != NULL);
+
+	cbmimage_fileimage * image = fat->image;
+
+	if (block.lba >= fat->elements || cbmimage_i_fat_get_lba(fat, block.lba) == CBMIMAGE_FAT_UNUSED) {
+		// this block is not part of any chain, nothing to do
+		return 0;
+	}
+
+	const uint8_t * data = cbmimage_i_get_address_of_block(image, block);
+	if (data == NULL) {
+		return -1;
+	}
+
+	uint16_t lba_old = cbmimage_i_fat_get_link_lba(image, link_old);
+	uint16_t lba_new = cbmimage_i_fat_get_link_lba(image, data);
+
+	if (lba_old == lba_new) {
+		return 0;
+	}
+
+	if (cbmimage_i_fat_get_lba(fat, block.lba) != lba_old) {
+		cbmimage_i_fmt_print("====> The FAT entry of %u/%u(%03X) does not match its old link, the FAT is not updated.\n",
+				block.ts.track, block.ts.sector, block.lba);
+		return 2;
+	}
+
+	if (cbmimage_i_fat_make_dense(fat)) {
+		return -1;
+	}
+
+#if CBMIMAGE_FAT_DEBUG
+	cbmimage_i_fmt_print("Updating FAT link of %u/%u(%03X) from %03X to %03X.\n",
+			block.ts.track, block.ts.sector, block.lba,
+			lba_old, lba_new);
+#endif
+
+	int ret = 0;
+
+	cbmimage_block_owner owner = fat->owner[block.lba];
+
+	fat->entry[block.lba].lba = lba_new;
+
+	cbmimage_loop * new_chain = cbmimage_loop_create(image);
+	if (new_chain == NULL) {
+		return -1;
+	}
+	cbmimage_loop_mark(new_chain, block);
+
+	// add the blocks that are reachable through the new link
+	cbmimage_blockaddress block_current;
+
+	for (uint16_t lba = lba_new; lba != CBMIMAGE_FAT_LASTBLOCK; lba = fat->entry[lba].lba) {
+		CBMIMAGE_BLOCK_SET_FROM_LBA(image, block_current, lba);
+
+		if (cbmimage_loop_check(new_chain, block_current)) {
+			break;
+		}
+		cbmimage_loop_mark(new_chain, block_current);
+
+		if (fat->entry[lba].lba == CBMIMAGE_FAT_UNUSED) {
+			const uint8_t * data_current = cbmimage_i_get_address_of_block(image, block_current);
+			if (data_current == NULL) {
+				break;
+			}
+			fat->owner[lba] = owner;
+			fat->entry[lba].lba = cbmimage_i_fat_get_link_lba(image, data_current);
+		}
+		else if ( (fat->owner[lba].type != owner.type)
+		       || (fat->owner[lba].dir_index != owner.dir_index)
+		        )
+		{
+			// we reached a block of another owner: we are cross-linked
+			char owner_old[32];
+			char owner_new[32];
+
+			cbmimage_i_fmt_print("====> Marking already marked block following from %u/%u(%03X) at %u/%u(%03X): owned by %s, claimed by %s.\n",
+					block.ts.track, block.ts.sector, block.lba,
+					block_current.ts.track, block_current.ts.sector, block_current.lba,
+					cbmimage_fat_owner_format(fat->owner[lba], owner_old, sizeof owner_old),
+					cbmimage_fat_owner_format(owner, owner_new, sizeof owner_new));
+			ret = 1;
+			break;
+		}
+	}
+
+	// remove the blocks that were only reachable through the old link
+	for (uint16_t lba = lba_old; lba != CBMIMAGE_FAT_LASTBLOCK && lba != CBMIMAGE_FAT_UNUSED; ) {
+		CBMIMAGE_BLOCK_SET_FROM_LBA(image, block_current, lba);
+
+		if ( cbmimage_loop_check(new_chain, block_current)
+		  || (fat->owner[lba].type != owner.type)
+		  || (fat->owner[lba].dir_index != owner.dir_index)
+		   )
+		{
+			break;
+		}
+
+		uint16_t lba_next = fat->entry[lba].lba;
+
+		cbmimage_fat_clear(fat, block_current);
+
+		lba = lba_next;
+	}
+
+	cbmimage_loop_close(new_chain);
+
+	return ret;
+}
+
+/** @brief set the owner of a block in the FAT
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @param[in] block
+ *    The address of the block of which the owner is set
+ *
+ * @param[in] owner
+ *    The owner of this block
+ *
+ * @return
+ *    - 0 if everything is ok
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *   - The owner is independent of the link stored with cbmimage_fat_set().
+ *     Thus, it is possible to set the owner before or after setting the link.
+ */
+int
+cbmimage_fat_set_owner(
+		cbmimage_fat *        fat,
+		cbmimage_blockaddress block,
+		cbmimage_block_owner  owner
+		)
+{
+	assert(fat != NULL);
+
+	assert(block.lba < fat->elements);
+	assert(owner.type < BLOCK_OWNER_LAST);
+
+	if (block.lba >= fat->elements || owner.type >= BLOCK_OWNER_LAST) {
+		return -1;
+	}
+
+	if (cbmimage_i_fat_make_dense(fat)) {
+		return -1;
+	}
+
+	fat->owner[block.lba] = owner;
+
+	return 0;
+}
+
+/** @brief get the owner of a block in the FAT
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @param[in] block
+ *    The address of the block to be examined
+ *
+ * @return
+ *    The owner of the block. \n
+ *    If the block is not used (or it does not exist), the type of the owner
+ *    is BLOCK_OWNER_NONE.
+ */
+cbmimage_block_owner
+cbmimage_fat_get_owner(
+		cbmimage_fat *        fat,
+		cbmimage_blockaddress block
+		)
+{
+	cbmimage_block_owner owner = { .type = BLOCK_OWNER_NONE, .dir_index = 0 };
+
+	assert(fat != NULL);
+
+	if (block.lba < fat->elements) {
+		owner = cbmimage_i_fat_get_owner_lba(fat, block.lba);
+	}
+
+	return owner;
+}
+
+/** @brief get a user readable name for an owner type
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] type
+ *    The owner type for which to get the name
+ *
+ * @return
+ *    pointer to a (static) string that names the owner type
+ */
+const char *
+cbmimage_fat_owner_type_name(
+		cbmimage_block_owner_type type
+		)
+{
+	static const char * owner_type_names[BLOCK_OWNER_LAST] = {
+		"unused",         // BLOCK_OWNER_NONE
+		"file",           // BLOCK_OWNER_FILE
+		"side-sector",    // BLOCK_OWNER_SIDESECTOR
+		"GEOS info",      // BLOCK_OWNER_GEOS_INFO
+		"info",           // BLOCK_OWNER_INFO
+		"BAM",            // BLOCK_OWNER_BAM
+		"directory",      // BLOCK_OWNER_DIRECTORY
+		"GEOS border",    // BLOCK_OWNER_GEOS_BORDER
+		"reserved",       // BLOCK_OWNER_RESERVED
+	};
+
+	if (type < BLOCK_OWNER_NONE || type >= BLOCK_OWNER_LAST) {
+		return "???";
+	}
+
+	return owner_type_names[type];
+}
+
+/** @brief format the owner of a block into a user readable text
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] owner
+ *    The owner to format
+ *
+ * @param[out] buffer
+ *    pointer to a buffer that will contain the text on termination
+ *
+ * @param[in] len
+ *    the size of the buffer pointed to by the parameter buffer
+ *
+ * @return
+ *    the pointer to the buffer
+ *
+ * @remark
+ *    - If the owner is associated with a directory entry, the index of the
+ *      directory entry is part of the output, for example "file #3".
+ */
+char *
+cbmimage_fat_owner_format(
+		cbmimage_block_owner owner,
+		char *               buffer,
+		size_t               len
+		)
+{
+	assert(buffer != NULL);
+
+	switch (owner.type) {
+		case BLOCK_OWNER_FILE:
+		case BLOCK_OWNER_SIDESECTOR:
+		case BLOCK_OWNER_GEOS_INFO:
+			snprintf(buffer, len, "%s #%u", cbmimage_fat_owner_type_name(owner.type), owner.dir_index);
+			break;
+
+		default:
+			snprintf(buffer, len, "%s", cbmimage_fat_owner_type_name(owner.type));
+			break;
+	}
+
+	return buffer;
+}
+
+
 /** @brief dump a FAT structure
  * @ingroup cbmimage_fat
  *
@@ -306,7 +1200,7 @@ cbmimage_fat_dump(
 		cbmimage_blockaddress block;
 		CBMIMAGE_BLOCK_SET_FROM_LBA(image, block, 1);
 
-		cbmimage_i_fmt_print("\n%3u (%04X): %04X ", 0, 0, fat->entry[0]);
+		cbmimage_i_fmt_print("\n%3u (%04X): %04X ", 0, 0, cbmimage_i_fat_get_lba(fat, 0));
 		int count = 0;
 		do {
 			if (block.ts.sector == 0) {
@@ -317,7 +1211,7 @@ cbmimage_fat_dump(
 				cbmimage_i_fmt_print("\n            ");
 				count = 0;
 			}
-			cbmimage_i_fmt_print("%04X ", fat->entry[block.lba]);
+			cbmimage_i_fmt_print("%04X ", cbmimage_i_fat_get_lba(fat, block.lba));
 		}
 		while (cbmimage_blockaddress_advance(image, &block) == 0);
 		cbmimage_i_print("\n");
@@ -327,8 +1221,45 @@ cbmimage_fat_dump(
 			if (i % 16 == 0) {
 				cbmimage_i_fmt_print("\n%04X: ", i);
 			}
-			cbmimage_i_fmt_print("%04X ", fat->entry[i]);
+			cbmimage_i_fmt_print("%04X ", cbmimage_i_fat_get_lba(fat, i));
 		}
 		cbmimage_i_print("\n");
 	}
 }
+
+/** @brief dump the owners of the blocks of a FAT structure
+ * @ingroup cbmimage_fat
+ *
+ * @param[in] fat
+ *    pointer to a fat structure
+ *
+ * @remark
+ *    - Only blocks that have an owner are output.
+ */
+void
+cbmimage_fat_dump_owner(
+		cbmimage_fat * fat
+		)
+{
+	assert(fat != NULL);
+
+	cbmimage_fileimage * image = fat->image;
+
+	cbmimage_i_print("Dumping block owners:\n");
+
+	cbmimage_blockaddress block;
+	CBMIMAGE_BLOCK_SET_FROM_LBA(image, block, 1);
+
+	do {
+		cbmimage_block_owner owner = cbmimage_fat_get_owner(fat, block);
+
+		if (owner.type != BLOCK_OWNER_NONE) {
+			char owner_text[32];
+
+			cbmimage_i_fmt_print("%3u/%2u (%04X): %s\n",
+					block.ts.track, block.ts.sector, block.lba,
+					cbmimage_fat_owner_format(owner, owner_text, sizeof owner_text));
+		}
+	}
+	while (cbmimage_blockaddress_advance(image, &block) == 0);
+}
@@ -16,6 +16,9 @@
 /** @brief open a file on the cbmimage where the name is known
  * @ingroup cbmimage_file
  *
+ * @param[in] image
+ *    pointer to the image data
+ *
  * @param[in] filename
  *    pointer to the file name of the file to open on the image.
  *
@@ -28,15 +31,28 @@
  *      be closed with a call to cbmimage_file_close()
  *    - If the file has been already enumated in the directory,
  *      cbmimage_file_open_by_dir_entry() will be the better choice.
+ *    - The file is looked up with cbmimage_dir_find(); thus, the name
+ *      must match exactly, and no wildcards are processed.
  */
 cbmimage_file *
 cbmimage_file_open_by_name(
-		const char * filename
+		cbmimage_fileimage * image,
+		const char *         filename
 		)
 {
-	/// @todo implement cbmimage_file_open_by_name()
-	/// @bug cbmimage_file_open_by_name() not yet implemented
-	return NULL;
+	assert(image != NULL);
+	assert(filename != NULL);
+
+	cbmimage_file * file = NULL;
+
+	cbmimage_dir_entry * dir_entry = cbmimage_dir_find(image, filename);
+
+	if (dir_entry) {
+		file = cbmimage_file_open_by_dir_entry(dir_entry);
+		cbmimage_dir_get_close(dir_entry);
+	}
+
+	return file;
 }
 
 /** @brief open a file on the cbmimage that has already een enumerated
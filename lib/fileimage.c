@@ -218,6 +218,11 @@ cbmimage_i_fileimage_create(
 		}
 
 		cbmimage_i_create_last_block(image);
+
+		if (cbmimage_i_bam_track_table_create(image->settings)) {
+			cbmimage_image_close(image);
+			image = NULL;
+		}
 	}
 
 	return image;
@@ -478,6 +483,11 @@ cbmimage_image_close(
 
 	if (settings) {
 		cbmimage_fat_close(settings->fat);
+		cbmimage_i_bam_cache_invalidate(settings);
+		cbmimage_i_dir_index_invalidate(settings);
+		cbmimage_i_dir_slots_invalidate(settings);
+		cbmimage_i_dir_header_cache_close(settings);
+		cbmimage_i_bam_track_table_close(settings);
 		cbmimage_blockaccessor_close(settings->info);
 	}
 
@@ -513,3 +523,76 @@ cbmimage_image_fat_dump(
 		cbmimage_fat_dump(settings->fat, trackformat);
 	}
 }
+
+/** @brief dump the owners of all blocks of the image
+ * @ingroup cbmimage_image
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @remark
+ *    - If there is no FAT yet, the image is validated first in order
+ *      to create it.
+ */
+void
+cbmimage_image_owner_dump(
+		cbmimage_fileimage * image
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+
+	if (!settings->fat) {
+		cbmimage_validate(image);
+	}
+	if (settings->fat) {
+		cbmimage_fat_dump_owner(settings->fat);
+	}
+}
+
+/** @brief get the owner of a block of the image
+ * @ingroup cbmimage_image
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    The address of the block to be examined
+ *
+ * @param[out] owner
+ *    pointer to a cbmimage_block_owner that will contain the owner of
+ *    the block on termination
+ *
+ * @return
+ *    - 0 on success
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *    - If there is no FAT yet, the image is validated first in order
+ *      to create it. Thus, the first call can take some time; all
+ *      subsequent calls are answered from the FAT.
+ */
+int
+cbmimage_image_get_block_owner(
+		cbmimage_fileimage *   image,
+		cbmimage_blockaddress  block,
+		cbmimage_block_owner * owner
+		)
+{
+	assert(image != NULL);
+	assert(owner != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+
+	if (!settings->fat) {
+		cbmimage_validate(image);
+	}
+	if (!settings->fat) {
+		return -1;
+	}
+
+	*owner = cbmimage_fat_get_owner(settings->fat, block);
+
+	return 0;
+}
@@ -0,0 +1,554 @@
+/** @file lib/petscii.c \n
+ * @author Spiro Trikaliotis \n
+ * \n
+ * @brief cbmimage: conversion of PETSCII names
+ *
+ * The names on an image are stored as PETSCII. These functions convert
+ * them to UTF-8 or to ASCII. The conversion is table driven: every PETSCII
+ * character is looked up in a table that contains its UTF-8 encoding or its
+ * ASCII replacement.
+ *
+ * The tables use the upper case/graphics character set, as the CBM DOS
+ * shows the directory with it. The graphic characters are mapped to the
+ * box drawing, block element and "Symbols for Legacy Computing" characters
+ * of Unicode. Control characters, and characters that have no ASCII
+ * equivalent, are converted to U+FFFD or '?', respectively.
+ *
+ * @defgroup cbmimage_petscii PETSCII conversion functions
+ */
+#include "cbmimage/internal.h"
+#include "cbmimage/alloc.h"
+
+#include <assert.h>
+#include <string.h>
+
+/** @brief @internal the UTF-8 encoding of a PETSCII character
+ * @ingroup cbmimage_petscii
+ */
+typedef
+struct cbmimage_i_petscii_utf8_char_s {
+
+	/// the number of bytes in utf8
+	uint8_t length;
+
+	/// the UTF-8 encoding; it is not NUL terminated
+	char utf8[4];
+
+} cbmimage_i_petscii_utf8_char;
+
+/** @brief @internal the UTF-8 encoding of every PETSCII character
+ * @ingroup cbmimage_petscii
+ */
+static const cbmimage_i_petscii_utf8_char cbmimage_i_petscii_utf8[256] = {
+	{ 3, "\xEF\xBF\xBD" }, // 0x00: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x01: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x02: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x03: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x04: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x05: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x06: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x07: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x08: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x09: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x0A: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x0B: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x0C: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x0D: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x0E: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x0F: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x10: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x11: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x12: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x13: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x14: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x15: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x16: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x17: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x18: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x19: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x1A: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x1B: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x1C: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x1D: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x1E: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x1F: U+FFFD
+	{ 1, "\x20" }, // 0x20: U+0020
+	{ 1, "\x21" }, // 0x21: U+0021
+	{ 1, "\x22" }, // 0x22: U+0022
+	{ 1, "\x23" }, // 0x23: U+0023
+	{ 1, "\x24" }, // 0x24: U+0024
+	{ 1, "\x25" }, // 0x25: U+0025
+	{ 1, "\x26" }, // 0x26: U+0026
+	{ 1, "\x27" }, // 0x27: U+0027
+	{ 1, "\x28" }, // 0x28: U+0028
+	{ 1, "\x29" }, // 0x29: U+0029
+	{ 1, "\x2A" }, // 0x2A: U+002A
+	{ 1, "\x2B" }, // 0x2B: U+002B
+	{ 1, "\x2C" }, // 0x2C: U+002C
+	{ 1, "\x2D" }, // 0x2D: U+002D
+	{ 1, "\x2E" }, // 0x2E: U+002E
+	{ 1, "\x2F" }, // 0x2F: U+002F
+	{ 1, "\x30" }, // 0x30: U+0030
+	{ 1, "\x31" }, // 0x31: U+0031
+	{ 1, "\x32" }, // 0x32: U+0032
+	{ 1, "\x33" }, // 0x33: U+0033
+	{ 1, "\x34" }, // 0x34: U+0034
+	{ 1, "\x35" }, // 0x35: U+0035
+	{ 1, "\x36" }, // 0x36: U+0036
+	{ 1, "\x37" }, // 0x37: U+0037
+	{ 1, "\x38" }, // 0x38: U+0038
+	{ 1, "\x39" }, // 0x39: U+0039
+	{ 1, "\x3A" }, // 0x3A: U+003A
+	{ 1, "\x3B" }, // 0x3B: U+003B
+	{ 1, "\x3C" }, // 0x3C: U+003C
+	{ 1, "\x3D" }, // 0x3D: U+003D
+	{ 1, "\x3E" }, // 0x3E: U+003E
+	{ 1, "\x3F" }, // 0x3F: U+003F
+	{ 1, "\x40" }, // 0x40: U+0040
+	{ 1, "\x41" }, // 0x41: U+0041
+	{ 1, "\x42" }, // 0x42: U+0042
+	{ 1, "\x43" }, // 0x43: U+0043
+	{ 1, "\x44" }, // 0x44: U+0044
+	{ 1, "\x45" }, // 0x45: U+0045
+	{ 1, "\x46" }, // 0x46: U+0046
+	{ 1, "\x47" }, // 0x47: U+0047
+	{ 1, "\x48" }, // 0x48: U+0048
+	{ 1, "\x49" }, // 0x49: U+0049
+	{ 1, "\x4A" }, // 0x4A: U+004A
+	{ 1, "\x4B" }, // 0x4B: U+004B
+	{ 1, "\x4C" }, // 0x4C: U+004C
+	{ 1, "\x4D" }, // 0x4D: U+004D
+	{ 1, "\x4E" }, // 0x4E: U+004E
+	{ 1, "\x4F" }, // 0x4F: U+004F
+	{ 1, "\x50" }, // 0x50: U+0050
+	{ 1, "\x51" }, // 0x51: U+0051
+	{ 1, "\x52" }, // 0x52: U+0052
+	{ 1, "\x53" }, // 0x53: U+0053
+	{ 1, "\x54" }, // 0x54: U+0054
+	{ 1, "\x55" }, // 0x55: U+0055
+	{ 1, "\x56" }, // 0x56: U+0056
+	{ 1, "\x57" }, // 0x57: U+0057
+	{ 1, "\x58" }, // 0x58: U+0058
+	{ 1, "\x59" }, // 0x59: U+0059
+	{ 1, "\x5A" }, // 0x5A: U+005A
+	{ 1, "\x5B" }, // 0x5B: U+005B
+	{ 2, "\xC2\xA3" }, // 0x5C: U+00A3
+	{ 1, "\x5D" }, // 0x5D: U+005D
+	{ 3, "\xE2\x86\x91" }, // 0x5E: U+2191
+	{ 3, "\xE2\x86\x90" }, // 0x5F: U+2190
+	{ 3, "\xE2\x94\x80" }, // 0x60: U+2500
+	{ 3, "\xE2\x99\xA0" }, // 0x61: U+2660
+	{ 4, "\xF0\x9F\xAD\xB2" }, // 0x62: U+1FB72
+	{ 4, "\xF0\x9F\xAD\xB8" }, // 0x63: U+1FB78
+	{ 4, "\xF0\x9F\xAD\xB7" }, // 0x64: U+1FB77
+	{ 4, "\xF0\x9F\xAD\xB6" }, // 0x65: U+1FB76
+	{ 4, "\xF0\x9F\xAD\xBA" }, // 0x66: U+1FB7A
+	{ 4, "\xF0\x9F\xAD\xB1" }, // 0x67: U+1FB71
+	{ 4, "\xF0\x9F\xAD\xB4" }, // 0x68: U+1FB74
+	{ 3, "\xE2\x95\xAE" }, // 0x69: U+256E
+	{ 3, "\xE2\x95\xB0" }, // 0x6A: U+2570
+	{ 3, "\xE2\x95\xAF" }, // 0x6B: U+256F
+	{ 4, "\xF0\x9F\xAD\xBC" }, // 0x6C: U+1FB7C
+	{ 3, "\xE2\x95\xB2" }, // 0x6D: U+2572
+	{ 3, "\xE2\x95\xB1" }, // 0x6E: U+2571
+	{ 4, "\xF0\x9F\xAD\xBD" }, // 0x6F: U+1FB7D
+	{ 4, "\xF0\x9F\xAD\xBE" }, // 0x70: U+1FB7E
+	{ 3, "\xE2\x97\x8F" }, // 0x71: U+25CF
+	{ 4, "\xF0\x9F\xAD\xBB" }, // 0x72: U+1FB7B
+	{ 3, "\xE2\x99\xA5" }, // 0x73: U+2665
+	{ 4, "\xF0\x9F\xAD\xB0" }, // 0x74: U+1FB70
+	{ 3, "\xE2\x95\xAD" }, // 0x75: U+256D
+	{ 3, "\xE2\x95\xB3" }, // 0x76: U+2573
+	{ 3, "\xE2\x97\x8B" }, // 0x77: U+25CB
+	{ 3, "\xE2\x99\xA3" }, // 0x78: U+2663
+	{ 4, "\xF0\x9F\xAD\xB5" }, // 0x79: U+1FB75
+	{ 3, "\xE2\x99\xA6" }, // 0x7A: U+2666
+	{ 3, "\xE2\x94\xBC" }, // 0x7B: U+253C
+	{ 4, "\xF0\x9F\xAE\x8C" }, // 0x7C: U+1FB8C
+	{ 3, "\xE2\x94\x82" }, // 0x7D: U+2502
+	{ 2, "\xCF\x80" }, // 0x7E: U+03C0
+	{ 3, "\xE2\x97\xA5" }, // 0x7F: U+25E5
+	{ 3, "\xEF\xBF\xBD" }, // 0x80: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x81: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x82: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x83: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x84: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x85: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x86: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x87: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x88: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x89: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x8A: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x8B: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x8C: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x8D: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x8E: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x8F: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x90: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x91: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x92: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x93: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x94: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x95: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x96: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x97: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x98: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x99: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x9A: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x9B: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x9C: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x9D: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x9E: U+FFFD
+	{ 3, "\xEF\xBF\xBD" }, // 0x9F: U+FFFD
+	{ 2, "\xC2\xA0" }, // 0xA0: U+00A0
+	{ 3, "\xE2\x96\x8C" }, // 0xA1: U+258C
+	{ 3, "\xE2\x96\x84" }, // 0xA2: U+2584
+	{ 3, "\xE2\x96\x94" }, // 0xA3: U+2594
+	{ 3, "\xE2\x96\x81" }, // 0xA4: U+2581
+	{ 3, "\xE2\x96\x8F" }, // 0xA5: U+258F
+	{ 3, "\xE2\x96\x92" }, // 0xA6: U+2592
+	{ 3, "\xE2\x96\x95" }, // 0xA7: U+2595
+	{ 4, "\xF0\x9F\xAE\x8F" }, // 0xA8: U+1FB8F
+	{ 3, "\xE2\x97\xA4" }, // 0xA9: U+25E4
+	{ 4, "\xF0\x9F\xAE\x87" }, // 0xAA: U+1FB87
+	{ 3, "\xE2\x94\x9C" }, // 0xAB: U+251C
+	{ 3, "\xE2\x96\x97" }, // 0xAC: U+2597
+	{ 3, "\xE2\x94\x94" }, // 0xAD: U+2514
+	{ 3, "\xE2\x94\x90" }, // 0xAE: U+2510
+	{ 3, "\xE2\x96\x82" }, // 0xAF: U+2582
+	{ 3, "\xE2\x94\x8C" }, // 0xB0: U+250C
+	{ 3, "\xE2\x94\xB4" }, // 0xB1: U+2534
+	{ 3, "\xE2\x94\xAC" }, // 0xB2: U+252C
+	{ 3, "\xE2\x94\xA4" }, // 0xB3: U+2524
+	{ 3, "\xE2\x96\x8E" }, // 0xB4: U+258E
+	{ 3, "\xE2\x96\x8D" }, // 0xB5: U+258D
+	{ 4, "\xF0\x9F\xAE\x88" }, // 0xB6: U+1FB88
+	{ 4, "\xF0\x9F\xAE\x82" }, // 0xB7: U+1FB82
+	{ 4, "\xF0\x9F\xAE\x83" }, // 0xB8: U+1FB83
+	{ 3, "\xE2\x96\x83" }, // 0xB9: U+2583
+	{ 4, "\xF0\x9F\xAD\xBF" }, // 0xBA: U+1FB7F
+	{ 3, "\xE2\x96\x96" }, // 0xBB: U+2596
+	{ 3, "\xE2\x96\x9D" }, // 0xBC: U+259D
+	{ 3, "\xE2\x94\x98" }, // 0xBD: U+2518
+	{ 3, "\xE2\x96\x98" }, // 0xBE: U+2598
+	{ 3, "\xE2\x96\x9A" }, // 0xBF: U+259A
+	{ 3, "\xE2\x94\x80" }, // 0xC0: U+2500
+	{ 3, "\xE2\x99\xA0" }, // 0xC1: U+2660
+	{ 4, "\xF0\x9F\xAD\xB2" }, // 0xC2: U+1FB72
+	{ 4, "\xF0\x9F\xAD\xB8" }, // 0xC3: U+1FB78
+	{ 4, "\xF0\x9F\xAD\xB7" }, // 0xC4: U+1FB77
+	{ 4, "\xF0\x9F\xAD\xB6" }, // 0xC5: U+1FB76
+	{ 4, "\xF0\x9F\xAD\xBA" }, // 0xC6: U+1FB7A
+	{ 4, "\xF0\x9F\xAD\xB1" }, // 0xC7: U+1FB71
+	{ 4, "\xF0\x9F\xAD\xB4" }, // 0xC8: U+1FB74
+	{ 3, "\xE2\x95\xAE" }, // 0xC9: U+256E
+	{ 3, "\xE2\x95\xB0" }, // 0xCA: U+2570
+	{ 3, "\xE2\x95\xAF" }, // 0xCB: U+256F
+	{ 4, "\xF0\x9F\xAD\xBC" }, // 0xCC: U+1FB7C
+	{ 3, "\xE2\x95\xB2" }, // 0xCD: U+2572
+	{ 3, "\xE2\x95\xB1" }, // 0xCE: U+2571
+	{ 4, "\xF0\x9F\xAD\xBD" }, // 0xCF: U+1FB7D
+	{ 4, "\xF0\x9F\xAD\xBE" }, // 0xD0: U+1FB7E
+	{ 3, "\xE2\x97\x8F" }, // 0xD1: U+25CF
+	{ 4, "\xF0\x9F\xAD\xBB" }, // 0xD2: U+1FB7B
+	{ 3, "\xE2\x99\xA5" }, // 0xD3: U+2665
+	{ 4, "\xF0\x9F\xAD\xB0" }, // 0xD4: U+1FB70
+	{ 3, "\xE2\x95\xAD" }, // 0xD5: U+256D
+	{ 3, "\xE2\x95\xB3" }, // 0xD6: U+2573
+	{ 3, "\xE2\x97\x8B" }, // 0xD7: U+25CB
+	{ 3, "\xE2\x99\xA3" }, // 0xD8: U+2663
+	{ 4, "\xF0\x9F\xAD\xB5" }, // 0xD9: U+1FB75
+	{ 3, "\xE2\x99\xA6" }, // 0xDA: U+2666
+	{ 3, "\xE2\x94\xBC" }, // 0xDB: U+253C
+	{ 4, "\xF0\x9F\xAE\x8C" }, // 0xDC: U+1FB8C
+	{ 3, "\xE2\x94\x82" }, // 0xDD: U+2502
+	{ 2, "\xCF\x80" }, // 0xDE: U+03C0
+	{ 3, "\xE2\x97\xA5" }, // 0xDF: U+25E5
+	{ 2, "\xC2\xA0" }, // 0xE0: U+00A0
+	{ 3, "\xE2\x96\x8C" }, // 0xE1: U+258C
+	{ 3, "\xE2\x96\x84" }, // 0xE2: U+2584
+	{ 3, "\xE2\x96\x94" }, // 0xE3: U+2594
+	{ 3, "\xE2\x96\x81" }, // 0xE4: U+2581
+	{ 3, "\xE2\x96\x8F" }, // 0xE5: U+258F
+	{ 3, "\xE2\x96\x92" }, // 0xE6: U+2592
+	{ 3, "\xE2\x96\x95" }, // 0xE7: U+2595
+	{ 4, "\xF0\x9F\xAE\x8F" }, // 0xE8: U+1FB8F
+	{ 3, "\xE2\x97\xA4" }, // 0xE9: U+25E4
+	{ 4, "\xF0\x9F\xAE\x87" }, // 0xEA: U+1FB87
+	{ 3, "\xE2\x94\x9C" }, // 0xEB: U+251C
+	{ 3, "\xE2\x96\x97" }, // 0xEC: U+2597
+	{ 3, "\xE2\x94\x94" }, // 0xED: U+2514
+	{ 3, "\xE2\x94\x90" }, // 0xEE: U+2510
+	{ 3, "\xE2\x96\x82" }, // 0xEF: U+2582
+	{ 3, "\xE2\x94\x8C" }, // 0xF0: U+250C
+	{ 3, "\xE2\x94\xB4" }, // 0xF1: U+2534
+	{ 3, "\xE2\x94\xAC" }, // 0xF2: U+252C
+	{ 3, "\xE2\x94\xA4" }, // 0xF3: U+2524
+	{ 3, "\xE2\x96\x8E" }, // 0xF4: U+258E
+	{ 3, "\xE2\x96\x8D" }, // 0xF5: U+258D
+	{ 4, "\xF0\x9F\xAE\x88" }, // 0xF6: U+1FB88
+	{ 4, "\xF0\x9F\xAE\x82" }, // 0xF7: U+1FB82
+	{ 4, "\xF0\x9F\xAE\x83" }, // 0xF8: U+1FB83
+	{ 3, "\xE2\x96\x83" }, // 0xF9: U+2583
+	{ 4, "\xF0\x9F\xAD\xBF" }, // 0xFA: U+1FB7F
+	{ 3, "\xE2\x96\x96" }, // 0xFB: U+2596
+	{ 3, "\xE2\x96\x9D" }, // 0xFC: U+259D
+	{ 3, "\xE2\x94\x98" }, // 0xFD: U+2518
+	{ 3, "\xE2\x96\x98" }, // 0xFE: U+2598
+	{ 2, "\xCF\x80" }, // 0xFF: U+03C0
+};
+
+/** @brief @internal the ASCII replacement of every PETSCII character
+ * @ingroup cbmimage_petscii
+ */
+static const char cbmimage_i_petscii_ascii[256] = {
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0x00
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0x10
+	' ', '!', '"', '#', '$', '%', '&', '\'', '(', ')', '*', '+', ',', '-', '.', '/', // 0x20
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', ':', ';', '<', '=', '>', '?', // 0x30
+	'@', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', // 0x40
+	'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', '[', '\\', ']', '^', '_', // 0x50
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0x60
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0x70
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0x80
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0x90
+	' ', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0xA0
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0xB0
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0xC0
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0xD0
+	' ', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0xE0
+	'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', // 0xF0
+};
+
+/** @brief @internal get the length of a converted PETSCII string
+ * @ingroup cbmimage_petscii
+ *
+ * @param[in] petscii
+ *    pointer to the PETSCII characters
+ *
+ * @param[in] length
+ *    the number of PETSCII characters
+ *
+ * @param[in] charset
+ *    the character set to convert to
+ *
+ * @return
+ *    the number of bytes of the converted string, without the trailing NUL
+ */
+static
+size_t
+cbmimage_i_petscii_converted_length(
+		const uint8_t *    petscii,
+		size_t             length,
+		cbmimage_charset   charset
+		)
+{
+	if (charset == CHARSET_ASCII) {
+		return length;
+	}
+
+	size_t converted_length = 0;
+
+	for (size_t i = 0; i < length; ++i) {
+		converted_length += cbmimage_i_petscii_utf8[petscii[i]].length;
+	}
+
+	return converted_length;
+}
+
+/** @brief @internal convert a PETSCII string
+ * @ingroup cbmimage_petscii
+ *
+ * @param[in] petscii
+ *    pointer to the PETSCII characters
+ *
+ * @param[in] length
+ *    the number of PETSCII characters
+ *
+ * @param[in] charset
+ *    the character set to convert to
+ *
+ * @param[out] buffer
+ *    the buffer for the converted string. It must be big enough for the
+ *    converted string, cf. cbmimage_i_petscii_converted_length().
+ *
+ * @return
+ *    pointer to the end of the converted string in buffer
+ *
+ * @remark
+ *    - The converted string is not NUL terminated.
+ */
+static
+char *
+cbmimage_i_petscii_convert(
+		const uint8_t *    petscii,
+		size_t             length,
+		cbmimage_charset   charset,
+		char *             buffer
+		)
+{
+	if (charset == CHARSET_ASCII) {
+		for (size_t i = 0; i < length; ++i) {
+			*buffer++ = cbmimage_i_petscii_ascii[petscii[i]];
+		}
+	}
+	else {
+		for (size_t i = 0; i < length; ++i) {
+			const cbmimage_i_petscii_utf8_char * c = &cbmimage_i_petscii_utf8[petscii[i]];
+
+			// always copy all 4 byte; the superfluous ones are overwritten by the next character
+			memcpy(buffer, c->utf8, sizeof c->utf8);
+			buffer += c->length;
+		}
+	}
+
+	return buffer;
+}
+
+/** @brief convert a PETSCII string
+ * @ingroup cbmimage_petscii
+ *
+ * @param[in] petscii
+ *    pointer to the PETSCII characters
+ *
+ * @param[in] length
+ *    the number of PETSCII characters
+ *
+ * @param[in] charset
+ *    the character set to convert to
+ *
+ * @param[out] buffer
+ *    the buffer for the converted string. Can be NULL if buffer_size is 0.
+ *
+ * @param[in] buffer_size
+ *    the size of buffer
+ *
+ * @return
+ *    the number of bytes of the complete converted string, without the
+ *    trailing NUL. \n
+ *    If this is >= buffer_size, the converted string has been truncated.
+ *
+ * @remark
+ *    - As with snprintf(), the converted string is always NUL terminated,
+ *      unless buffer_size is 0.
+ *    - A truncated string never ends with an incomplete UTF-8 sequence.
+ *    - In the worst case (UTF-8), every PETSCII character needs 4 byte.
+ */
+size_t
+cbmimage_petscii_convert(
+		const uint8_t *    petscii,
+		size_t             length,
+		cbmimage_charset   charset,
+		char *             buffer,
+		size_t             buffer_size
+		)
+{
+	assert(petscii != NULL || length == 0);
+	assert(buffer != NULL || buffer_size == 0);
+
+	size_t converted_length = cbmimage_i_petscii_converted_length(petscii, length, charset);
+
+	if (buffer_size == 0) {
+		return converted_length;
+	}
+
+	// cbmimage_i_petscii_convert() writes up to 3 byte more than the converted length
+	if (converted_length + sizeof cbmimage_i_petscii_utf8[0].utf8 <= buffer_size) {
+		*cbmimage_i_petscii_convert(petscii, length, charset, buffer) = 0;
+		return converted_length;
+	}
+
+	// near the end of the buffer, convert character by character
+	char * end = buffer + buffer_size - 1;
+
+	for (size_t i = 0; i < length; ++i) {
+		char character[sizeof cbmimage_i_petscii_utf8[0].utf8];
+		size_t character_length = cbmimage_i_petscii_convert(&petscii[i], 1, charset, character) - character;
+
+		if (character_length > (size_t) (end - buffer)) {
+			break;
+		}
+
+		memcpy(buffer, character, character_length);
+		buffer += character_length;
+	}
+
+	*buffer = 0;
+
+	return converted_length;
+}
+
+/** @brief convert the names of a directory snapshot
+ * @ingroup cbmimage_petscii
+ *
+ * @param[in] snapshot
+ *    the snapshot, as returned by cbmimage_dir_snapshot()
+ *
+ * @param[in] count
+ *    the number of entries of snapshot
+ *
+ * @param[in] charset
+ *    the character set to convert to
+ *
+ * @return
+ *    - an array of count pointers to the NUL terminated, converted names.
+ *      Element i is the name of snapshot[i].
+ *    - NULL if an error occurred, or if count is 0
+ *
+ * @remark
+ *    - The array and all the names are stored in one memory block. This
+ *      block has to be freed by cbmimage_petscii_names_close() once the
+ *      processing is done.
+ *    - Only the name itself is converted, that is, everything before the
+ *      first shifted space.
+ */
+const char **
+cbmimage_petscii_convert_snapshot_names(
+		const cbmimage_dir_snapshot_entry * snapshot,
+		size_t                              count,
+		cbmimage_charset                    charset
+		)
+{
+	if (snapshot == NULL || count == 0) {
+		return NULL;
+	}
+
+	size_t arena_size = count * sizeof (const char *);
+
+	for (size_t i = 0; i < count; ++i) {
+		arena_size += cbmimage_i_petscii_converted_length(snapshot[i].name, snapshot[i].name_end_index, charset) + 1;
+	}
+
+	// cbmimage_i_petscii_convert() writes up to 3 byte more than the converted length
+	arena_size += sizeof cbmimage_i_petscii_utf8[0].utf8;
+
+	const char ** names = cbmimage_i_xalloc(arena_size);
+
+	if (names == NULL) {
+		return NULL;
+	}
+
+	char * arena = (char *) &names[count];
+
+	for (size_t i = 0; i < count; ++i) {
+		names[i] = arena;
+		arena = cbmimage_i_petscii_convert(snapshot[i].name, snapshot[i].name_end_index, charset, arena);
+		*arena++ = 0;
+	}
+
+	return names;
+}
+
+/** @brief free the names from cbmimage_petscii_convert_snapshot_names()
+ * @ingroup cbmimage_petscii
+ *
+ * @param[in] names
+ *    the result of cbmimage_petscii_convert_snapshot_names(). Can be NULL.
+ */
+void
+cbmimage_petscii_names_close(
+		const char ** names
+		)
+{
+	cbmimage_i_xfree((void *) names);
+}
@@ -206,6 +206,11 @@ cbmimage_read_block(
  *    - If the buffersize is not big enough, that is, it is not at least
  *      cbmimage_get_bytes_in_block() byte long, this function does nothing.
  *      It does not even partially copy the data in this case!
+ *    - If there is a FAT and the link of the block changes, the FAT is
+ *      updated accordingly (cf. cbmimage_i_fat_update_link()); a new
+ *      cross-link is reported. If the block contains the BAM, the decoded
+ *      BAM is discarded. Note that this is not the case if the block
+ *      is changed through a block accessor.
  *
  */
 int
@@ -231,8 +236,20 @@ cbmimage_write_block(
 	uint8_t * block_in_buffer_to_copy = cbmimage_i_get_address_of_block(image, block);
 
 	if (buffer && buffersize >= bytes_in_block && block_in_buffer_to_copy) {
+		uint8_t link_old[2] = { block_in_buffer_to_copy[0], block_in_buffer_to_copy[1] };
+
 		memcpy(block_in_buffer_to_copy, buffer, bytes_in_block);
 		ret = 0;
+
+		cbmimage_i_bam_cache_block_written(image, block);
+		cbmimage_i_dir_index_block_written(image, block);
+		cbmimage_i_dir_slots_block_written(image, block);
+		cbmimage_i_dir_header_block_written(image, block);
+
+		if (settings->fat && (link_old[0] != block_in_buffer_to_copy[0] || link_old[1] != block_in_buffer_to_copy[1])) {
+			// the link changed: keep the FAT up to date
+			cbmimage_i_fat_update_link(settings->fat, block, link_old);
+		}
 	}
 
 	return ret;
@@ -49,19 +49,27 @@
  *    The next block/the target of the current block in this chain.
  *    This block is set as target for the current block
  *
+ * @param[in] owner
+ *    The owner of the current block. It is recorded in the FAT, and
+ *    it is used to tell which structures collide if the block is
+ *    already marked.
+ *
  * @return
  *    - 0 if there is no loop or sharing of links.
  *    - != 0 if not
  *
+ * @remark
+ *    - loop_detector can be NULL if there is no chain that can
+ *      loop (e.g., a single block or a partition).
  */
-static
 int
 cbmimage_i_mark_global_and_local(
 		cbmimage_fileimage *  image,
 		cbmimage_loop *       loop_detector,
 		cbmimage_blockaddress block_start,
 		cbmimage_blockaddress block_current,
-		cbmimage_blockaddress block_target
+		cbmimage_blockaddress block_target,
+		cbmimage_block_owner  owner
 		)
 {
 	int ret = 0;
@@ -81,17 +89,77 @@ cbmimage_i_mark_global_and_local(
 		ret = -1;
 	}
 
-	if (cbmimage_fat_is_used(image->settings->fat, block_current)) {
-		cbmimage_i_fmt_print("====> Marking already marked block following from %u/%u(%03X) at %u/%u(%03X).\n",
+	// only the first one to mark a block is its owner
+	cbmimage_block_owner owner_previous = { .type = BLOCK_OWNER_NONE, .dir_index = 0 };
+
+	int claimed = cbmimage_fat_claim(image->settings->fat, block_current, block_target, owner, &owner_previous);
+
+	if (claimed < 0) {
+		cbmimage_i_fmt_print("====> Could not mark block following from %u/%u(%03X) at %u/%u(%03X).\n",
 				block_start.ts.track, block_start.ts.sector, block_start.lba,
 				block_current.ts.track, block_current.ts.sector, block_current.lba);
 		ret = -1;
 	}
-	cbmimage_fat_set(image->settings->fat, block_current, block_target);
+	else if (claimed == 1) {
+		char owner_old[32];
+		char owner_new[32];
+
+		cbmimage_i_fmt_print("====> Marking already marked block following from %u/%u(%03X) at %u/%u(%03X): owned by %s, claimed by %s.\n",
+				block_start.ts.track, block_start.ts.sector, block_start.lba,
+				block_current.ts.track, block_current.ts.sector, block_current.lba,
+				cbmimage_fat_owner_format(owner_previous, owner_old, sizeof owner_old),
+				cbmimage_fat_owner_format(owner, owner_new, sizeof owner_new));
+		ret = -1;
+	}
 
 	return ret;
 }
 
+/** @brief @internal determine the owner of a block of a system structure
+ * @ingroup cbmimage_validate
+ *
+ * The info block, the BAM blocks and the directory blocks are often linked
+ * together in one chain. This function determines which of these structures
+ * a specific block of such a chain is.
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] block
+ *    The block of which the owner is to be determined
+ *
+ * @return
+ *    the owner of the block
+ */
+static
+cbmimage_block_owner
+cbmimage_i_validate_get_system_owner(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block
+		)
+{
+	cbmimage_image_settings * settings = image->settings;
+
+	cbmimage_block_owner owner = { .type = BLOCK_OWNER_DIRECTORY, .dir_index = 0 };
+
+	if (settings->info && settings->info->block.lba == block.lba) {
+		owner.type = BLOCK_OWNER_INFO;
+	}
+	else {
+		for (size_t i = 0; i < settings->bam_count; ++i) {
+			if ( (settings->bam[i].block.lba == block.lba)
+			  || (settings->bam_counter && settings->bam_counter[i].block.lba == block.lba)
+			   )
+			{
+				owner.type = BLOCK_OWNER_BAM;
+				break;
+			}
+		}
+	}
+
+	return owner;
+}
+
 /** @brief @internal follow a chain and check if it is consistent
  * @ingroup cbmimage_validate
  *
@@ -111,6 +179,12 @@ cbmimage_i_mark_global_and_local(
  *    followed in the chain. \n
  *    Can be NULL; in this case, nothing will be returned.
  *
+ * @param[in] owner
+ *    The owner of the blocks of this chain. \n
+ *    If the type is BLOCK_OWNER_DIRECTORY, this is a chain of system
+ *    structures; in this case, the owner of each block is determined
+ *    separately (info block, BAM or directory).
+ *
  * @return
  *    - 0 if there is no loop or sharing of links.
  *    - != 0 if not
@@ -121,7 +195,8 @@ int
 cbmimage_i_validate_follow_chain(
 		cbmimage_fileimage *  image,
 		cbmimage_blockaddress block_start,
-		size_t *              count_blocks
+		size_t *              count_blocks,
+		cbmimage_block_owner  owner
 		)
 {
 	int ret = 0;
@@ -136,7 +211,14 @@ cbmimage_i_validate_follow_chain(
 			!cbmimage_chain_is_done(chain);
 			cbmimage_chain_advance(chain))
 	{
-		if (cbmimage_i_mark_global_and_local(image, loop_detector, block_start, cbmimage_chain_get_current(chain), cbmimage_chain_get_next(chain))) {
+		cbmimage_blockaddress block_current = cbmimage_chain_get_current(chain);
+		cbmimage_block_owner owner_current = owner;
+
+		if (owner.type == BLOCK_OWNER_DIRECTORY) {
+			owner_current = cbmimage_i_validate_get_system_owner(image, block_current);
+		}
+
+		if (cbmimage_i_mark_global_and_local(image, loop_detector, block_start, block_current, cbmimage_chain_get_next(chain), owner_current)) {
 			ret = -1;
 		}
 		++count;
@@ -172,6 +254,9 @@ cbmimage_i_validate_follow_chain(
  * @param[in] count
  *    The count of blocks that are occupied by this partition
  *
+ * @param[in] owner
+ *    The owner of the blocks of this partition
+ *
  * @return
  *    - 0 if everything is ok
  *    - != 0 if not
@@ -181,7 +266,8 @@ int
 cbmimage_i_validate_1581_partition(
 		cbmimage_fileimage *  image,
 		cbmimage_blockaddress block_start,
-		int                   count
+		int                   count,
+		cbmimage_block_owner  owner
 		)
 {
 	int ret = 0;
@@ -194,7 +280,7 @@ cbmimage_i_validate_1581_partition(
 			block_next = cbmimage_block_unused;
 		}
 
-		if (cbmimage_i_mark_global_and_local(image, NULL, block_start, block_current, block_next)) {
+		if (cbmimage_i_mark_global_and_local(image, NULL, block_start, block_current, block_next, owner)) {
 			ret = -1;
 		}
 
@@ -223,9 +309,9 @@ cbmimage_i_validate_1581_partition(
  *    - != 0 if not
  *
  * @remark
- *    - this function goes through all blocks and tests if the BAM is free and
- *      not marked in the loop detector, or not free and marked in the loop
- *      detector. If there is an unequality, it reports an error.
+ *    - this function compares the BAM and the FAT (cf. cbmimage_bam_compare_fat())
+ *      and reports every block that is free in the BAM and marked in the loop
+ *      detector, or not free in the BAM and not marked in the loop detector.
  */
 static
 int
@@ -235,25 +321,13 @@ cbmimage_i_bam_check_equality(
 {
 	int ret = 0;
 
-	cbmimage_blockaddress block;
-
-	cbmimage_blockaddress_init_from_ts_value(image, &block, 1, 0);
-
-	do {
-		int is_marked_in_loop = cbmimage_fat_is_used(image->settings->fat, block);
-		int is_used_in_bam = cbmimage_bam_get(image, block) == BAM_USED;
+	cbmimage_bam_mismatch * mismatches = NULL;
+	size_t                  mismatch_count = 0;
 
-		cbmimage_BAM_state bam_state = cbmimage_bam_get(image, block);
-
-		if (is_marked_in_loop && !is_used_in_bam) {
-			cbmimage_i_fmt_print("Block %u/%u(%03X) is marked as used, but the BAM tells us it is empty.\n",
-					block.ts.track, block.ts.sector, block.lba);
-		}
-		else if (!is_marked_in_loop && is_used_in_bam) {
-			cbmimage_i_fmt_print("Block %u/%u(%03X) is not marked as used, but the BAM tells us it is used.\n",
-					block.ts.track, block.ts.sector, block.lba);
-		}
-	} while (!cbmimage_blockaddress_advance(image, &block));
+	if (cbmimage_bam_compare_fat(image, &mismatches, &mismatch_count) == 0) {
+		cbmimage_bam_mismatch_print(image, mismatches, mismatch_count);
+		cbmimage_bam_mismatch_close(mismatches);
+	}
 
 	return ret;
 }
@@ -562,6 +636,9 @@ cbmimage_i_validate_sidesector_chain(
  * @param[in] dir_entry
  *    The directory entry of this file
  *
+ * @param[in] dir_index
+ *    The index of the directory entry of this file
+ *
  * @param[inout] count_blocks
  *    Pointer to a variable. On return, this function will add the number of blocks it
  *    followed in the chain. \n
@@ -577,12 +654,15 @@ int
 cbmimage_i_validate_rel_file(
 		cbmimage_fileimage * image,
 		cbmimage_dir_entry * dir_entry,
+		uint16_t             dir_index,
 		size_t *             count_blocks
 		)
 {
 	int ret = 0;
 	size_t block_count = 0;
 
+	cbmimage_block_owner owner = { .type = BLOCK_OWNER_SIDESECTOR, .dir_index = dir_index };
+
 	assert(image != NULL);
 	assert(dir_entry != NULL);
 
@@ -605,7 +685,7 @@ cbmimage_i_validate_rel_file(
 
 		chain_super_sidesector = cbmimage_chain_start(image, block_super_sidesector);
 
-		if (cbmimage_i_mark_global_and_local(image, NULL, block_super_sidesector, block_super_sidesector, cbmimage_chain_get_next(chain_super_sidesector))) {
+		if (cbmimage_i_mark_global_and_local(image, NULL, block_super_sidesector, block_super_sidesector, cbmimage_chain_get_next(chain_super_sidesector), owner)) {
 			ret = -1;
 		}
 
@@ -637,7 +717,7 @@ cbmimage_i_validate_rel_file(
 	{
 		++block_count;
 
-		if (cbmimage_i_mark_global_and_local(image, loop_detector, dir_entry->rel_sidesector_block, cbmimage_chain_get_current(chain_sidesector), cbmimage_chain_get_next(chain_sidesector))) {
+		if (cbmimage_i_mark_global_and_local(image, loop_detector, dir_entry->rel_sidesector_block, cbmimage_chain_get_current(chain_sidesector), cbmimage_chain_get_next(chain_sidesector), owner)) {
 			ret = -1;
 		}
 
@@ -721,6 +801,9 @@ cbmimage_i_validate_rel_file(
  * @param[in] dir_entry
  *    The directory entry of this file
  *
+ * @param[in] dir_index
+ *    The index of the directory entry of this file
+ *
  * @param[inout] count_blocks
  *    Pointer to a variable. On return, this function will add the number of blocks it
  *    followed in the chain. \n
@@ -736,6 +819,7 @@ int
 cbmimage_i_validate_geos_file(
 		cbmimage_fileimage * image,
 		cbmimage_dir_entry * dir_entry,
+		uint16_t             dir_index,
 		size_t *             count_blocks
 		)
 {
@@ -767,7 +851,8 @@ cbmimage_i_validate_geos_file(
 
 					cbmimage_blockaddress block_record;
 					CBMIMAGE_BLOCK_SET_FROM_TS(image, block_record, track, sector);
-					ret = cbmimage_i_validate_follow_chain(image, block_record, &block_count) | ret;
+					cbmimage_block_owner owner = { .type = BLOCK_OWNER_FILE, .dir_index = dir_index };
+					ret = cbmimage_i_validate_follow_chain(image, block_record, &block_count, owner) | ret;
 				}
 				for (i; i < 0x100; i += 2) {
 					uint8_t track = recordblock_data[i];
@@ -788,7 +873,8 @@ cbmimage_i_validate_geos_file(
 
 		if (dir_entry->geos_infoblock.lba > 0) {
 			cbmimage_blockaddress block_info = dir_entry->geos_infoblock;
-			if (cbmimage_i_mark_global_and_local(image, NULL, block_info, block_info, cbmimage_block_unused)) {
+			cbmimage_block_owner owner = { .type = BLOCK_OWNER_GEOS_INFO, .dir_index = dir_index };
+			if (cbmimage_i_mark_global_and_local(image, NULL, block_info, block_info, cbmimage_block_unused, owner)) {
 				ret = -1;
 			}
 			++block_count;
@@ -815,6 +901,10 @@ cbmimage_i_validate_geos_file(
  * @param[in] dir_entry
  *   pointer to the directory entry of the file to validate
  *
+ * @param[in] dir_index
+ *   the index of the directory entry of the file to validate. \n
+ *   This is recorded as owner of the blocks of this file.
+ *
  * @return
  *    - 0 if the file is consistent
  *    - != 0 if not
@@ -831,7 +921,8 @@ cbmimage_i_validate_geos_file(
 int
 cbmimage_i_validate_process_file(
 		cbmimage_fileimage * image,
-		cbmimage_dir_entry * dir_entry
+		cbmimage_dir_entry * dir_entry,
+		uint16_t             dir_index
 		)
 {
 	assert(image != NULL);
@@ -840,6 +931,8 @@ cbmimage_i_validate_process_file(
 	int ret = 0;
 	size_t block_count = 0;
 
+	cbmimage_block_owner owner = { .type = BLOCK_OWNER_FILE, .dir_index = dir_index };
+
 #if CBMIMAGE_VALIDATE_DEBUG
 	{
 		char name_buffer[26];
@@ -858,7 +951,7 @@ cbmimage_i_validate_process_file(
 			// There is no special meaning in the blocks, just mark the number of
 			// blocks as specified in the dir_entry, as used. Especially, do *not*
 			// follow the chain!
-			ret = cbmimage_i_validate_1581_partition(image, dir_entry->start_block, dir_entry->block_count) || ret;
+			ret = cbmimage_i_validate_1581_partition(image, dir_entry->start_block, dir_entry->block_count, owner) || ret;
 
 			// as we cannot count the number of blocks other than what we are given, accept it.
 			block_count = dir_entry->block_count;
@@ -870,17 +963,17 @@ cbmimage_i_validate_process_file(
 			break;
 
 		default:
-			ret = cbmimage_i_validate_follow_chain(image, dir_entry->start_block, &block_count) || ret;
+			ret = cbmimage_i_validate_follow_chain(image, dir_entry->start_block, &block_count, owner) || ret;
 			break;
 	}
 
 	if (dir_entry->type == DIR_TYPE_REL) {
 		// this is a REL file, special handling is due
-		ret = cbmimage_i_validate_rel_file(image, dir_entry, &block_count) || ret;
+		ret = cbmimage_i_validate_rel_file(image, dir_entry, dir_index, &block_count) || ret;
 	}
 
 	if (dir_entry->is_geos) {
-		ret = cbmimage_i_validate_geos_file(image, dir_entry, &block_count) || ret;
+		ret = cbmimage_i_validate_geos_file(image, dir_entry, dir_index, &block_count) || ret;
 	}
 
 	if (dir_entry->block_count != block_count) {
@@ -889,6 +982,8 @@ cbmimage_i_validate_process_file(
 		cbmimage_i_fmt_print("\nFile \"%s\" reports %u blocks, but occupies %u blocks.\n", name_buffer, dir_entry->block_count, block_count);
 		ret = 1;
 	}
+
+	return ret;
 }
 
 /** @brief validate the disk (and the bam)
@@ -934,8 +1029,11 @@ cbmimage_validate(
 
 		// now, iterate through all internal data structures and mark the blocks as used
 
+		// the info block, the BAM and the directory form a chain of system structures
+		cbmimage_block_owner owner_system = { .type = BLOCK_OWNER_DIRECTORY, .dir_index = 0 };
+
 		if (ret == 0) {
-			ret = cbmimage_i_validate_follow_chain(image, settings->info->block, NULL);
+			ret = cbmimage_i_validate_follow_chain(image, settings->info->block, NULL, owner_system);
 		}
 
 		if (ret == 0 && settings->bam != NULL) {
@@ -943,28 +1041,30 @@ cbmimage_validate(
 			// This is because the info and the BAM block are the same on some drives
 			// (i.e., D64, D40, ...)
 			if (!cbmimage_fat_is_used(image->settings->fat, settings->bam[0].block)) {
-				ret = cbmimage_i_validate_follow_chain(image, settings->bam[0].block, NULL);
+				ret = cbmimage_i_validate_follow_chain(image, settings->bam[0].block, NULL, owner_system);
 			}
 		}
 
 		if (ret == 0 && settings->geos_border.lba != 0) {
 			// mark the GEOS border block as used
-				ret = cbmimage_i_validate_follow_chain(image, settings->geos_border, NULL);
+			cbmimage_block_owner owner_geos_border = { .type = BLOCK_OWNER_GEOS_BORDER, .dir_index = 0 };
+			ret = cbmimage_i_validate_follow_chain(image, settings->geos_border, NULL, owner_geos_border);
 		}
 
 		// iterate through all files and mark their blocks as used
 		cbmimage_dir_entry * dir_entry;
+		uint16_t dir_index = 0;
 
 		for (dir_entry = cbmimage_dir_get_first(image);
 				 cbmimage_dir_get_is_valid(dir_entry);
-				 cbmimage_dir_get_next(dir_entry)
+				 cbmimage_dir_get_next(dir_entry), ++dir_index
 				)
 		{
 			if (cbmimage_dir_is_deleted(dir_entry)) {
 				continue;
 			}
 
-			ret = cbmimage_i_validate_process_file(image, dir_entry) || ret;
+			ret = cbmimage_i_validate_process_file(image, dir_entry, dir_index) || ret;
 
 		}
 
@@ -980,5 +1080,8 @@ cbmimage_validate(
 		ret = cbmimage_i_bam_check_equality(image) | ret;
 	}
 
+	// the FAT is mostly read from now on, thus, store it memory efficient
+	cbmimage_fat_compact(settings->fat);
+
 	return ret;
 }
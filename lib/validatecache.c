@@ -0,0 +1,381 @@
+/** @file lib/validatecache.c \n
+ * @author Spiro Trikaliotis \n
+ * \n
+ * @brief cbmimage: cache for the results of a validation
+ *
+ * Validating an image is expensive, as all chains on the image have to be
+ * followed. If the same image is validated again and again, the result of
+ * the validation (the FAT, the owners of the blocks and the verdict) can be
+ * stored in a sidecar file, and be loaded from there instead of being
+ * recomputed.
+ *
+ * The sidecar file is keyed by a hash of the contents of the image. If the
+ * image changes, the sidecar file is not used anymore.
+ *
+ * The layout of the sidecar file is (all values little endian):
+ *
+ * | offset   | size | contents                                     |
+ * |----------|------|----------------------------------------------|
+ * | 0        | 6    | magic "CBMFAT"                               |
+ * | 6        | 2    | version of the file format                   |
+ * | 8        | 8    | hash of the image, cf. cbmimage_image_hash() |
+ * | 16       | 4    | number of elements n in the FAT              |
+ * | 20       | 4    | verdict, as returned by cbmimage_validate()  |
+ * | 24       | 2*n  | FAT entries, one per LBA                     |
+ * | 24 + 2*n | 4*n  | owners: type (2 byte) and dir index (2 byte) |
+ *
+ * As it only consists of a fixed header and flat arrays, the file can also
+ * be mapped into memory directly.
+ *
+ * @defgroup cbmimage_validatecache validation cache functions
+ */
+#include "cbmimage/internal.h"
+#include "cbmimage/alloc.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief @internal magic at the beginning of a sidecar file */
+static const uint8_t cbmimage_i_validatecache_magic[6] = { 'C', 'B', 'M', 'F', 'A', 'T' };
+
+/** @brief @internal the version of the sidecar file format */
+#define CBMIMAGE_VALIDATECACHE_VERSION 1
+
+/** @brief @internal the size of the header of a sidecar file */
+#define CBMIMAGE_VALIDATECACHE_HEADER_SIZE 24
+
+/** @brief @internal the size of one FAT entry in a sidecar file */
+#define CBMIMAGE_VALIDATECACHE_ENTRY_SIZE 2
+
+/** @brief @internal the size of one owner in a sidecar file */
+#define CBMIMAGE_VALIDATECACHE_OWNER_SIZE 4
+
+/** @brief @internal store a value as little endian
+ * @ingroup cbmimage_validatecache
+ *
+ * @param[out] buffer
+ *    pointer to the buffer where the value is stored
+ *
+ * @param[in] value
+ *    the value to store
+ *
+ * @param[in] count
+ *    the number of bytes to store
+ */
+static
+void
+cbmimage_i_validatecache_put(
+		uint8_t * buffer,
+		uint64_t  value,
+		size_t    count
+		)
+{
+	for (size_t i = 0; i < count; ++i) {
+		buffer[i] = value & 0xFFu;
+		value >>= 8;
+	}
+}
+
+/** @brief @internal get a little endian value
+ * @ingroup cbmimage_validatecache
+ *
+ * @param[in] buffer
+ *    pointer to the buffer where the value is stored
+ *
+ * @param[in] count
+ *    the number of bytes of the value
+ *
+ * @return
+ *    the value
+ */
+static
+uint64_t
+cbmimage_i_validatecache_get(
+		const uint8_t * buffer,
+		size_t          count
+		)
+{
+	uint64_t value = 0;
+
+	for (size_t i = count; i > 0; --i) {
+		value = (value << 8) | buffer[i - 1];
+	}
+
+	return value;
+}
+
+/** @brief calculate a hash of the contents of the image
+ * @ingroup cbmimage_validatecache
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @return
+ *    the hash of the image
+ *
+ * @remark
+ *   - The hash is a 64 bit FNV-1a hash of the raw image.
+ *   - If a subdir or partition is active, its location is part
+ *     of the hash, too.
+ */
+uint64_t
+cbmimage_image_hash(
+		cbmimage_fileimage * image
+		)
+{
+	assert(image != NULL);
+
+	cbmimage_image_parameter * parameter = image->parameter;
+	cbmimage_image_settings *  settings  = image->settings;
+
+	uint64_t hash = 0xCBF29CE484222325u;
+
+	const uint8_t * buffer = parameter->buffer;
+
+	for (size_t i = 0; i < parameter->size; ++i) {
+		hash ^= buffer[i];
+		hash *= 0x100000001B3u;
+	}
+
+	uint8_t subdir[10];
+
+	cbmimage_i_validatecache_put(&subdir[0], settings->block_subdir_first.lba, 2);
+	cbmimage_i_validatecache_put(&subdir[2], settings->subdir_data_offset, 8);
+
+	for (size_t i = 0; i < sizeof subdir; ++i) {
+		hash ^= subdir[i];
+		hash *= 0x100000001B3u;
+	}
+
+	return hash;
+}
+
+/** @brief store the result of a validation in a sidecar file
+ * @ingroup cbmimage_validatecache
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] filename
+ *    the name of the sidecar file
+ *
+ * @param[in] verdict
+ *    the result of cbmimage_validate()
+ *
+ * @return
+ *    - 0 if the sidecar file was written
+ *    - != 0 if an error occurred
+ *
+ * @remark
+ *   - The image must have been validated before.
+ */
+int
+cbmimage_validate_cache_save(
+		cbmimage_fileimage * image,
+		const char *         filename,
+		int                  verdict
+		)
+{
+	int ret = -1;
+
+	assert(image != NULL);
+	assert(filename != NULL);
+
+	cbmimage_fat * fat = image->settings->fat;
+
+	if (fat == NULL) {
+		return -1;
+	}
+
+	size_t size = CBMIMAGE_VALIDATECACHE_HEADER_SIZE
+		+ fat->elements * (CBMIMAGE_VALIDATECACHE_ENTRY_SIZE + CBMIMAGE_VALIDATECACHE_OWNER_SIZE);
+
+	uint8_t * buffer = cbmimage_i_xalloc(size);
+
+	if (buffer == NULL) {
+		return -1;
+	}
+
+	memcpy(buffer, cbmimage_i_validatecache_magic, sizeof cbmimage_i_validatecache_magic);
+	cbmimage_i_validatecache_put(&buffer[6],  CBMIMAGE_VALIDATECACHE_VERSION, 2);
+	cbmimage_i_validatecache_put(&buffer[8],  cbmimage_image_hash(image), 8);
+	cbmimage_i_validatecache_put(&buffer[16], fat->elements, 4);
+	cbmimage_i_validatecache_put(&buffer[20], (uint32_t) verdict, 4);
+
+	uint8_t * p_entry = &buffer[CBMIMAGE_VALIDATECACHE_HEADER_SIZE];
+	uint8_t * p_owner = p_entry + fat->elements * CBMIMAGE_VALIDATECACHE_ENTRY_SIZE;
+
+	for (size_t i = 0; i < fat->elements; ++i) {
+		cbmimage_block_owner owner = cbmimage_i_fat_get_owner_lba(fat, i);
+
+		cbmimage_i_validatecache_put(p_entry, cbmimage_i_fat_get_lba(fat, i), 2);
+		cbmimage_i_validatecache_put(&p_owner[0], owner.type, 2);
+		cbmimage_i_validatecache_put(&p_owner[2], owner.dir_index, 2);
+
+		p_entry += CBMIMAGE_VALIDATECACHE_ENTRY_SIZE;
+		p_owner += CBMIMAGE_VALIDATECACHE_OWNER_SIZE;
+	}
+
+	FILE * f = fopen(filename, "wb");
+	if (f) {
+		if (fwrite(buffer, size, 1, f) == 1) {
+			ret = 0;
+		}
+		if (fclose(f) != 0) {
+			ret = -1;
+		}
+	}
+
+	cbmimage_i_xfree(buffer);
+
+	return ret;
+}
+
+/** @brief load the result of a validation from a sidecar file
+ * @ingroup cbmimage_validatecache
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] filename
+ *    the name of the sidecar file
+ *
+ * @param[out] verdict
+ *    pointer to a variable that will contain the result of the validation
+ *    as it was returned by cbmimage_validate(). Can be NULL.
+ *
+ * @return
+ *    - 0 if the sidecar file was loaded. In this case, the FAT of the image
+ *      is set as if cbmimage_validate() had been called.
+ *    - != 0 if the sidecar file does not exist, is invalid, or does not
+ *      belong to the contents of this image.
+ *
+ * @remark
+ *   - The image must not have been validated before.
+ */
+int
+cbmimage_validate_cache_load(
+		cbmimage_fileimage * image,
+		const char *         filename,
+		int *                verdict
+		)
+{
+	int ret = -1;
+
+	assert(image != NULL);
+	assert(filename != NULL);
+
+	cbmimage_image_settings * settings = image->settings;
+
+	assert(settings->fat == NULL);
+
+	if (settings->fat != NULL) {
+		return -1;
+	}
+
+	FILE * f = fopen(filename, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+
+	cbmimage_fat * fat = cbmimage_fat_create(image);
+
+	uint8_t header[CBMIMAGE_VALIDATECACHE_HEADER_SIZE];
+
+	if ( fat
+	  && fread(header, sizeof header, 1, f) == 1
+	  && memcmp(header, cbmimage_i_validatecache_magic, sizeof cbmimage_i_validatecache_magic) == 0
+	  && cbmimage_i_validatecache_get(&header[6], 2) == CBMIMAGE_VALIDATECACHE_VERSION
+	  && cbmimage_i_validatecache_get(&header[16], 4) == fat->elements
+	  && cbmimage_i_validatecache_get(&header[8], 8) == cbmimage_image_hash(image)
+	   )
+	{
+		size_t size = fat->elements * (CBMIMAGE_VALIDATECACHE_ENTRY_SIZE + CBMIMAGE_VALIDATECACHE_OWNER_SIZE);
+
+		uint8_t * buffer = cbmimage_i_xalloc(size);
+
+		if (buffer && fread(buffer, size, 1, f) == 1) {
+			const uint8_t * p_entry = buffer;
+			const uint8_t * p_owner = buffer + fat->elements * CBMIMAGE_VALIDATECACHE_ENTRY_SIZE;
+
+			ret = 0;
+
+			for (size_t i = 0; i < fat->elements; ++i) {
+				uint16_t lba  = cbmimage_i_validatecache_get(p_entry, 2);
+				uint16_t type = cbmimage_i_validatecache_get(&p_owner[0], 2);
+
+				if ( (type >= BLOCK_OWNER_LAST)
+				  || (lba != CBMIMAGE_FAT_LASTBLOCK && lba >= fat->elements)
+				   )
+				{
+					ret = -1;
+					break;
+				}
+
+				fat->entry[i].lba = lba;
+				fat->owner[i].type = type;
+				fat->owner[i].dir_index = cbmimage_i_validatecache_get(&p_owner[2], 2);
+
+				p_entry += CBMIMAGE_VALIDATECACHE_ENTRY_SIZE;
+				p_owner += CBMIMAGE_VALIDATECACHE_OWNER_SIZE;
+			}
+		}
+
+		cbmimage_i_xfree(buffer);
+	}
+
+	fclose(f);
+
+	if (ret == 0) {
+		cbmimage_fat_compact(fat);
+
+		settings->fat = fat;
+
+		if (verdict) {
+			*verdict = (int32_t) cbmimage_i_validatecache_get(&header[20], 4);
+		}
+	}
+	else {
+		cbmimage_fat_close(fat);
+	}
+
+	return ret;
+}
+
+/** @brief validate the disk, using a sidecar file as cache
+ * @ingroup cbmimage_validatecache
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] filename
+ *    the name of the sidecar file
+ *
+ * @return
+ *    - 0 if the BAM is consistent
+ *    - != 0 if not
+ *
+ * @remark
+ *   - If the sidecar file belongs to the contents of the image, the result
+ *     of the validation is loaded from it. Otherwise, cbmimage_validate()
+ *     is called and its result is stored in the sidecar file.
+ *   - If the result is loaded from the sidecar file, the messages
+ *     cbmimage_validate() outputs are not repeated.
+ */
+int
+cbmimage_validate_cached(
+		cbmimage_fileimage * image,
+		const char *         filename
+		)
+{
+	int verdict;
+
+	if (cbmimage_validate_cache_load(image, filename, &verdict) != 0) {
+		verdict = cbmimage_validate(image);
+
+		cbmimage_validate_cache_save(image, filename, verdict);
+	}
+
+	return verdict;
+}
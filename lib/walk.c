@@ -0,0 +1,198 @@
+/** @file lib/walk.c \n
+ * @author Spiro Trikaliotis \n
+ * \n
+ * @brief cbmimage: walk all directories and partitions of an image
+ *
+ * cbmimage_walk() visits every entry of the directory, and descends into
+ * every partition and sub-directory (depth first). This way, the whole
+ * image can be listed without driving cbmimage_dir_chdir() and
+ * cbmimage_dir_chdir_close() manually.
+ */
+#include "cbmimage/internal.h"
+#include "cbmimage/alloc.h"
+
+#include <assert.h>
+
+/** @brief @internal the state of a walk
+ * @ingroup cbmimage_dir
+ */
+typedef
+struct cbmimage_i_walk_s {
+
+	/// the image that is walked
+	cbmimage_fileimage * image;
+
+	/// the visitor
+	cbmimage_walk_visitor * visitor;
+
+	/// the context for the visitor
+	void * context;
+
+	/// the entries of the directories the walk is in, indexed by the depth
+	cbmimage_dir_entry * parent[CBMIMAGE_WALK_DEPTH_MAX];
+
+	/** the settings for the directories the walk descends into, indexed by the
+	 * depth of the directory that contains the entry. \n
+	 * They are allocated once, and used for every chdir on the same depth.
+	 */
+	cbmimage_image_settings * frame;
+
+} cbmimage_i_walk;
+
+/** @brief @internal check if a directory entry is a directory or partition
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] dir_entry
+ *    the directory entry
+ *
+ * @return
+ *    - != 0 if cbmimage_walk() descends into the entry
+ *    - 0 otherwise
+ */
+static int
+cbmimage_i_walk_is_dir(
+		cbmimage_dir_entry * dir_entry
+		)
+{
+	switch (dir_entry->type) {
+		case DIR_TYPE_PART1581:
+		case DIR_TYPE_CMD_NATIVE:
+		case DIR_TYPE_PART_CMD_NATIVE:
+		case DIR_TYPE_PART_D64:
+		case DIR_TYPE_PART_D71:
+		case DIR_TYPE_PART_D81:
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+/** @brief @internal walk the current directory
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] walk
+ *    the state of the walk
+ *
+ * @param[in] depth
+ *    the depth of the current directory
+ *
+ * @return
+ *    - 0 if the walk is to be continued
+ *    - != 0 if the visitor stopped the walk
+ */
+static int
+cbmimage_i_walk_dir(
+		cbmimage_i_walk * walk,
+		unsigned int      depth
+		)
+{
+	int ret = 0;
+
+	cbmimage_dir_entry * dir_entry;
+
+	for (dir_entry = cbmimage_dir_get_first(walk->image);
+	     cbmimage_dir_get_is_valid(dir_entry);
+	     cbmimage_dir_get_next(dir_entry)
+	    )
+	{
+		if (cbmimage_dir_is_deleted(dir_entry)) {
+			continue;
+		}
+
+		cbmimage_walk_info info = {
+			.image  = walk->image,
+			.entry  = dir_entry,
+			.depth  = depth,
+			.parent = walk->parent,
+			.is_dir = (depth + 1 < CBMIMAGE_WALK_DEPTH_MAX) && cbmimage_i_walk_is_dir(dir_entry),
+		};
+
+		cbmimage_walk_result result = walk->visitor(&info, walk->context);
+
+		if (result == WALK_STOP) {
+			ret = 1;
+			break;
+		}
+
+		if (result == WALK_PRUNE || !info.is_dir) {
+			continue;
+		}
+
+		if (cbmimage_i_dir_chdir_frame(dir_entry, &walk->frame[depth]) == 0) {
+			walk->parent[depth] = dir_entry;
+
+			ret = cbmimage_i_walk_dir(walk, depth + 1);
+
+			walk->parent[depth] = NULL;
+
+			cbmimage_dir_chdir_close(walk->image);
+
+			if (ret) {
+				break;
+			}
+		}
+	}
+
+	cbmimage_dir_get_close(dir_entry);
+
+	return ret;
+}
+
+/** @brief walk all directories and partitions of an image
+ * @ingroup cbmimage_dir
+ *
+ * @param[in] image
+ *    pointer to the image data
+ *
+ * @param[in] visitor
+ *    the function that is called for every directory entry
+ *
+ * @param[in] context
+ *    a context that is given to the visitor
+ *
+ * @return
+ *    - 0 if all entries have been visited
+ *    - 1 if the visitor stopped the walk
+ *    - -1 if an error occurred
+ *
+ * @remark
+ *    - The walk starts in the current directory of the image. Deleted
+ *      entries are not visited.
+ *    - After an entry that is a directory or partition (cf. cbmimage_walk_info)
+ *      has been visited, the walk descends into it, unless the visitor
+ *      returned WALK_PRUNE. If the chdir to the entry fails, the entry is
+ *      handled as if it was pruned.
+ *    - The walk does not descend deeper than CBMIMAGE_WALK_DEPTH_MAX - 1
+ *      directories.
+ *    - The visitor must not change the directory of the image. The
+ *      directory entries it gets are only valid during the call.
+ */
+int
+cbmimage_walk(
+		cbmimage_fileimage *    image,
+		cbmimage_walk_visitor * visitor,
+		void *                  context
+		)
+{
+	assert(image != NULL);
+	assert(visitor != NULL);
+
+	cbmimage_i_walk walk = {
+		.image   = image,
+		.visitor = visitor,
+		.context = context,
+	};
+
+	walk.frame = cbmimage_i_xalloc(CBMIMAGE_WALK_DEPTH_MAX * sizeof *walk.frame);
+
+	if (walk.frame == NULL) {
+		return -1;
+	}
+
+	int ret = cbmimage_i_walk_dir(&walk, 0);
+
+	cbmimage_i_xfree(walk.frame);
+
+	return ret;
+}
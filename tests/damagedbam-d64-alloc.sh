@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/damagedbam.d64 alloc --count=3 bam"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty.d64 alloc --count=24"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty.d64 create --name=FILE --count=10 --start=17/0 delete --name=FILE2 delete --name=FILE5 delete --name=FILE9 compact dir --snapshot bam"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty.d64 create --name=GONE --type=DEL dir --snapshot create --name=FOO"
+
+source ../make/test-helper.sh
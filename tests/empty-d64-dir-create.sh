@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty.d64 create --name=FILE --count=10 --start=17/0 --blocks=3 dir --snapshot bam"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty.d64 showfile --name=FOO create --name=FOO --type=PRG --start=17/0 --blocks=1 showfile --name=FOO showfile --name=FILE9 create --name=FILE --count=9 --start=17/0 --blocks=1 rename --name=FILE9 --to=BAR dir --snapshot"
+
+source ../make/test-helper.sh
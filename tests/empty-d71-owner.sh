@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty.d71 owner --block=53/0 owner --block=53/1 owner --block=18/0"
+
+source ../make/test-helper.sh
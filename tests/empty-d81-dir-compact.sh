@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty.d81 create --name=X --count=20 --start=1/0 delete --name=X1 delete --name=X2 delete --name=X3 delete --name=X4 delete --name=X5 compact --keep-deleted compact dir --snapshot bam"
+
+source ../make/test-helper.sh
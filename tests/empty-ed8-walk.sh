@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty-ed8.d4m walk"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/empty-hd8.d2m dir --snapshot"
+
+source ../make/test-helper.sh
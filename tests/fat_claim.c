@@ -0,0 +1,100 @@
+#include "cbmimage.h"
+#include "cbmimage/alloc.h"
+
+#include "cbmimage/testhelper.h"
+
+#include <stdlib.h>
+
+static void *
+xalloc_failing(
+		size_t size
+		)
+{
+	(void) size;
+
+	return NULL;
+}
+
+static void
+xfree_failing(
+		void * ptr
+		)
+{
+	free(ptr);
+}
+
+static int
+owner_is(
+		cbmimage_block_owner      owner,
+		cbmimage_block_owner_type type,
+		uint16_t                  dir_index
+		)
+{
+	return owner.type == type && owner.dir_index == dir_index;
+}
+
+int
+main(
+		void
+		)
+{
+	cbmimage_fileimage * image = cbmimage_image_openfile("images/empty.d64", TYPE_UNKNOWN);
+	TEST_ASSERT(image != NULL);
+
+	cbmimage_fat * fat = cbmimage_fat_create(image);
+	TEST_ASSERT(fat != NULL);
+
+	cbmimage_blockaddress block;
+	cbmimage_blockaddress target;
+	cbmimage_blockaddress target_other;
+
+	TEST_ASSERT(cbmimage_blockaddress_init_from_ts_value(image, &block, 1, 0) == 0);
+	TEST_ASSERT(cbmimage_blockaddress_init_from_ts_value(image, &target, 1, 10) == 0);
+	TEST_ASSERT(cbmimage_blockaddress_init_from_ts_value(image, &target_other, 2, 0) == 0);
+
+	cbmimage_block_owner owner_first  = { .type = BLOCK_OWNER_FILE, .dir_index = 3 };
+	cbmimage_block_owner owner_second = { .type = BLOCK_OWNER_SIDESECTOR, .dir_index = 5 };
+	cbmimage_block_owner owner_previous = { .type = BLOCK_OWNER_NONE, .dir_index = 0 };
+
+	// an unused block is claimed
+	TEST_ASSERT(cbmimage_fat_claim(fat, block, target, owner_first, &owner_previous) == 0);
+	TEST_ASSERT(owner_is(owner_previous, BLOCK_OWNER_NONE, 0));
+	TEST_ASSERT(cbmimage_fat_is_used(fat, block));
+	TEST_ASSERT(cbmimage_fat_get(fat, block).lba == target.lba);
+	TEST_ASSERT(owner_is(cbmimage_fat_get_owner(fat, block), BLOCK_OWNER_FILE, 3));
+
+	// a block that is already claimed keeps its owner, and reports it back
+	TEST_ASSERT(cbmimage_fat_claim(fat, block, target_other, owner_second, &owner_previous) == 1);
+	TEST_ASSERT(owner_is(owner_previous, BLOCK_OWNER_FILE, 3));
+	TEST_ASSERT(owner_is(cbmimage_fat_get_owner(fat, block), BLOCK_OWNER_FILE, 3));
+	TEST_ASSERT(cbmimage_fat_get(fat, block).lba == target_other.lba);
+
+	// owner_previous is optional
+	TEST_ASSERT(cbmimage_fat_claim(fat, block, target, owner_second, NULL) == 1);
+	TEST_ASSERT(cbmimage_fat_get(fat, block).lba == target.lba);
+
+	// if the compacted FAT cannot be made dense again, this is an error, and the FAT is unchanged
+	TEST_ASSERT(cbmimage_fat_compact(fat) == 0);
+
+	owner_previous.type = BLOCK_OWNER_NONE;
+	owner_previous.dir_index = 0;
+
+	cbmimage_alloc_set_functions(xalloc_failing, xfree_failing, NULL);
+	int ret = cbmimage_fat_claim(fat, target_other, target, owner_second, &owner_previous);
+	cbmimage_alloc_set_functions(NULL, NULL, NULL);
+
+	TEST_ASSERT(ret == -1);
+	TEST_ASSERT(owner_is(owner_previous, BLOCK_OWNER_NONE, 0));
+	TEST_ASSERT(!cbmimage_fat_is_used(fat, target_other));
+	TEST_ASSERT(owner_is(cbmimage_fat_get_owner(fat, block), BLOCK_OWNER_FILE, 3));
+	TEST_ASSERT(cbmimage_fat_get(fat, block).lba == target.lba);
+
+	// with memory, the same claim succeeds
+	TEST_ASSERT(cbmimage_fat_claim(fat, target_other, target, owner_second, &owner_previous) == 0);
+	TEST_ASSERT(owner_is(cbmimage_fat_get_owner(fat, target_other), BLOCK_OWNER_SIDESECTOR, 5));
+
+	cbmimage_fat_close(fat);
+	cbmimage_image_close(image);
+
+	return 0;
+}
@@ -0,0 +1,152 @@
+#include "cbmimage/internal.h"
+
+#include "cbmimage/testhelper.h"
+
+#include <stdlib.h>
+
+typedef struct fat_snapshot_s {
+	uint16_t *             lba;
+	cbmimage_block_owner * owner;
+} fat_snapshot;
+
+static int
+owner_is_equal(
+		cbmimage_block_owner owner1,
+		cbmimage_block_owner owner2
+		)
+{
+	return owner1.type == owner2.type && owner1.dir_index == owner2.dir_index;
+}
+
+static void
+snapshot_take(
+		cbmimage_fileimage * image,
+		cbmimage_fat *       fat,
+		fat_snapshot *       snapshot
+		)
+{
+	snapshot->lba   = calloc(fat->elements, sizeof snapshot->lba[0]);
+	snapshot->owner = calloc(fat->elements, sizeof snapshot->owner[0]);
+	TEST_ASSERT(snapshot->lba != NULL);
+	TEST_ASSERT(snapshot->owner != NULL);
+
+	cbmimage_blockaddress block;
+	cbmimage_blockaddress_init_from_lba_value(image, &block, 1);
+
+	do {
+		snapshot->lba[block.lba]   = cbmimage_fat_get(fat, block).lba;
+		snapshot->owner[block.lba] = cbmimage_fat_get_owner(fat, block);
+	} while (!cbmimage_blockaddress_advance(image, &block));
+}
+
+static void
+snapshot_compare(
+		cbmimage_fileimage * image,
+		cbmimage_fat *       fat,
+		const fat_snapshot * snapshot
+		)
+{
+	cbmimage_blockaddress block;
+	cbmimage_blockaddress_init_from_lba_value(image, &block, 1);
+
+	do {
+		TEST_ASSERT(cbmimage_fat_get(fat, block).lba == snapshot->lba[block.lba]);
+		TEST_ASSERT(owner_is_equal(cbmimage_fat_get_owner(fat, block), snapshot->owner[block.lba]));
+	} while (!cbmimage_blockaddress_advance(image, &block));
+}
+
+static void
+snapshot_free(
+		fat_snapshot * snapshot
+		)
+{
+	free(snapshot->lba);
+	free(snapshot->owner);
+}
+
+int
+main(
+		void
+		)
+{
+	cbmimage_fileimage * image = cbmimage_image_openfile("images/simpletest.d64", TYPE_UNKNOWN);
+	TEST_ASSERT(image != NULL);
+
+	cbmimage_validate(image);
+
+	cbmimage_fat * fat_validated = image->settings->fat;
+	TEST_ASSERT(fat_validated != NULL);
+
+	// build a dense copy of the FAT of the validated image
+	cbmimage_fat * fat = cbmimage_fat_create(image);
+	TEST_ASSERT(fat != NULL);
+	TEST_ASSERT(fat->entry != NULL);
+
+	cbmimage_blockaddress block;
+	cbmimage_blockaddress_init_from_lba_value(image, &block, 1);
+
+	int count_used = 0;
+
+	do {
+		if (!cbmimage_fat_is_used(fat_validated, block)) {
+			continue;
+		}
+
+		++count_used;
+
+		cbmimage_blockaddress target = cbmimage_fat_get(fat_validated, block);
+
+		if (target.lba == CBMIMAGE_FAT_LASTBLOCK) {
+			target.lba = 0;
+		}
+
+		TEST_ASSERT(cbmimage_fat_set(fat, block, target) == 0);
+		TEST_ASSERT(cbmimage_fat_set_owner(fat, block, cbmimage_fat_get_owner(fat_validated, block)) == 0);
+	} while (!cbmimage_blockaddress_advance(image, &block));
+
+	TEST_ASSERT(count_used > 0);
+
+	fat_snapshot snapshot;
+	snapshot_take(image, fat, &snapshot);
+
+	// compacting keeps every entry and every owner
+	TEST_ASSERT(cbmimage_fat_compact(fat) == 0);
+	TEST_ASSERT(fat->entry == NULL);
+	TEST_ASSERT(fat->owner == NULL);
+	TEST_ASSERT(fat->extent != NULL);
+	TEST_ASSERT(fat->owner_extent != NULL);
+
+	snapshot_compare(image, fat, &snapshot);
+
+	// compacting again does not change anything
+	TEST_ASSERT(cbmimage_fat_compact(fat) == 0);
+	snapshot_compare(image, fat, &snapshot);
+
+	// a modification writes the FAT back into the dense representation
+	cbmimage_blockaddress block_modified;
+	cbmimage_blockaddress target_modified;
+	TEST_ASSERT(cbmimage_blockaddress_init_from_ts_value(image, &block_modified, 1, 0) == 0);
+	TEST_ASSERT(cbmimage_blockaddress_init_from_ts_value(image, &target_modified, 1, 10) == 0);
+	TEST_ASSERT(!cbmimage_fat_is_used(fat, block_modified));
+
+	TEST_ASSERT(cbmimage_fat_set(fat, block_modified, target_modified) == 0);
+	TEST_ASSERT(fat->entry != NULL);
+	TEST_ASSERT(fat->owner != NULL);
+	TEST_ASSERT(fat->extent == NULL);
+	TEST_ASSERT(fat->owner_extent == NULL);
+
+	snapshot.lba[block_modified.lba] = target_modified.lba;
+	snapshot_compare(image, fat, &snapshot);
+
+	// and the modified FAT can be compacted again
+	TEST_ASSERT(cbmimage_fat_compact(fat) == 0);
+	TEST_ASSERT(fat->entry == NULL);
+	snapshot_compare(image, fat, &snapshot);
+
+	snapshot_free(&snapshot);
+
+	cbmimage_fat_close(fat);
+	cbmimage_image_close(image);
+
+	return 0;
+}
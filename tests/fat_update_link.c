@@ -0,0 +1,164 @@
+#include "cbmimage/internal.h"
+
+#include "cbmimage/testhelper.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define IMAGE_NAME "images/simpletest.d64"
+
+static int cross_link_reported = 0;
+
+static void
+print_count_cross_links(
+		const char * text
+		)
+{
+	if (strstr(text, "Marking already marked block") != NULL) {
+		cross_link_reported = 1;
+	}
+
+	fputs(text, stdout);
+}
+
+static int
+owner_is_equal(
+		cbmimage_block_owner owner1,
+		cbmimage_block_owner owner2
+		)
+{
+	return owner1.type == owner2.type && owner1.dir_index == owner2.dir_index;
+}
+
+static void
+write_link(
+		cbmimage_fileimage *  image,
+		cbmimage_blockaddress block,
+		uint8_t               track,
+		uint8_t               sector
+		)
+{
+	uint8_t buffer[256];
+
+	TEST_ASSERT(cbmimage_read_block(image, block, buffer, sizeof buffer) >= 0);
+
+	buffer[0] = track;
+	buffer[1] = sector;
+
+	TEST_ASSERT(cbmimage_write_block(image, block, buffer, sizeof buffer) == 0);
+}
+
+/* Change the link of a block of a validated image, and compare the FAT
+ * that is updated incrementally with the FAT of an image that is
+ * validated after the same change.
+ */
+static void
+check_update_link(
+		cbmimage_fat *        fat_original,
+		cbmimage_blockaddress block,
+		uint8_t               track,
+		uint8_t               sector
+		)
+{
+	cbmimage_fileimage * image_incremental = cbmimage_image_openfile(IMAGE_NAME, TYPE_UNKNOWN);
+	cbmimage_fileimage * image_fresh = cbmimage_image_openfile(IMAGE_NAME, TYPE_UNKNOWN);
+	TEST_ASSERT(image_incremental != NULL);
+	TEST_ASSERT(image_fresh != NULL);
+
+	cbmimage_validate(image_incremental);
+
+	cross_link_reported = 0;
+	write_link(image_incremental, block, track, sector);
+	int is_cross_link_reported = cross_link_reported;
+
+	write_link(image_fresh, block, track, sector);
+	cbmimage_validate(image_fresh);
+
+	cbmimage_fat * fat_incremental = image_incremental->settings->fat;
+	cbmimage_fat * fat_fresh = image_fresh->settings->fat;
+	TEST_ASSERT(fat_incremental != NULL);
+	TEST_ASSERT(fat_fresh != NULL);
+
+	// if the new link leads into the blocks of another owner, it is a cross-link
+	cbmimage_blockaddress target;
+	int is_cross_link = 0;
+
+	if ( cbmimage_blockaddress_ts_exists(image_fresh, track, sector)
+	  && cbmimage_blockaddress_init_from_ts_value(image_fresh, &target, track, sector) == 0
+	   )
+	{
+		cbmimage_block_owner owner_target = cbmimage_fat_get_owner(fat_original, target);
+
+		is_cross_link = owner_target.type != BLOCK_OWNER_NONE
+			&& !owner_is_equal(owner_target, cbmimage_fat_get_owner(fat_original, block));
+	}
+
+	TEST_ASSERT(is_cross_link_reported == is_cross_link);
+
+	cbmimage_blockaddress block_current;
+	cbmimage_blockaddress_init_from_lba_value(image_fresh, &block_current, 1);
+
+	do {
+		TEST_ASSERT(cbmimage_fat_get(fat_incremental, block_current).lba == cbmimage_fat_get(fat_fresh, block_current).lba);
+
+		// on a cross-link, the blocks of the other owner keep their owner
+		if (!is_cross_link) {
+			TEST_ASSERT(owner_is_equal(cbmimage_fat_get_owner(fat_incremental, block_current), cbmimage_fat_get_owner(fat_fresh, block_current)));
+		}
+	} while (!cbmimage_blockaddress_advance(image_fresh, &block_current));
+
+	cbmimage_image_close(image_fresh);
+	cbmimage_image_close(image_incremental);
+}
+
+int
+main(
+		void
+		)
+{
+	cbmimage_print_set_function(print_count_cross_links);
+
+	cbmimage_fileimage * image = cbmimage_image_openfile(IMAGE_NAME, TYPE_UNKNOWN);
+	TEST_ASSERT(image != NULL);
+
+	cbmimage_validate(image);
+
+	cbmimage_fat * fat = image->settings->fat;
+	TEST_ASSERT(fat != NULL);
+
+	int count_file_blocks = 0;
+
+	cbmimage_blockaddress block;
+	cbmimage_blockaddress_init_from_lba_value(image, &block, 1);
+
+	do {
+		if (cbmimage_fat_get_owner(fat, block).type != BLOCK_OWNER_FILE) {
+			continue;
+		}
+
+		++count_file_blocks;
+
+		check_update_link(fat, block, 0, 255);
+		check_update_link(fat, block, 30, 0);
+		check_update_link(fat, block, 13, 1);
+	} while (!cbmimage_blockaddress_advance(image, &block));
+
+	TEST_ASSERT(count_file_blocks > 0);
+
+	// if the FAT entry does not match the old link, the FAT is not changed
+	cbmimage_blockaddress_init_from_lba_value(image, &block, 1);
+
+	while (cbmimage_fat_get_owner(fat, block).type != BLOCK_OWNER_FILE) {
+		TEST_ASSERT(cbmimage_blockaddress_advance(image, &block) == 0);
+	}
+
+	uint16_t lba_target = cbmimage_fat_get(fat, block).lba;
+	const uint8_t link_wrong[2] = { 30, 0 };
+
+	TEST_ASSERT(cbmimage_i_fat_update_link(fat, block, link_wrong) == 2);
+	TEST_ASSERT(cbmimage_fat_get(fat, block).lba == lba_target);
+
+	cbmimage_image_close(image);
+
+	return 0;
+}
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/partition1581.d81 dir --json"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/partition1581.d81 showfile --name=CREATE4"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/relfiletest.d64 owner"
+
+source ../make/test-helper.sh
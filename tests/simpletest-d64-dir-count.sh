@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/simpletest.d64 dir --count"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/simpletest.d64 delete --name=252 rename --name=253 --to=RENAMED create --name=ADDED --type=SEQ --start=17/0 --blocks=1 dir --snapshot"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/simpletest.d64 dir --json"
+
+source ../make/test-helper.sh
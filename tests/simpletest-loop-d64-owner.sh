@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/simpletest-loop.d64 owner --block=17/0"
+
+source ../make/test-helper.sh
@@ -0,0 +1,9 @@
+#!/bin/bash
+
+CACHEFILE=../output/testresults/simpletest-loop-d64-validate-cache.fatcache
+
+rm -f $CACHEFILE
+
+EXEC="../output/cbmimage/cbmimage open images/simpletest-loop.d64 validate --cache=$CACHEFILE open images/simpletest-loop.d64 validate --cache=$CACHEFILE owner"
+
+source ../make/test-helper.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+EXEC="../output/cbmimage/cbmimage open images/simpletest-loop.d64 validate --fix checkbam bam"
+
+source ../make/test-helper.sh